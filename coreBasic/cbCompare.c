@@ -0,0 +1,89 @@
+/***************************************************************
+ 
+ cBasic - coreBasic - BASIC Language Interpreter on iOS
+ Copyright 2011 Jeremy Bridon - See License.txt for info
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+***************************************************************/
+
+#include "cbCompare.h"
+
+// Comparator state: the expected output, how much of it matched, and how it compares so far (short
+// of the expected output until all of it matched, or the output went wrong)
+typedef struct __cbComparator
+{
+    const char* Expected;
+    size_t ExpectedLength;
+    size_t Offset;
+    cbCompareResult Result;
+} cbComparator;
+
+cbError cbCompare_Start(cbVirtualMachine* Processor, const char* Expected, size_t ExpectedLength)
+{
+    if(Processor == NULL || (Expected == NULL && ExpectedLength > 0))
+        return cbError_Null;
+    
+    cbCompare_Stop(Processor);
+    
+    cbComparator* Comparator = malloc(sizeof(cbComparator));
+    if(Comparator == NULL)
+        return cbError_Overflow;
+    
+    Comparator->Expected = Expected;
+    Comparator->ExpectedLength = ExpectedLength;
+    Comparator->Offset = 0;
+    Comparator->Result = cbCompareResult_Short;
+    Processor->Comparator = Comparator;
+    return cbError_None;
+}
+
+void cbCompare_Stop(cbVirtualMachine* Processor)
+{
+    if(Processor == NULL || Processor->Comparator == NULL)
+        return;
+    
+    cbStep_TakeRequests(Processor, cbRequest_Mismatch);
+    free(Processor->Comparator);
+    Processor->Comparator = NULL;
+}
+
+cbCompareResult cbCompare_GetResult(cbVirtualMachine* Processor, size_t* Offset)
+{
+    if(Processor == NULL || Processor->Comparator == NULL)
+        return cbCompareResult_Mismatch;
+    
+    cbComparator* Comparator = Processor->Comparator;
+    if(Offset != NULL)
+        *Offset = Comparator->Offset;
+    
+    if(Comparator->Result == cbCompareResult_Short && Comparator->Offset == Comparator->ExpectedLength)
+        return cbCompareResult_Match;
+    return Comparator->Result;
+}
+
+void cbCompare_Output(cbVirtualMachine* Processor, const char* Text, size_t Length)
+{
+    // Only the first difference is of any use
+    cbComparator* Comparator = Processor->Comparator;
+    if(Comparator->Result != cbCompareResult_Short)
+        return;
+    
+    // Find the first byte that differs, if any, within what is left of the expected output
+    size_t Left = Comparator->ExpectedLength - Comparator->Offset;
+    size_t Count = (Length < Left) ? Length : Left;
+    const char* Expected = Comparator->Expected + Comparator->Offset;
+    size_t Matched = Count;
+    if(memcmp(Text, Expected, Count) != 0)
+        for(Matched = 0; Text[Matched] == Expected[Matched]; Matched++);
+    Comparator->Offset += Matched;
+    
+    // Hold the program from here on
+    if(Matched < Count)
+        Comparator->Result = cbCompareResult_Mismatch;
+    else if(Length > Left)
+        Comparator->Result = cbCompareResult_Excess;
+    if(Comparator->Result != cbCompareResult_Short)
+        cbStep_PostRequest(Processor, cbRequest_Mismatch);
+}
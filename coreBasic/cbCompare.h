@@ -0,0 +1,53 @@
+/***************************************************************
+ 
+ cBasic - coreBasic - BASIC Language Interpreter on iOS
+ Copyright 2011 Jeremy Bridon - See License.txt for info
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: cbCompare.h/c
+ Desc: Expected output comparator: checks a program's output
+ against the output it should write as it is written, stopping
+ the program on the first difference (i.e. when grading).
+ 
+***************************************************************/
+
+#ifndef __CBCOMPARE_H__
+#define __CBCOMPARE_H__
+
+/*** Needed includes ***/
+
+#include "cbUtil.h"
+#include "cbTypes.h"
+#include "cbProcess.h"
+
+/*
+ Each span of output is compared against the expected output as the program writes it, before it is
+ buffered, whichever output sink is set (even none, or a runner's; see cbRunner.h). On the first byte
+ that differs, or past the end of the expected output, the mismatch request (cbRequest_Mismatch) is
+ posted, so the program stops at its next loop (or its next run) with cbError_WrongOutput rather than
+ running on to its end or a tick limit
+*/
+
+/*** Comparison Functions ***/
+
+// Start comparing all output from now on against the given expected output, which the host keeps around while
+// comparing, replacing any previous comparison; output still goes on to the output sink as usual. Returns an
+// error if the comparator can't be allocated
+__cbEXPORT cbError cbCompare_Start(cbVirtualMachine* Processor, const char* Expected, size_t ExpectedLength);
+
+// Stop comparing, taking back the mismatch request (if posted)
+__cbEXPORT void cbCompare_Stop(cbVirtualMachine* Processor);
+
+// Returns how the output compares so far, and the number of bytes that matched (the offset of the first difference)
+// if Offset is not null; not safe to call while the processor runs on another thread. Once the program halted, a
+// short match means some of the expected output was never written
+__cbEXPORT cbCompareResult cbCompare_GetResult(cbVirtualMachine* Processor, size_t* Offset);
+
+/*** Helper Functions ***/
+
+// Compare the given output, as the program writes it, against what is expected next
+void cbCompare_Output(cbVirtualMachine* Processor, const char* Text, size_t Length);
+
+#endif
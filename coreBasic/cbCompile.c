@@ -10,6 +10,12 @@
 
 #include "cbCompile.h"
 
+// Round the given byte offset up to the given alignment (a power of two)
+static inline size_t cbParse_Align(size_t Offset, size_t Alignment)
+{
+    return (Offset + Alignment - 1) & ~(Alignment - 1);
+}
+
 bool cbParse_CompileProgram(cbSymbolsTable* SymbolsTable, cbList* ErrorList, cbVirtualMachine* Process)
 {
     /*** Translate Lex-Tree to ByteCode ***/
@@ -21,6 +27,11 @@ bool cbParse_CompileProgram(cbSymbolsTable* SymbolsTable, cbList* ErrorList, cbV
     cbList_Init(&SymbolsTable->JumpTable);
     cbList_Init(&SymbolsTable->LabelTable);
     cbList_Init(&SymbolsTable->BlockStack);
+    cbList_Init(&SymbolsTable->UntypedVariables);
+    cbList_Init(&SymbolsTable->LineTable);
+    
+    // Find out which variables only ever hold integers, so that their math can skip type checks
+    cbParse_InferTypes(SymbolsTable);
     
     // Print the parse tree (i.e. for each line...)
     size_t LineCount = cbList_GetCount(&SymbolsTable->LexTree);
@@ -31,7 +42,7 @@ bool cbParse_CompileProgram(cbSymbolsTable* SymbolsTable, cbList* ErrorList, cbV
         if(LineNode == NULL)
             continue;
         
-        // Push the line number before parsing each line
+        // Mark the start of each line (stripped into the line table once the code is final)
         size_t LineNumber = LineNode->LineNumber;
         cbParse_LoadInstruction(SymbolsTable, cbOps_Nop, ErrorList, (int)LineNumber);
         cbParse_BuildNode(SymbolsTable, cbList_GetElement(&SymbolsTable->LexTree, i), ErrorList);
@@ -41,6 +52,32 @@ bool cbParse_CompileProgram(cbSymbolsTable* SymbolsTable, cbList* ErrorList, cbV
     if(cbList_GetCount(&SymbolsTable->BlockStack) > 0)
         cbUtil_RaiseError(ErrorList, cbError_BlockMismatch, 0);
     
+    // Match all goto's with labels, while the instructions are still in the list
+    while(cbList_GetCount(&SymbolsTable->JumpTable) > 0)
+    {
+        // Pop off the instruction we need to update and the label's name
+        cbJump* Jump = cbList_PopFront(&SymbolsTable->JumpTable);
+        
+        // Find the label in the labels list
+        int LabelObjIndex = cbList_FindOffset(&SymbolsTable->LabelTable, Jump->LabelName, cbList_CompareLabelName);
+        if(LabelObjIndex >= 0)
+        {
+            // Get the label info, the current instruction position, and set the jump offset
+            cbLabel* LabelObj = cbList_GetElement(&SymbolsTable->LabelTable, LabelObjIndex);
+            int InstrIndex = cbList_FindOffset(&SymbolsTable->InstructionsList, Jump->Instr, cbList_ComparePointer);
+            
+            // Offset = Label dest. - jump origin (in instructions)
+            Jump->Instr->Arg = (int)LabelObj->Index - InstrIndex;
+        }
+        // Else, never found, error
+        else
+            cbUtil_RaiseError(ErrorList, cbError_MissingLabel, Jump->LineNumber);
+        
+        // All done with this jump object
+        free(Jump->LabelName);
+        free(Jump);
+    }
+    
     /*** Place ByteCode into Memory ***/
     
     // 1. Push a stack-init function if there are any variables on the stack:
@@ -58,40 +95,56 @@ bool cbParse_CompileProgram(cbSymbolsTable* SymbolsTable, cbList* ErrorList, cbV
     // when the program exits normally
     cbParse_LoadInstruction(SymbolsTable, cbOps_Halt, ErrorList, 0);
     
-    // 3. Check: will we have enough space for all the instructions, variables, and strings?
+    // 3. Now that all jumps are relative: translate into the register machine's three-address code if
+    // asked for, else fuse the most common op sequences. Code that can't be translated stays stack code
+    bool IsRegisterCode = (Process->Options & cbOption_RegisterMachine) && cbParse_BuildRegisters(SymbolsTable, VarCount);
+    if(!IsRegisterCode)
+    {
+        Process->Options &= ~cbOption_RegisterMachine;
+        cbParse_FuseInstructions(SymbolsTable);
+    }
+    size_t InstrSize = IsRegisterCode ? sizeof(cbRegInstruction) : sizeof(cbInstruction);
+    
+    // Move the line markers out of the code and into the line table
+    cbParse_BuildLineTable(SymbolsTable, IsRegisterCode);
+    
+    // 4. Check: will we have enough space for all the instructions, variables, strings, and the line table?
+    // Each region is sized in bytes, and aligned, exactly as it is laid out below
     size_t InstrCount = cbList_GetCount(&SymbolsTable->InstructionsList);
     size_t DataCount = cbList_GetCount(&SymbolsTable->DataList);
-    size_t TotalByteCount = sizeof(cbInstruction) * InstrCount + sizeof(cbVariable) + DataCount;
+    size_t LineEntryCount = cbList_GetCount(&SymbolsTable->LineTable);
+    size_t TotalByteCount = InstrSize * InstrCount + DataCount * sizeof(cbVariable);
     
-    // Add all string data from variables
+    // Add all string data from variables, each with its (aligned) length
     for(int i = 0; i < DataCount; i++)
     {
         cbVariable* var = cbList_GetElement(&SymbolsTable->DataList, i);
         if(var->Type == cbVariableType_String)
-            TotalByteCount += strlen(var->Data.String) + 1;
+            TotalByteCount = cbParse_Align(TotalByteCount, sizeof(int)) + sizeof(int) + strlen(var->Data.String) + 1;
     }
+    TotalByteCount = cbParse_Align(TotalByteCount, _Alignof(cbLineEntry)) + LineEntryCount * sizeof(cbLineEntry);
     
     // Are we small enough to continue compiling?
     if(TotalByteCount < Process->MemorySize)
     {
-        // 4. Copy the code segment
-        cbInstruction* Instr = NULL;
+        // 5. Copy the code segment
+        void* Instr = NULL;
         InstrCount = 0;
         
         while((Instr = cbList_PopFront(&SymbolsTable->InstructionsList)) != NULL)
         {
             // Copy over data
-            memcpy((cbInstruction*)Process->Memory + InstrCount, Instr, sizeof(cbInstruction));
+            memcpy((char*)Process->Memory + InstrSize * InstrCount, Instr, InstrSize);
             InstrCount++;
             
             // Release instruction
             free(Instr);
         }
         
-        // 5. Above code (higher address), copy over static data (i.e. some literals and variables)
+        // 6. Above code (higher address), copy over static data (i.e. some literals and variables)
         cbVariable* Var = NULL;
         Process->DataVarCount = 0;
-        Process->DataPointer = sizeof(cbInstruction) * InstrCount;
+        Process->DataPointer = InstrSize * InstrCount;
         VarCount = 0;
         
         while((Var = cbList_PopFront(&SymbolsTable->DataList)) != NULL)
@@ -107,8 +160,8 @@ bool cbParse_CompileProgram(cbSymbolsTable* SymbolsTable, cbList* ErrorList, cbV
             Process->DataVarCount++;
         }
         
-        // 6. For each data that is a string, copy the string itself to the end of the
-        // data segment, thus turning this var into a reference to the string
+        // 7. For each data that is a string, copy the string itself (after its length) to the end
+        // of the data segment, thus turning this var into a reference to the string
         
         // The offset of where the strings should be stored
         size_t ByteOffset = Process->DataPointer + DataCount * sizeof(cbVariable);
@@ -122,11 +175,17 @@ bool cbParse_CompileProgram(cbSymbolsTable* SymbolsTable, cbList* ErrorList, cbV
                 // Grab from heap
                 char* HeapString = Var->Data.String;
                 
+                // Store the (aligned) length first, so that it never has to be counted at run-time
+                int StringLength = (int)strlen(HeapString);
+                ByteOffset = cbParse_Align(ByteOffset, sizeof(int));
+                memcpy((char*)Process->Memory + ByteOffset, &StringLength, sizeof(int));
+                ByteOffset += sizeof(int);
+                
                 // Have the variable point to the new address
                 Var->Data.String = (char*)(ByteOffset - Process->DataPointer);
                 
                 // Copy the string with the null terminator
-                size_t FullStringLength = strlen(HeapString) + 1;
+                size_t FullStringLength = StringLength + 1;
                 strncpy((char*)Process->Memory + ByteOffset, HeapString, FullStringLength);
                 ByteOffset += FullStringLength;
                 
@@ -135,34 +194,26 @@ bool cbParse_CompileProgram(cbSymbolsTable* SymbolsTable, cbList* ErrorList, cbV
             }
         }
         
-        // Save the heap-starting address
-        Process->HeapPointer = ByteOffset;
+        // 8. After the strings (aligned), copy over the line table
+        ByteOffset = cbParse_Align(ByteOffset, _Alignof(cbLineEntry));
+        Process->LineTablePointer = ByteOffset;
+        Process->LineCount = 0;
         
-        // 7. Match all goto's with labels
-        while(cbList_GetCount(&SymbolsTable->JumpTable) > 0)
+        cbLineEntry* Entry = NULL;
+        while((Entry = cbList_PopFront(&SymbolsTable->LineTable)) != NULL)
         {
-            // Pop off the instruction we need to update and the label's name
-            cbJump* Jump = cbList_PopFront(&SymbolsTable->JumpTable);
-            
-            // Find the label in the labels list
-            int LabelObjIndex = cbList_FindOffset(&SymbolsTable->LabelTable, Jump->LabelName, cbList_CompareString);
-            if(LabelObjIndex >= 0)
-            {
-                // Get the label info, the current instruction position, and set the jump offset
-                cbLabel* LabelObj = cbList_GetElement(&SymbolsTable->LabelTable, LabelObjIndex);
-                int InstrIndex = cbList_FindOffset(&SymbolsTable->InstructionsList, Jump->Instr, cbList_ComparePointer);
-                
-                // Offset = Label dest. - jump origin
-                Jump->Instr->Arg = LabelObj->Index - InstrIndex;
-            }
-            // Else, never found, error
-            else
-                cbUtil_RaiseError(ErrorList, cbError_MissingLabel, Jump->LineNumber);
-            
-            // All done with this jump object
-            free(Jump->LabelName);
-            free(Jump);
+            memcpy((cbLineEntry*)((char*)Process->Memory + Process->LineTablePointer) + Process->LineCount, Entry, sizeof(cbLineEntry));
+            Process->LineCount++;
+            free(Entry);
         }
+        ByteOffset += Process->LineCount * sizeof(cbLineEntry);
+        
+        // Save the heap-starting address
+        Process->HeapPointer = ByteOffset;
+        
+        // 9. Pre-decode into the internal execution form
+        if(cbStep_Decode(Process) != cbError_None)
+            cbUtil_RaiseError(ErrorList, cbError_Overflow, 0);
         
         // All done with compilation
     }
@@ -179,6 +230,9 @@ bool cbParse_CompileProgram(cbSymbolsTable* SymbolsTable, cbList* ErrorList, cbV
     }
     cbList_Release(&SymbolsTable->LexTree);
     
+    // Variable names were owned by the lex-tree
+    cbList_Release(&SymbolsTable->UntypedVariables);
+    
     // Release symbols tables
     while(cbList_GetCount(&SymbolsTable->InstructionsList)) free(cbList_PopFront(&SymbolsTable->InstructionsList));
     cbList_Release(&SymbolsTable->InstructionsList);
@@ -186,12 +240,15 @@ bool cbParse_CompileProgram(cbSymbolsTable* SymbolsTable, cbList* ErrorList, cbV
     while(cbList_GetCount(&SymbolsTable->DataList)) free(cbList_PopFront(&SymbolsTable->DataList));
     cbList_Release(&SymbolsTable->DataList);
     
+    while(cbList_GetCount(&SymbolsTable->LineTable)) free(cbList_PopFront(&SymbolsTable->LineTable));
+    cbList_Release(&SymbolsTable->LineTable);
+    
     while(cbList_GetCount(&SymbolsTable->VariablesList)) free(cbList_PopFront(&SymbolsTable->VariablesList));
     cbList_Release(&SymbolsTable->VariablesList);
     
     // Need to deep-free the jump tabel and the label table
     cbJump* Jump = NULL;
-    while((Jump = cbList_PeekBack(&SymbolsTable->JumpTable)) != NULL)
+    while((Jump = cbList_PopBack(&SymbolsTable->JumpTable)) != NULL)
     {
         free(Jump->LabelName);
         free(Jump);
@@ -200,7 +257,7 @@ bool cbParse_CompileProgram(cbSymbolsTable* SymbolsTable, cbList* ErrorList, cbV
     
     // Nothing to release, the pointers point to the process memory map
     cbLabel* Label = NULL;
-    while((Label = cbList_PeekBack(&SymbolsTable->LabelTable)) != NULL)
+    while((Label = cbList_PopBack(&SymbolsTable->LabelTable)) != NULL)
     {
         free(Label->LabelName);
         free(Label);
@@ -229,10 +286,22 @@ void cbParse_BuildNode(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* Er
         cbList_PushBack(&SymbolsTable->BlockStack, Target);
     }
     
+    // Assignments only evaluate their expression, then store it into the variable's slot: the variable is
+    // never loaded (it is not a value here), but it still takes its slot first, before any in the expression
+    if(Node->Type == cbLexNodeType_Symbol && Node->Data.Symbol == cbSymbol_Declaration && Node->Left != NULL)
+    {
+        int Slot = cbParse_GetVariableSlot(SymbolsTable, Node->Left->Data.Terminal.Data.String);
+        cbParse_BuildNode(SymbolsTable, Node->Right, ErrorList);
+        cbParse_LoadInstruction(SymbolsTable, cbOps_StoreToSlot, ErrorList, Slot);
+        return;
+    }
+    
     // Seek left, right, then middle
+    // Note: goto and label statements keep their label name in the middle, which is not code
     cbParse_BuildNode(SymbolsTable, Node->Left, ErrorList);
     cbParse_BuildNode(SymbolsTable, Node->Right, ErrorList);
-    cbParse_BuildNode(SymbolsTable, Node->Middle, ErrorList);
+    if(Node->Type != cbLexNodeType_Symbol || (Node->Data.Symbol != cbSymbol_StatementGoto && Node->Data.Symbol != cbSymbol_StatementLabel))
+        cbParse_BuildNode(SymbolsTable, Node->Middle, ErrorList);
     
     // Special statements / production rules
     if(Node->Type == cbLexNodeType_Symbol)
@@ -278,7 +347,7 @@ void cbParse_BuildNode(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* Er
         else if(Symbol == cbSymbol_StatementLabel)
             cbParse_LoadLabel(SymbolsTable, Node, ErrorList);
         else if(Symbol == cbSymbol_StatementWhile)
-            ((cbJumpTarget*)cbList_PeekBack(&SymbolsTable->BlockStack))->Instruction = cbParse_LoadInstruction(SymbolsTable, cbOps_Goto, ErrorList, 0);
+            ((cbJumpTarget*)cbList_PeekBack(&SymbolsTable->BlockStack))->Instruction = cbParse_LoadInstruction(SymbolsTable, cbOps_If, ErrorList, 0);
         else if(Symbol == cbSymbol_StatementFor)
             printf(" For is not yet implemented!\n");
         else if(Symbol == cbSymbol_End)
@@ -292,8 +361,18 @@ void cbParse_BuildNode(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* Er
                 cbJumpTarget* Target = cbList_PopBack(&SymbolsTable->BlockStack);
                 size_t OpCount = cbList_GetCount(&SymbolsTable->InstructionsList);
                 
+                // While loops jump back up to their conditional code, while the conditional
+                // itself jumps past this loop-back on failure
+                if(Target->Symbol == cbSymbol_StatementWhile)
+                {
+                    int IfIndex = cbList_FindOffset(&SymbolsTable->InstructionsList, Target->Instruction, cbList_ComparePointer);
+                    cbParse_LoadInstruction(SymbolsTable, cbOps_Goto, ErrorList, (int)Target->Index - (int)OpCount);
+                    Target->Instruction->Arg = (int)OpCount + 1 - IfIndex;
+                }
+                
                 // Set the jump location down to this location, but don't add any ops..
-                Target->Instruction->Arg = OpCount - Target->Index - 1;
+                else
+                    Target->Instruction->Arg = OpCount - Target->Index - 1;
                 
                 // Done with target
                 free(Target);
@@ -315,9 +394,9 @@ void cbParse_BuildNode(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* Er
         else if(Type == cbLexIDType_Variable)
             cbParse_LoadVariable(SymbolsTable, Node, ErrorList);
         
-        // Regular op turns straight to code *or* is a function call
+        // Regular op turns straight to code (type-specialized when possible) *or* is a function call
         else if(Type == cbLexIDType_Op)
-            cbParse_LoadInstruction(SymbolsTable, Node->Data.Terminal.Data.Op, ErrorList, 0);
+            cbParse_LoadInstruction(SymbolsTable, cbParse_GetTypedOp(SymbolsTable, Node), ErrorList, 0);
         
         // Functions
         else if(Type == cbLexIDType_Func)
@@ -332,6 +411,476 @@ void cbParse_BuildNode(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* Er
         cbUtil_RaiseError(ErrorList, cbError_UnknownToken, Node->LineNumber);
 }
 
+void cbParse_InferTypes(cbSymbolsTable* SymbolsTable)
+{
+    // Collect all assignments of the program
+    cbList Assignments;
+    cbList_Init(&Assignments);
+    for(cbListNode* Line = SymbolsTable->LexTree.Front; Line != NULL; Line = Line->Next)
+        cbParse_FindAssignments(Line->Data, &Assignments);
+    
+    // All variables start out as integers (the stack is zeroed), so only assignments can change that:
+    // keep dropping any variable assigned something that isn't proven to be an integer, until nothing changes
+    bool Changed = true;
+    while(Changed)
+    {
+        Changed = false;
+        for(cbListNode* Node = Assignments.Front; Node != NULL; Node = Node->Next)
+        {
+            cbLexNode* Assignment = Node->Data;
+            char* VariableName = Assignment->Left->Data.Terminal.Data.String;
+            if(cbList_FindOffset(&SymbolsTable->UntypedVariables, VariableName, cbList_CompareString) < 0 && !cbParse_IsIntExpression(SymbolsTable, Assignment->Right))
+            {
+                cbList_PushBack(&SymbolsTable->UntypedVariables, VariableName);
+                Changed = true;
+            }
+        }
+    }
+    
+    // The nodes themselves belong to the lex-tree
+    cbList_Release(&Assignments);
+}
+
+void cbParse_FindAssignments(cbLexNode* Node, cbList* Assignments)
+{
+    // If null, give up
+    if(Node == NULL)
+        return;
+    
+    // Declarations save the variable on the left, and the expression on the right
+    if(Node->Type == cbLexNodeType_Symbol && Node->Data.Symbol == cbSymbol_Declaration && Node->Left != NULL && Node->Right != NULL)
+        cbList_PushBack(Assignments, Node);
+    
+    cbParse_FindAssignments(Node->Left, Assignments);
+    cbParse_FindAssignments(Node->Middle, Assignments);
+    cbParse_FindAssignments(Node->Right, Assignments);
+}
+
+bool cbParse_IsIntExpression(cbSymbolsTable* SymbolsTable, cbLexNode* Node)
+{
+    // Only terminals have a type
+    if(Node == NULL || Node->Type != cbLexNodeType_Terminal)
+        return false;
+    
+    // Integer literals, and variables that were never assigned anything else
+    cbLexIDType Type = Node->Data.Terminal.Type;
+    if(Type == cbLexIDType_Int)
+        return true;
+    else if(Type == cbLexIDType_Variable)
+        return cbList_FindOffset(&SymbolsTable->UntypedVariables, Node->Data.Terminal.Data.String, cbList_CompareString) < 0;
+    
+    // Math and comparisons always result in integers (or fail at run-time); logic ops keep their operand's type
+    else if(Type == cbLexIDType_Op)
+        return Node->Data.Terminal.Data.Op >= cbOps_Add && Node->Data.Terminal.Data.Op <= cbOps_LessEq;
+    
+    // Anything else (other literals, function calls) isn't proven
+    else
+        return false;
+}
+
+cbOps cbParse_GetTypedOp(cbSymbolsTable* SymbolsTable, cbLexNode* Node)
+{
+    // Math and comparisons on two proven integers get their type-specialized op
+    cbOps Op = Node->Data.Terminal.Data.Op;
+    if(Op >= cbOps_Add && Op <= cbOps_LessEq && cbParse_IsIntExpression(SymbolsTable, Node->Left) && cbParse_IsIntExpression(SymbolsTable, Node->Right))
+        return (cbOps)(Op - cbOps_Add + cbOps_AddInt);
+    else
+        return Op;
+}
+
+void cbParse_FuseInstructions(cbSymbolsTable* SymbolsTable)
+{
+    // Pull all instructions out of the list, so sequences can be matched by index
+    size_t Count = cbList_GetCount(&SymbolsTable->InstructionsList);
+    cbInstruction** Code = malloc(Count * sizeof(cbInstruction*));
+    for(size_t i = 0; i < Count; i++)
+        Code[i] = cbList_PopFront(&SymbolsTable->InstructionsList);
+    
+    // Mark all jump destinations: nothing may jump into the middle of a fused sequence
+    bool* IsTarget = calloc(Count + 1, sizeof(bool));
+    for(size_t i = 0; i < Count; i++)
+    {
+        long Destination = (long)i + Code[i]->Arg;
+        if((Code[i]->Op == cbOps_If || Code[i]->Op == cbOps_Goto) && Destination >= 0 && Destination <= (long)Count)
+            IsTarget[Destination] = true;
+    }
+    
+    // New index of each old instruction (plus the end of code), and old index of each new instruction
+    int* NewIndex = malloc((Count + 1) * sizeof(int));
+    int* OldIndex = malloc((Count + 1) * sizeof(int));
+    int NewCount = 0;
+    
+    // For each instruction, try to start a fused sequence at it
+    for(size_t i = 0; i < Count; )
+    {
+        // Number of instructions we may fuse: up to the next jump destination
+        size_t Span = 1;
+        while(i + Span < Count && Span < 4 && !IsTarget[i + Span])
+            Span++;
+        
+        // Instructions consumed by this step, and where they start in the new code
+        size_t Length = 1;
+        int GroupIndex = NewCount;
+        
+        // "a = a <op> literal": loadval a, loaddata, <math op>, store a
+        // Becomes setmath a, then the math op with the literal's data offset
+        // Note: the fused ops check types themselves, so type-specialized ops are stored as their generic op
+        cbOps Op = (Span >= 3) ? cbUtil_GetGenericOp(Code[i + 2]->Op) : cbOps_Nop;
+        if(Span >= 4 && Code[i]->Op == cbOps_LoadValue && Code[i + 1]->Op == cbOps_LoadData && Op >= cbOps_Add && Op <= cbOps_Mod &&
+           Code[i + 3]->Op == cbOps_StoreToSlot && Code[i]->Arg == Code[i + 3]->Arg)
+        {
+            Code[i]->Op = cbOps_SetMath;
+            Code[i + 2]->Op = Op;
+            Code[i + 2]->Arg = Code[i + 1]->Arg;
+            
+            cbList_PushBack(&SymbolsTable->InstructionsList, Code[i]);
+            OldIndex[NewCount++] = (int)i;
+            cbList_PushBack(&SymbolsTable->InstructionsList, Code[i + 2]);
+            OldIndex[NewCount++] = (int)i + 2;
+            
+            free(Code[i + 1]);
+            free(Code[i + 3]);
+            Length = 4;
+        }
+        
+        // "if a <op> literal" (and while conditions): loadval a, loaddata, <comparison op>, if
+        // Becomes ifcomp a, then the comparison op with the literal's data offset, then the untouched if
+        else if(Span >= 4 && Code[i]->Op == cbOps_LoadValue && Code[i + 1]->Op == cbOps_LoadData &&
+                cbUtil_GetGenericOp(Code[i + 2]->Op) >= cbOps_Eq && cbUtil_GetGenericOp(Code[i + 2]->Op) <= cbOps_LessEq && Code[i + 3]->Op == cbOps_If)
+        {
+            Code[i]->Op = cbOps_IfComp;
+            Code[i + 2]->Op = cbUtil_GetGenericOp(Code[i + 2]->Op);
+            Code[i + 2]->Arg = Code[i + 1]->Arg;
+            
+            cbList_PushBack(&SymbolsTable->InstructionsList, Code[i]);
+            OldIndex[NewCount++] = (int)i;
+            cbList_PushBack(&SymbolsTable->InstructionsList, Code[i + 2]);
+            OldIndex[NewCount++] = (int)i + 2;
+            cbList_PushBack(&SymbolsTable->InstructionsList, Code[i + 3]);
+            OldIndex[NewCount++] = (int)i + 3;
+            
+            free(Code[i + 1]);
+            Length = 4;
+        }
+        
+        // Else, keep as-is
+        else
+        {
+            cbList_PushBack(&SymbolsTable->InstructionsList, Code[i]);
+            OldIndex[NewCount++] = (int)i;
+        }
+        
+        // Only the first instruction of a sequence is ever jumped to
+        for(size_t j = 0; j < Length; j++)
+            NewIndex[i + j] = GroupIndex;
+        i += Length;
+    }
+    NewIndex[Count] = NewCount;
+    
+    // Re-target all relative jumps to the new instruction indices
+    int Index = 0;
+    for(cbListNode* Node = SymbolsTable->InstructionsList.Front; Node != NULL; Node = Node->Next, Index++)
+    {
+        cbInstruction* Instruction = Node->Data;
+        long Destination = (long)OldIndex[Index] + Instruction->Arg;
+        if((Instruction->Op == cbOps_If || Instruction->Op == cbOps_Goto) && Destination >= 0 && Destination <= (long)Count)
+            Instruction->Arg = NewIndex[Destination] - Index;
+    }
+    
+    // Release the work buffers
+    free(Code);
+    free(IsTarget);
+    free(NewIndex);
+    free(OldIndex);
+}
+
+void cbParse_BuildLineTable(cbSymbolsTable* SymbolsTable, bool IsRegisterCode)
+{
+    // Pull all instructions out of the list; both formats keep the op first, and the
+    // line number (for nops) or relative jump in their first operand
+    size_t Count = cbList_GetCount(&SymbolsTable->InstructionsList);
+    void** Code = malloc(Count * sizeof(void*));
+    for(size_t i = 0; i < Count; i++)
+        Code[i] = cbList_PopFront(&SymbolsTable->InstructionsList);
+    #define __cbOperand(Index) (IsRegisterCode ? &((cbRegInstruction*)Code[Index])->Out : &((cbInstruction*)Code[Index])->Arg)
+    
+    // New index of each old instruction (plus the end of code): jumps to a line marker now land on the line's first instruction
+    int* NewIndex = malloc((Count + 1) * sizeof(int));
+    int NewCount = 0;
+    for(size_t i = 0; i < Count; i++)
+    {
+        NewIndex[i] = NewCount;
+        if(*(cbOps*)Code[i] != cbOps_Nop)
+            NewCount++;
+    }
+    NewIndex[Count] = NewCount;
+    
+    // Put back the instructions, re-targeting relative jumps, and turn each line marker into a table entry
+    for(size_t i = 0; i < Count; i++)
+    {
+        cbOps Op = *(cbOps*)Code[i];
+        int* Operand = __cbOperand(i);
+        if(Op == cbOps_Nop)
+        {
+            // Lines without any code of their own share the next line's first instruction: the later line wins
+            cbLineEntry* Last = SymbolsTable->LineTable.Back != NULL ? SymbolsTable->LineTable.Back->Data : NULL;
+            if(Last == NULL || Last->Instruction != NewIndex[i])
+            {
+                Last = malloc(sizeof(cbLineEntry));
+                Last->Instruction = NewIndex[i];
+                cbList_PushBack(&SymbolsTable->LineTable, Last);
+            }
+            Last->Line = *Operand;
+            free(Code[i]);
+            continue;
+        }
+        
+        long Destination = (long)i + *Operand;
+        if((Op == cbOps_If || Op == cbOps_Goto) && Destination >= 0 && Destination <= (long)Count)
+            *Operand = NewIndex[Destination] - NewIndex[i];
+        cbList_PushBack(&SymbolsTable->InstructionsList, Code[i]);
+    }
+    #undef __cbOperand
+    
+    // Release the work buffers
+    free(Code);
+    free(NewIndex);
+}
+
+bool cbParse_BuildRegisters(cbSymbolsTable* SymbolsTable, size_t VarCount)
+{
+    // Pull all instructions out of the list, so they can be put back if we fail
+    size_t Count = cbList_GetCount(&SymbolsTable->InstructionsList);
+    cbInstruction** Code = malloc(Count * sizeof(cbInstruction*));
+    for(size_t i = 0; i < Count; i++)
+        Code[i] = cbList_PopFront(&SymbolsTable->InstructionsList);
+    
+    // Mark all jump destinations: values on the stack never live across them
+    bool* IsTarget = calloc(Count + 1, sizeof(bool));
+    for(size_t i = 0; i < Count; i++)
+    {
+        long Destination = (long)i + Code[i]->Arg;
+        if((Code[i]->Op == cbOps_If || Code[i]->Op == cbOps_Goto) && Destination >= 0 && Destination <= (long)Count)
+            IsTarget[Destination] = true;
+    }
+    
+    // Symbolic stack: the operand (variable, temporary, or literal) each stack entry would hold at run-time
+    int* Stack = malloc((Count + 1) * sizeof(int));
+    size_t Depth = 0;
+    size_t TempCount = 0;
+    
+    // New index of each old instruction (plus the end of code), and old index of each new instruction
+    int* NewIndex = malloc((Count + 1) * sizeof(int));
+    int* OldIndex = malloc((Count + 1) * sizeof(int));
+    cbList Registers;
+    cbList_Init(&Registers);
+    cbRegInstruction* Last = NULL;
+    bool Success = true;
+    
+    // Frame offsets: variables are right under the stack base, each stack depth gets its own temporary below them
+    int VarBottom = -(int)(VarCount * sizeof(cbVariable));
+    #define __cbTemp(Index) (VarBottom - (int)(((Index) + 1) * sizeof(cbVariable)))
+    
+    // Pop an operand off the symbolic stack, failing if there are none
+    #define __cbPop(Operand) \
+        if(Depth == 0) \
+        { \
+            Success = false; \
+            break; \
+        } \
+        (Operand) = Stack[--Depth]
+    
+    // Push the result of this instruction into the temporary of the current depth
+    #define __cbPushTemp() \
+        Reg.Out = __cbTemp(Depth); \
+        Stack[Depth++] = Reg.Out; \
+        TempCount = (Depth > TempCount) ? Depth : TempCount
+    
+    // For each stack instruction, emit its register instruction (if any)
+    for(size_t i = 0; i < Count && Success; i++)
+    {
+        cbInstruction* Instruction = Code[i];
+        NewIndex[i] = (int)cbList_GetCount(&Registers);
+        if(IsTarget[i] && Depth != 0)
+        {
+            Success = false;
+            break;
+        }
+        
+        // Defaults to an operand-less copy of the instruction
+        cbRegInstruction Reg = { Instruction->Op, 0, 0, 0 };
+        bool Emit = true;
+        
+        switch(Instruction->Op)
+        {
+            // Loads only name the operand for whoever consumes it
+            case cbOps_LoadValue:
+            case cbOps_LoadData:
+                Stack[Depth++] = Instruction->Arg;
+                Emit = false;
+                break;
+            
+            // Binary ops. write into a temporary
+            case cbOps_Add:
+            case cbOps_Sub:
+            case cbOps_Mul:
+            case cbOps_Div:
+            case cbOps_Mod:
+            case cbOps_Eq:
+            case cbOps_NotEq:
+            case cbOps_Greater:
+            case cbOps_GreaterEq:
+            case cbOps_Less:
+            case cbOps_LessEq:
+            case cbOps_And:
+            case cbOps_Or:
+            case cbOps_AddInt:
+            case cbOps_SubInt:
+            case cbOps_MulInt:
+            case cbOps_DivInt:
+            case cbOps_ModInt:
+            case cbOps_EqInt:
+            case cbOps_NotEqInt:
+            case cbOps_GreaterInt:
+            case cbOps_GreaterEqInt:
+            case cbOps_LessInt:
+            case cbOps_LessEqInt:
+                __cbPop(Reg.B);
+                __cbPop(Reg.A);
+                __cbPushTemp();
+                break;
+            
+            // Unary op. and user inputs write into a temporary too
+            case cbOps_Not:
+                __cbPop(Reg.A);
+                __cbPushTemp();
+                break;
+            case cbOps_Input:
+            case cbOps_GetKey:
+                __cbPushTemp();
+                break;
+            
+            // Stores write into the variable, retargeting the op. that just computed the value when possible
+            case cbOps_StoreToSlot:
+            {
+                __cbPop(Reg.A);
+                if(Last != NULL && Reg.A < VarBottom && Last->Out == Reg.A && ((cbUtil_GetGenericOp(Last->Op) >= cbOps_Add && cbUtil_GetGenericOp(Last->Op) <= cbOps_Or) || Last->Op == cbOps_Input || Last->Op == cbOps_GetKey))
+                {
+                    Last->Out = Instruction->Arg;
+                    Emit = false;
+                }
+                else
+                    Reg.Out = Instruction->Arg;
+                break;
+            }
+            
+            // Jumps keep their relative offsets (re-targeted below), and must leave nothing on the stack
+            case cbOps_If:
+                __cbPop(Reg.A);
+                // Fall through
+            case cbOps_Goto:
+                Reg.Out = Instruction->Arg;
+                Success = (Depth == 0);
+                break;
+            
+            // Outputs, and waits on their duration
+            case cbOps_Disp:
+            case cbOps_Wait:
+                __cbPop(Reg.A);
+                break;
+            case cbOps_Output:
+                __cbPop(Reg.Out);
+                __cbPop(Reg.B);
+                __cbPop(Reg.A);
+                break;
+            
+            // Meta-data and the stack frame
+            case cbOps_Nop:
+            case cbOps_AddStack:
+                Reg.Out = Instruction->Arg;
+                break;
+            
+            // No operands
+            case cbOps_Halt:
+            case cbOps_Pause:
+            case cbOps_Clear:
+            case cbOps_Flip:
+            case cbOps_Exec:
+            case cbOps_Return:
+                break;
+            
+            // Anything else has no register form
+            default:
+                Success = false;
+                break;
+        }
+        
+        // Save the new instruction
+        if(Success && Emit)
+        {
+            Last = malloc(sizeof(cbRegInstruction));
+            *Last = Reg;
+            OldIndex[cbList_GetCount(&Registers)] = (int)i;
+            cbList_PushBack(&Registers, Last);
+        }
+    }
+    NewIndex[Count] = (int)cbList_GetCount(&Registers);
+    
+    #undef __cbTemp
+    #undef __cbPop
+    #undef __cbPushTemp
+    
+    // Re-target all relative jumps to the new instruction indices
+    int Index = 0;
+    for(cbListNode* Node = Registers.Front; Success && Node != NULL; Node = Node->Next, Index++)
+    {
+        cbRegInstruction* Reg = Node->Data;
+        long Destination = (long)OldIndex[Index] + Reg->Out;
+        if((Reg->Op == cbOps_If || Reg->Op == cbOps_Goto) && Destination >= 0 && Destination <= (long)Count)
+            Reg->Out = NewIndex[Destination] - Index;
+    }
+    
+    // Grow the stack frame to also hold the temporaries (jumps are relative, so pushing to the front is safe)
+    cbRegInstruction* Frame = cbList_PeekFront(&Registers);
+    if(Success && TempCount > 0)
+    {
+        if(Frame != NULL && Frame->Op == cbOps_AddStack)
+            Frame->Out -= (int)(TempCount * sizeof(cbVariable));
+        else
+        {
+            Frame = malloc(sizeof(cbRegInstruction));
+            Frame->Op = cbOps_AddStack;
+            Frame->Out = -(int)(TempCount * sizeof(cbVariable));
+            Frame->A = Frame->B = 0;
+            cbList_PushFront(&Registers, Frame);
+        }
+    }
+    
+    // Keep the register code, or put the stack code back as-is if we failed
+    for(size_t i = 0; i < Count; i++)
+    {
+        if(Success)
+            free(Code[i]);
+        else
+            cbList_PushBack(&SymbolsTable->InstructionsList, Code[i]);
+    }
+    if(Success)
+        SymbolsTable->InstructionsList = Registers;
+    else
+    {
+        while(cbList_GetCount(&Registers) > 0)
+            free(cbList_PopFront(&Registers));
+    }
+    
+    // Release the work buffers
+    free(Code);
+    free(IsTarget);
+    free(Stack);
+    free(NewIndex);
+    free(OldIndex);
+    return Success;
+}
+
 cbInstruction* cbParse_LoadInstruction(cbSymbolsTable* SymbolsTable, cbOps Op, cbList* ErrorList, int Arg)
 {
     // Allocate and set
@@ -370,6 +919,7 @@ void cbParse_LoadLiteral(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList*
     {
         Var->Type = cbVariableType_String;
         Var->Data.String = cbUtil_stralloc(Node->Data.Terminal.Data.String); // Copy for now...
+        cbParse_ApplyEscapes(Var->Data.String);
     }
     // Unknown...
     else
@@ -383,11 +933,27 @@ void cbParse_LoadLiteral(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList*
     cbParse_LoadInstruction(SymbolsTable, cbOps_LoadData, ErrorList, AddressIndex * (int)sizeof(cbVariable));
 }
 
-void cbParse_LoadVariable(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* ErrorList)
+void cbParse_ApplyEscapes(char* String)
+{
+    // Escapes only ever shrink the string, so write back over it
+    char* Out = String;
+    for(const char* In = String; *In != '\0'; In++)
+    {
+        if(In[0] == '\\' && (In[1] == 'n' || In[1] == 't' || In[1] == '\\'))
+        {
+            In++;
+            *(Out++) = (*In == 'n') ? '\n' : (*In == 't') ? '\t' : '\\';
+        }
+        else
+            *(Out++) = *In;
+    }
+    *Out = '\0';
+}
+
+int cbParse_GetVariableSlot(cbSymbolsTable* SymbolsTable, const char* VariableName)
 {
     // Does this variable name exist?
-    char* VariableName = Node->Data.Terminal.Data.String;
-    int Offset = cbList_FindOffset(&SymbolsTable->VariablesList, VariableName, cbList_CompareString);
+    int Offset = cbList_FindOffset(&SymbolsTable->VariablesList, (void*)VariableName, cbList_CompareString);
     
     // If the variable does not exist, add to the list to get the offset
     if(Offset < 0)
@@ -397,9 +963,15 @@ void cbParse_LoadVariable(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList*
         cbList_PushBack(&SymbolsTable->VariablesList, cbUtil_stralloc(VariableName));
     }
     
-    // Load the variable from the stack base onto the top of the stack
     // + 1 because the data ends at the stack base address
-    cbParse_LoadInstruction(SymbolsTable, cbOps_LoadVar, ErrorList, -(Offset + 1) * sizeof(cbVariable));
+    return -(Offset + 1) * (int)sizeof(cbVariable);
+}
+
+void cbParse_LoadVariable(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* ErrorList)
+{
+    // Copy the variable's value from its slot under the stack base onto the top of the stack
+    int Slot = cbParse_GetVariableSlot(SymbolsTable, Node->Data.Terminal.Data.String);
+    cbParse_LoadInstruction(SymbolsTable, cbOps_LoadValue, ErrorList, Slot);
 }
 
 void cbParse_LoadGoto(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* ErrorList)
@@ -407,7 +979,7 @@ void cbParse_LoadGoto(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* Err
     // Create a jump object
     cbJump* Jump = malloc(sizeof(cbJump));
     Jump->Instr = cbParse_LoadInstruction(SymbolsTable, cbOps_Goto, ErrorList, 0);
-    Jump->LabelName = cbUtil_stralloc(Node->Data.Terminal.Data.String);
+    Jump->LabelName = cbUtil_stralloc(Node->Middle->Data.Terminal.Data.String);
     Jump->LineNumber = Node->LineNumber;
     
     // Save into the jump table
@@ -419,7 +991,7 @@ void cbParse_LoadLabel(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* Er
     // Create a label object
     cbLabel* Label = malloc(sizeof(cbLabel));
     Label->Index = cbList_GetCount(&SymbolsTable->InstructionsList);
-    Label->LabelName = cbUtil_stralloc(Node->Data.Terminal.Data.String);
+    Label->LabelName = cbUtil_stralloc(Node->Middle->Data.Terminal.Data.String);
     
     // Save into the labels table
     cbList_PushBack(&SymbolsTable->LabelTable, Label);
@@ -434,6 +1006,11 @@ void cbParse_LoadFunction(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList*
        cbOps_Output,
        cbOps_GetKey,
        cbOps_Clear,
+       cbOps_Line,
+       cbOps_Rect,
+       cbOps_Blit,
+       cbOps_Flip,
+       cbOps_Wait,
     */
     
     // This node itself contains the function name, while the right points to the args list
@@ -452,6 +1029,16 @@ void cbParse_LoadFunction(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList*
         OpFunc = cbOps_GetKey;
     else if(strcmp(FuncName, "clear") == 0 && ArgCount == 0)
         OpFunc = cbOps_Clear;
+    else if(strcmp(FuncName, "line") == 0 && ArgCount == 5)
+        OpFunc = cbOps_Line;
+    else if(strcmp(FuncName, "rect") == 0 && ArgCount == 5)
+        OpFunc = cbOps_Rect;
+    else if(strcmp(FuncName, "blit") == 0 && ArgCount == 4)
+        OpFunc = cbOps_Blit;
+    else if(strcmp(FuncName, "flip") == 0 && ArgCount == 0)
+        OpFunc = cbOps_Flip;
+    else if(strcmp(FuncName, "wait") == 0 && ArgCount == 1)
+        OpFunc = cbOps_Wait;
     
     // Never matched, raise error
     if(OpFunc == cbOps_Nop)
@@ -19,6 +19,7 @@
 #include "cbUtil.h"
 #include "cbTypes.h"
 #include "cbParse.h"
+#include "cbProcess.h"
 
 /*** Main Compiler Entry Points ***/
 
@@ -30,6 +31,33 @@ bool cbParse_CompileProgram(cbSymbolsTable* SymbolsTable, cbList* ErrorList, cbV
 // Build code by traversing the lex-tree left-right then inside (ops)
 void cbParse_BuildNode(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* ErrorList);
 
+// Find the variables that are proven to only ever hold integers, saving all others into the symbols
+// table's untyped variables list; variables start out as integers, so only assignments are looked at
+void cbParse_InferTypes(cbSymbolsTable* SymbolsTable);
+
+// Collect all assignments (declaration nodes) within the given lex-tree node
+void cbParse_FindAssignments(cbLexNode* Node, cbList* Assignments);
+
+// Returns true if the given expression is proven to always result in an integer
+bool cbParse_IsIntExpression(cbSymbolsTable* SymbolsTable, cbLexNode* Node);
+
+// Returns the op to emit for the given op node: the type-specialized op if both operands are
+// proven integers, else the node's own (generic) op
+cbOps cbParse_GetTypedOp(cbSymbolsTable* SymbolsTable, cbLexNode* Node);
+
+// Replace common op sequences in the instructions list with fused superinstructions (see cbOps_SetMath
+// and cbOps_IfComp), re-targeting all relative jumps; sequences that are jumped into are left as-is
+void cbParse_FuseInstructions(cbSymbolsTable* SymbolsTable);
+
+// Translate the stack code in the instructions list into the register machine's three-address code
+// (cbRegInstruction), with temporaries in the stack frame right under the given number of variables
+// Returns false, leaving the stack code as-is, if the code keeps values on the stack across jumps
+bool cbParse_BuildRegisters(cbSymbolsTable* SymbolsTable, size_t VarCount);
+
+// Strip the line markers (nops) out of the final code in the instructions list (stack or register
+// machine code), re-targeting all relative jumps, and fill the line table with where each line starts
+void cbParse_BuildLineTable(cbSymbolsTable* SymbolsTable, bool IsRegisterCode);
+
 // Load a given instruction into the instructions list
 // Returns the newly allocated instruction
 cbInstruction* cbParse_LoadInstruction(cbSymbolsTable* SymbolsTable, cbOps Op, cbList* ErrorList, int Arg);
@@ -37,7 +65,14 @@ cbInstruction* cbParse_LoadInstruction(cbSymbolsTable* SymbolsTable, cbOps Op, c
 // Load a literal into the static memory segment and push a new loaddata call
 void cbParse_LoadLiteral(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* ErrorList);
 
-// Builds instructions to load the variable at run-time onto the function stack
+// Replace the escape sequences (\n, \t, and \\) of the given string literal with the characters they
+// stand for, in place; done once here so that strings are printed as-is at run-time
+void cbParse_ApplyEscapes(char* String);
+
+// Returns the frame slot (offset from the stack base) of the given variable, adding the variable if new
+int cbParse_GetVariableSlot(cbSymbolsTable* SymbolsTable, const char* VariableName);
+
+// Builds instructions to load the variable's value at run-time onto the function stack
 void cbParse_LoadVariable(cbSymbolsTable* SymbolsTable, cbLexNode* Node, cbList* ErrorList);
 
 // Load a jump instruction to the target label
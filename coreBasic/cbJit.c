@@ -0,0 +1,707 @@
+/***************************************************************
+ 
+ cBasic - coreBasic - BASIC Language Interpreter on iOS
+ Copyright 2011 Jeremy Bridon - See License.txt for info
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+***************************************************************/
+
+#include "cbJit.h"
+
+#ifdef __cbJIT__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+/*
+ Native code layout and register use:
+
+ +-----------------+
+ | Prologue        | <-- Entry: (Processor, &TicksLeft, native address to start from)
+ |-----------------|
+ | Common exit     | <-- Posts registers back into the processor, returns eax
+ |-----------------|
+ | Instruction 0   | <-- Each instruction takes a tick, then runs its template
+ | ...             |     Unsupported ops call back into the interpreter
+ | Instruction n-1 |
+ |-----------------|
+ | End-of-code     | <-- Overflow, as with the decoded sentinel
+ |-----------------|
+ | Exit stubs      | <-- Set the instruction to resume from (esi) and the error (eax)
+ +-----------------+
+
+ rbx: Processor, r12: Memory, r13: StackPointer (an offset from Memory), r14: ticks left,
+ r15: where to post the ticks left on exit, rbp: Memory + StackBasePointer (the frame)
+
+ The stack pointer is only kept in r13, so it is written back around every call into the
+ interpreter; all other processor state is kept in the processor itself.
+*/
+
+// Native code entry point
+typedef cbError (*cbJitEntry)(cbVirtualMachine* Processor, size_t* TicksLeft, const void* Start);
+
+// A compiled program: the executable mapping, and the native address of each instruction
+// (plus the end-of-code sentinel) to start or resume from
+typedef struct __cbJitProgram
+{
+    unsigned char* Code;
+    size_t CodeSize;
+    const void** Addresses;
+    size_t Count;
+} cbJitProgram;
+
+// Ways out of native code, all of which post the instruction to resume from
+typedef enum __cbJitExit
+{
+    cbJitExit_Budget,   // Out of ticks before the instruction ran: gives the tick back
+    cbJitExit_Error,    // Posts a fixed error (cbError_None for halts and interrupts)
+    cbJitExit_Helper,   // Posts the error returned by the interpreter call
+} cbJitExit;
+
+// Branch conditions, as the second byte of the two-byte jcc rel32 encodings
+typedef enum __cbJitCondition
+{
+    cbJitCondition_Always = 0,      // Plain jmp rel32
+    cbJitCondition_Below = 0x82,
+    cbJitCondition_Equal = 0x84,
+    cbJitCondition_NotEqual = 0x85,
+    cbJitCondition_Sign = 0x88,
+    cbJitCondition_Less = 0x8C,
+    cbJitCondition_GreaterEq = 0x8D,
+    cbJitCondition_LessEq = 0x8E,
+    cbJitCondition_Greater = 0x8F,
+} cbJitCondition;
+
+// A rel32 to patch once all code is placed: either to an instruction, or to a new exit stub
+typedef struct __cbJitFixup
+{
+    size_t Position;    // Offset of the rel32 field
+    bool IsExit;        // Targets an exit stub rather than an instruction
+    cbJitExit Exit;
+    size_t Index;       // The target instruction, or the instruction to resume from on exit
+    cbError Error;
+} cbJitFixup;
+
+// Code being generated
+typedef struct __cbJitBuffer
+{
+    unsigned char* Data;
+    size_t Size, Capacity;
+    cbJitFixup* Fixups;
+    size_t FixupCount, FixupCapacity;
+    bool Failed;        // Ran out of memory
+} cbJitBuffer;
+
+// Emit the given bytes (a list of constant bytes) into the local buffer
+#define __cbEmit(...) cbJit_EmitBytes(Buffer, (const unsigned char[]){ __VA_ARGS__ }, sizeof((const unsigned char[]){ __VA_ARGS__ }))
+
+// Processor field displacements from rbx
+#define __cbField(Name) ((int32_t)offsetof(cbVirtualMachine, Name))
+
+/*** Code Emission ***/
+
+static void cbJit_EmitBytes(cbJitBuffer* Buffer, const unsigned char* Bytes, size_t Count)
+{
+    // Grow as needed
+    if(Buffer->Size + Count > Buffer->Capacity)
+    {
+        size_t Capacity = (Buffer->Capacity + Count) * 2;
+        unsigned char* Data = realloc(Buffer->Data, Capacity);
+        if(Data == NULL)
+        {
+            Buffer->Failed = true;
+            return;
+        }
+        Buffer->Data = Data;
+        Buffer->Capacity = Capacity;
+    }
+    
+    memcpy(Buffer->Data + Buffer->Size, Bytes, Count);
+    Buffer->Size += Count;
+}
+
+static void cbJit_Emit32(cbJitBuffer* Buffer, int32_t Value)
+{
+    cbJit_EmitBytes(Buffer, (const unsigned char*)&Value, sizeof(int32_t));
+}
+
+static void cbJit_Emit64(cbJitBuffer* Buffer, uint64_t Value)
+{
+    cbJit_EmitBytes(Buffer, (const unsigned char*)&Value, sizeof(uint64_t));
+}
+
+// Emit a (conditional) branch with a rel32 to be patched later
+static void cbJit_EmitBranch(cbJitBuffer* Buffer, cbJitCondition Condition, bool IsExit, cbJitExit Exit, size_t Index, cbError Error)
+{
+    if(Condition == cbJitCondition_Always)
+        __cbEmit(0xE9);
+    else
+        __cbEmit(0x0F, Condition);
+    
+    // Save the fixup, growing as needed
+    if(Buffer->FixupCount >= Buffer->FixupCapacity)
+    {
+        size_t Capacity = (Buffer->FixupCapacity + 16) * 2;
+        cbJitFixup* Fixups = realloc(Buffer->Fixups, Capacity * sizeof(cbJitFixup));
+        if(Fixups == NULL)
+        {
+            Buffer->Failed = true;
+            return;
+        }
+        Buffer->Fixups = Fixups;
+        Buffer->FixupCapacity = Capacity;
+    }
+    
+    cbJitFixup* Fixup = Buffer->Fixups + Buffer->FixupCount++;
+    Fixup->Position = Buffer->Size;
+    Fixup->IsExit = IsExit;
+    Fixup->Exit = Exit;
+    Fixup->Index = Index;
+    Fixup->Error = Error;
+    cbJit_Emit32(Buffer, 0);
+}
+
+// Branch to the given instruction's native code
+static void cbJit_EmitJump(cbJitBuffer* Buffer, cbJitCondition Condition, size_t Index)
+{
+    cbJit_EmitBranch(Buffer, Condition, false, cbJitExit_Error, Index, cbError_None);
+}
+
+// Branch out of native code, resuming from the given instruction next time
+static void cbJit_EmitExit(cbJitBuffer* Buffer, cbJitCondition Condition, cbJitExit Exit, size_t Index, cbError Error)
+{
+    cbJit_EmitBranch(Buffer, Condition, true, Exit, Index, Error);
+}
+
+// Plain jmp to an already placed offset
+static void cbJit_EmitJumpTo(cbJitBuffer* Buffer, size_t Offset)
+{
+    __cbEmit(0xE9);
+    cbJit_Emit32(Buffer, (int32_t)(Offset - (Buffer->Size + sizeof(int32_t))));
+}
+
+// Call a C function (the native stack is kept 16-byte aligned throughout)
+static void cbJit_EmitCall(cbJitBuffer* Buffer, const void* Function)
+{
+    __cbEmit(0x48, 0xB8);                                   // mov rax, imm64
+    cbJit_Emit64(Buffer, (uint64_t)(uintptr_t)Function);
+    __cbEmit(0xFF, 0xD0);                                   // call rax
+}
+
+// Push a new stack slot (the interpreter's overflow check included), leaving its address in rcx
+static void cbJit_EmitPush(cbJitBuffer* Buffer, size_t Index)
+{
+    __cbEmit(0x49, 0x83, 0xED, sizeof(cbVariable));         // sub r13, 16
+    __cbEmit(0x4C, 0x3B, 0xAB);                             // cmp r13, [rbx + HeapPointer]
+    cbJit_Emit32(Buffer, __cbField(HeapPointer));
+    cbJit_EmitExit(Buffer, cbJitCondition_Below, cbJitExit_Error, Index + 1, cbError_Overflow);
+    __cbEmit(0x4B, 0x8D, 0x0C, 0x2C);                       // lea rcx, [r12 + r13]
+}
+
+// Pop the two operands of a binary op: A (top) into rsi, B into rdi, and the result slot (B's) into rcx
+static void cbJit_EmitPopOperands(cbJitBuffer* Buffer)
+{
+    __cbEmit(0x4B, 0x8D, 0x34, 0x2C);                       // lea rsi, [r12 + r13]
+    __cbEmit(0x48, 0x8D, 0x7E, sizeof(cbVariable));         // lea rdi, [rsi + 16]
+    __cbEmit(0x48, 0x89, 0xF9);                             // mov rcx, rdi
+    __cbEmit(0x49, 0x83, 0xC5, sizeof(cbVariable));         // add r13, 16
+}
+
+/*** Instruction Templates ***/
+
+// Returns the native jump destination of a relative jump; anything out of the code lands on the sentinel
+static size_t cbJit_GetTarget(size_t Index, int Arg, size_t Count)
+{
+    long Destination = (long)Index + Arg;
+    if(Destination < 0 || Destination > (long)Count)
+        Destination = Count;
+    return (size_t)Destination;
+}
+
+// Returns the (static data) literal at the given offset, or NULL if out of bounds
+static cbVariable* cbJit_GetLiteral(cbVirtualMachine* Processor, int Offset)
+{
+    if(Offset < 0 || Processor->DataPointer + Offset + sizeof(cbVariable) > Processor->HeapPointer)
+        return NULL;
+    return (cbVariable*)((char*)Processor->Memory + Processor->DataPointer + Offset);
+}
+
+// Returns true if the given variable slot (offset from the stack base) is within the stack
+static bool cbJit_IsSlot(cbVirtualMachine* Processor, int Offset)
+{
+    return Offset < 0 && (size_t)-(long)Offset <= Processor->StackBasePointer - Processor->HeapPointer;
+}
+
+// Truth value of an if condition, as with cbStep_If: 1 if true, 0 if false, -1 on a type mismatch
+static int cbJit_GetTruth(cbVariable* A)
+{
+    if(A->Type == cbVariableType_Int)
+        return A->Data.Int != 0;
+    else if(A->Type == cbVariableType_Float)
+        return A->Data.Float != 0;
+    else if(A->Type == cbVariableType_Bool)
+        return A->Data.Bool != 0;
+    else
+        return -1;
+}
+
+// Emit the native code of a single instruction; returns false if the instruction is invalid
+static bool cbJit_EmitInstruction(cbVirtualMachine* Processor, cbJitBuffer* Buffer, size_t Index, size_t Count)
+{
+    cbInstruction* Instruction = (cbInstruction*)Processor->Memory + Index;
+    
+    // Ops are never checked at run-time, so reject the program now
+    if((unsigned int)Instruction->Op >= (unsigned int)cbOpsCount)
+        return false;
+    
+    // Take a tick, or leave (without running the instruction) if there are none left
+    __cbEmit(0x49, 0x83, 0xEE, 0x01);                       // sub r14, 1
+    cbJit_EmitExit(Buffer, cbJitCondition_Below, cbJitExit_Budget, Index, cbError_None);
+    
+    switch(Instruction->Op)
+    {
+        // Only takes its tick
+        case cbOps_Nop:
+            break;
+        
+        // Push a copy of the variable's value, or of a literal
+        case cbOps_LoadValue:
+            if(!cbJit_IsSlot(Processor, Instruction->Arg))
+                return false;
+            
+            cbJit_EmitPush(Buffer, Index);
+            __cbEmit(0x0F, 0x10, 0x85);                     // movups xmm0, [rbp + Variable]
+            cbJit_Emit32(Buffer, Instruction->Arg);
+            __cbEmit(0x0F, 0x11, 0x01);                     // movups [rcx], xmm0
+            break;
+        case cbOps_LoadData:
+        {
+            cbVariable* Literal = cbJit_GetLiteral(Processor, Instruction->Arg);
+            if(Literal == NULL)
+                return false;
+            
+            cbJit_EmitPush(Buffer, Index);
+            __cbEmit(0x48, 0xB8);                           // mov rax, imm64
+            cbJit_Emit64(Buffer, (uint64_t)(uintptr_t)Literal);
+            __cbEmit(0x0F, 0x10, 0x00);                     // movups xmm0, [rax]
+            __cbEmit(0x0F, 0x11, 0x01);                     // movups [rcx], xmm0
+            break;
+        }
+        
+        // Type-specialized ops: no type checks, as with cbStep_IntOp
+        case cbOps_AddInt:
+        case cbOps_SubInt:
+        case cbOps_MulInt:
+        case cbOps_DivInt:
+        case cbOps_ModInt:
+        case cbOps_EqInt:
+        case cbOps_NotEqInt:
+        case cbOps_GreaterInt:
+        case cbOps_GreaterEqInt:
+        case cbOps_LessInt:
+        case cbOps_LessEqInt:
+            cbJit_EmitPopOperands(Buffer);
+            __cbEmit(0x8B, 0x47, 0x08);                     // mov eax, [rdi + 8]
+            switch(Instruction->Op)
+            {
+                case cbOps_AddInt:  __cbEmit(0x03, 0x46, 0x08);         break;  // add eax, [rsi + 8]
+                case cbOps_SubInt:  __cbEmit(0x2B, 0x46, 0x08);         break;  // sub eax, [rsi + 8]
+                case cbOps_MulInt:  __cbEmit(0x0F, 0xAF, 0x46, 0x08);   break;  // imul eax, [rsi + 8]
+                case cbOps_DivInt:
+                case cbOps_ModInt:
+                    __cbEmit(0x44, 0x8B, 0x46, 0x08);       // mov r8d, [rsi + 8]
+                    __cbEmit(0x45, 0x85, 0xC0);             // test r8d, r8d
+                    cbJit_EmitExit(Buffer, cbJitCondition_Equal, cbJitExit_Error, Index + 1, cbError_DivZero);
+                    __cbEmit(0x99);                         // cdq
+                    __cbEmit(0x41, 0xF7, 0xF8);             // idiv r8d
+                    if(Instruction->Op == cbOps_ModInt)
+                        __cbEmit(0x89, 0xD0);               // mov eax, edx
+                    break;
+                default:
+                {
+                    // Comparisons: setcc of the matching condition
+                    static const unsigned char SetCodes[] = { 0x94, 0x95, 0x9F, 0x9D, 0x9C, 0x9E };
+                    __cbEmit(0x3B, 0x46, 0x08);             // cmp eax, [rsi + 8]
+                    __cbEmit(0x0F, SetCodes[Instruction->Op - cbOps_EqInt], 0xC0);   // setcc al
+                    __cbEmit(0x0F, 0xB6, 0xC0);             // movzx eax, al
+                    break;
+                }
+            }
+            __cbEmit(0xC7, 0x01);                           // mov dword [rcx], Int
+            cbJit_Emit32(Buffer, cbVariableType_Int);
+            __cbEmit(0x89, 0x41, 0x08);                     // mov [rcx + 8], eax
+            break;
+        
+        // Pop the top of the stack into the variable, as with cbStep_Store
+        case cbOps_StoreToSlot:
+            if(!cbJit_IsSlot(Processor, Instruction->Arg))
+                return false;
+            
+            __cbEmit(0x43, 0x0F, 0x10, 0x04, 0x2C);         // movups xmm0, [r12 + r13]
+            __cbEmit(0x49, 0x83, 0xC5, sizeof(cbVariable)); // add r13, 16
+            __cbEmit(0x0F, 0x11, 0x85);                     // movups [rbp + Variable], xmm0
+            cbJit_Emit32(Buffer, Instruction->Arg);
+            break;
+        
+        // Jumps are native; integer conditions are tested inline, all others through cbJit_GetTruth
+        case cbOps_If:
+        {
+            size_t Target = cbJit_GetTarget(Index, Instruction->Arg, Count);
+            __cbEmit(0x4B, 0x8D, 0x34, 0x2C);               // lea rsi, [r12 + r13]
+            __cbEmit(0x49, 0x83, 0xC5, sizeof(cbVariable)); // add r13, 16
+            __cbEmit(0x83, 0x3E, cbVariableType_Int);       // cmp dword [rsi], Int
+            __cbEmit(0x75, 0x0F);                           // jne +15 (to the slow path)
+            __cbEmit(0x83, 0x7E, 0x08, 0x00);               // cmp dword [rsi + 8], 0
+            cbJit_EmitJump(Buffer, cbJitCondition_Equal, Target);
+            cbJit_EmitJump(Buffer, cbJitCondition_Always, Index + 1);
+            __cbEmit(0x48, 0x89, 0xF7);                     // mov rdi, rsi
+            cbJit_EmitCall(Buffer, (const void*)cbJit_GetTruth);
+            __cbEmit(0x85, 0xC0);                           // test eax, eax
+            cbJit_EmitExit(Buffer, cbJitCondition_Sign, cbJitExit_Error, Index + 1, cbError_TypeMismatch);
+            cbJit_EmitJump(Buffer, cbJitCondition_Equal, Target);
+            break;
+        }
+        case cbOps_Goto:
+        {
+            // Loops close with a jump back, where a posted request leaves once the jump is taken
+            size_t Target = cbJit_GetTarget(Index, Instruction->Arg, Count);
+            if(Target <= Index)
+            {
+                __cbEmit(0x83, 0xBB);                       // cmp dword [rbx + Request], 0
+                cbJit_Emit32(Buffer, __cbField(Request));
+                __cbEmit(0x00);
+                cbJit_EmitExit(Buffer, cbJitCondition_NotEqual, cbJitExit_Error, Target, cbError_None);
+            }
+            cbJit_EmitJump(Buffer, cbJitCondition_Always, Target);
+            break;
+        }
+        
+        // Halts and interrupts set their state, then leave
+        case cbOps_Halt:
+            __cbEmit(0xC6, 0x83);                           // mov byte [rbx + Halted], 1
+            cbJit_Emit32(Buffer, __cbField(Halted));
+            __cbEmit(0x01);
+            cbJit_EmitExit(Buffer, cbJitCondition_Always, cbJitExit_Error, Index + 1, cbError_None);
+            break;
+        case cbOps_Pause:
+            __cbEmit(0xC7, 0x83);                           // mov dword [rbx + InterruptState], imm32
+            cbJit_Emit32(Buffer, __cbField(InterruptState));
+            cbJit_Emit32(Buffer, cbInterrupt_Pause);
+            cbJit_EmitExit(Buffer, cbJitCondition_Always, cbJitExit_Error, Index + 1, cbError_None);
+            break;
+        
+        // Fused ops: the literal is static data, so it is folded into the code as an immediate
+        case cbOps_SetMath:
+        case cbOps_IfComp:
+        {
+            // Validate the operand slots, as the decoder does
+            if(Index + cbUtil_GetOperandSlots(Instruction->Op) >= Count)
+                return false;
+            cbInstruction* Operand = Instruction + 1;
+            cbVariable* Literal = cbJit_GetLiteral(Processor, Operand->Arg);
+            bool IsMath = Operand->Op >= cbOps_Add && Operand->Op <= cbOps_Mod;
+            bool IsComp = Operand->Op >= cbOps_Eq && Operand->Op <= cbOps_LessEq;
+            if(Literal == NULL || (Instruction->Op == cbOps_SetMath && !IsMath) || (Instruction->Op == cbOps_IfComp && (!IsComp || Instruction[2].Op != cbOps_If)))
+                return false;
+            
+            // Only integers are supported (the variable is checked at run-time)
+            int32_t Variable = Instruction->Arg;
+            int32_t Value = Variable + (int32_t)offsetof(cbVariable, Data);
+            if(Literal->Type != cbVariableType_Int)
+            {
+                cbJit_EmitExit(Buffer, cbJitCondition_Always, cbJitExit_Error, Index + 1, cbError_TypeMismatch);
+                break;
+            }
+            __cbEmit(0x83, 0xBD);                           // cmp dword [rbp + Variable], Int
+            cbJit_Emit32(Buffer, Variable);
+            __cbEmit(cbVariableType_Int);
+            cbJit_EmitExit(Buffer, cbJitCondition_NotEqual, cbJitExit_Error, Index + 1, cbError_TypeMismatch);
+            
+            int32_t K = Literal->Data.Int;
+            if(Instruction->Op == cbOps_IfComp)
+            {
+                // Jump to the if's target when false, else skip over the operand slots
+                static const cbJitCondition FalseConditions[] = { cbJitCondition_NotEqual, cbJitCondition_Equal, cbJitCondition_LessEq, cbJitCondition_Less, cbJitCondition_GreaterEq, cbJitCondition_Greater };
+                __cbEmit(0x81, 0xBD);                       // cmp dword [rbp + Value], K
+                cbJit_Emit32(Buffer, Value);
+                cbJit_Emit32(Buffer, K);
+                cbJit_EmitJump(Buffer, FalseConditions[Operand->Op - cbOps_Eq], cbJit_GetTarget(Index + 2, Instruction[2].Arg, Count));
+                cbJit_EmitJump(Buffer, cbJitCondition_Always, Index + 3);
+                break;
+            }
+            
+            // Apply the op straight into the variable, then skip over the operand slot
+            switch(Operand->Op)
+            {
+                case cbOps_Add:
+                    __cbEmit(0x81, 0x85);                   // add dword [rbp + Value], K
+                    cbJit_Emit32(Buffer, Value);
+                    cbJit_Emit32(Buffer, K);
+                    break;
+                case cbOps_Sub:
+                    __cbEmit(0x81, 0xAD);                   // sub dword [rbp + Value], K
+                    cbJit_Emit32(Buffer, Value);
+                    cbJit_Emit32(Buffer, K);
+                    break;
+                case cbOps_Mul:
+                    __cbEmit(0x8B, 0x85);                   // mov eax, [rbp + Value]
+                    cbJit_Emit32(Buffer, Value);
+                    __cbEmit(0x69, 0xC0);                   // imul eax, eax, K
+                    cbJit_Emit32(Buffer, K);
+                    __cbEmit(0x89, 0x85);                   // mov [rbp + Value], eax
+                    cbJit_Emit32(Buffer, Value);
+                    break;
+                default:
+                    // Division and modulo by a zero literal always fail
+                    if(K == 0)
+                    {
+                        cbJit_EmitExit(Buffer, cbJitCondition_Always, cbJitExit_Error, Index + 1, cbError_DivZero);
+                        break;
+                    }
+                    __cbEmit(0x8B, 0x85);                   // mov eax, [rbp + Value]
+                    cbJit_Emit32(Buffer, Value);
+                    __cbEmit(0x99);                         // cdq
+                    __cbEmit(0x41, 0xB8);                   // mov r8d, K
+                    cbJit_Emit32(Buffer, K);
+                    __cbEmit(0x41, 0xF7, 0xF8);             // idiv r8d
+                    if(Operand->Op == cbOps_Div)
+                        __cbEmit(0x89, 0x85);               // mov [rbp + Value], eax
+                    else
+                        __cbEmit(0x89, 0x95);               // mov [rbp + Value], edx
+                    cbJit_Emit32(Buffer, Value);
+                    break;
+            }
+            cbJit_EmitJump(Buffer, cbJitCondition_Always, Index + 2);
+            break;
+        }
+        
+        // Everything else (generic ops, output, stack frames) runs on the interpreter; input
+        // (unless taken from the input buffer) and waits then leave, as the other interrupts do
+        case cbOps_Input:
+        case cbOps_GetKey:
+        case cbOps_Wait:
+        default:
+            __cbEmit(0x4C, 0x89, 0xAB);                     // mov [rbx + StackPointer], r13
+            cbJit_Emit32(Buffer, __cbField(StackPointer));
+            __cbEmit(0x48, 0x89, 0xDF);                     // mov rdi, rbx
+            __cbEmit(0x48, 0xBE);                           // mov rsi, imm64
+            cbJit_Emit64(Buffer, (uint64_t)(uintptr_t)Instruction);
+            cbJit_EmitCall(Buffer, (const void*)cbStep_ExecuteInstruction);
+            __cbEmit(0x4C, 0x8B, 0xAB);                     // mov r13, [rbx + StackPointer]
+            cbJit_Emit32(Buffer, __cbField(StackPointer));
+            __cbEmit(0x85, 0xC0);                           // test eax, eax
+            cbJit_EmitExit(Buffer, cbJitCondition_NotEqual, cbJitExit_Helper, Index + 1, cbError_None);
+            if(Instruction->Op == cbOps_Input || Instruction->Op == cbOps_GetKey || Instruction->Op == cbOps_Wait)
+            {
+                __cbEmit(0x83, 0xBB);                       // cmp dword [rbx + InterruptState], 0
+                cbJit_Emit32(Buffer, __cbField(InterruptState));
+                __cbEmit(0x00);
+                cbJit_EmitExit(Buffer, cbJitCondition_NotEqual, cbJitExit_Error, Index + 1, cbError_None);
+            }
+            break;
+    }
+    
+    return true;
+}
+
+/*** JIT Functions ***/
+
+bool cbJit_Compile(cbVirtualMachine* Processor)
+{
+    // Release any previous compilation
+    cbJit_Release(Processor);
+    
+    // Only stack machine code is supported
+    if(Processor->Options & cbOption_RegisterMachine)
+        return false;
+    
+    size_t Count = Processor->DataPointer / sizeof(cbInstruction);
+    size_t* Offsets = malloc((Count + 1) * sizeof(size_t));
+    if(Offsets == NULL)
+        return false;
+    
+    cbJitBuffer BufferData;
+    memset((void*)&BufferData, 0, sizeof(cbJitBuffer));
+    cbJitBuffer* Buffer = &BufferData;
+    
+    /*** Prologue ***/
+    
+    // Save the callee-saved registers (keeping the stack aligned) and load the processor state
+    __cbEmit(0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);   // push rbx, rbp, r12 - r15
+    __cbEmit(0x48, 0x83, 0xEC, 0x08);                       // sub rsp, 8
+    __cbEmit(0x48, 0x89, 0xFB);                             // mov rbx, rdi
+    __cbEmit(0x49, 0x89, 0xF7);                             // mov r15, rsi
+    __cbEmit(0x4C, 0x8B, 0x36);                             // mov r14, [rsi]
+    __cbEmit(0x4C, 0x8B, 0xA3);                             // mov r12, [rbx + Memory]
+    cbJit_Emit32(Buffer, __cbField(Memory));
+    __cbEmit(0x4C, 0x8B, 0xAB);                             // mov r13, [rbx + StackPointer]
+    cbJit_Emit32(Buffer, __cbField(StackPointer));
+    __cbEmit(0x48, 0x8B, 0xAB);                             // mov rbp, [rbx + StackBasePointer]
+    cbJit_Emit32(Buffer, __cbField(StackBasePointer));
+    __cbEmit(0x4C, 0x01, 0xE5);                             // add rbp, r12
+    __cbEmit(0xFF, 0xE2);                                   // jmp rdx
+    
+    /*** Common Exit ***/
+    
+    // Post the stack pointer, instruction pointer (from the instruction index in esi), and ticks left
+    size_t ExitOffset = Buffer->Size;
+    __cbEmit(0x4C, 0x89, 0xAB);                             // mov [rbx + StackPointer], r13
+    cbJit_Emit32(Buffer, __cbField(StackPointer));
+    __cbEmit(0x48, 0xC1, 0xE6, 0x03);                       // shl rsi, 3 (sizeof(cbInstruction))
+    __cbEmit(0x48, 0x89, 0xB3);                             // mov [rbx + InstructionPointer], rsi
+    cbJit_Emit32(Buffer, __cbField(InstructionPointer));
+    __cbEmit(0x4D, 0x89, 0x37);                             // mov [r15], r14
+    __cbEmit(0x48, 0x83, 0xC4, 0x08);                       // add rsp, 8
+    __cbEmit(0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B);   // pop r15 - r12, rbp, rbx
+    __cbEmit(0xC3);                                         // ret
+    
+    /*** Instructions ***/
+    
+    bool IsValid = true;
+    for(size_t i = 0; i < Count && IsValid; i++)
+    {
+        Offsets[i] = Buffer->Size;
+        IsValid = cbJit_EmitInstruction(Processor, Buffer, i, Count);
+    }
+    
+    // End-of-code sentinel: running off the code is an overflow (no tick is taken)
+    Offsets[Count] = Buffer->Size;
+    __cbEmit(0xBE);                                         // mov esi, Count
+    cbJit_Emit32(Buffer, (int32_t)Count);
+    __cbEmit(0xB8);                                         // mov eax, Overflow
+    cbJit_Emit32(Buffer, cbError_Overflow);
+    cbJit_EmitJumpTo(Buffer, ExitOffset);
+    
+    /*** Exit Stubs and Fixups ***/
+    
+    for(size_t i = 0; i < Buffer->FixupCount && IsValid && !Buffer->Failed; i++)
+    {
+        cbJitFixup* Fixup = Buffer->Fixups + i;
+        size_t Destination = Offsets[Fixup->Index];
+        
+        // Each exit gets its own stub
+        if(Fixup->IsExit)
+        {
+            Destination = Buffer->Size;
+            if(Fixup->Exit == cbJitExit_Budget)
+                __cbEmit(0x49, 0xFF, 0xC6);                 // inc r14
+            __cbEmit(0xBE);                                 // mov esi, Index
+            cbJit_Emit32(Buffer, (int32_t)Fixup->Index);
+            if(Fixup->Exit != cbJitExit_Helper)
+            {
+                __cbEmit(0xB8);                             // mov eax, Error
+                cbJit_Emit32(Buffer, Fixup->Error);
+            }
+            cbJit_EmitJumpTo(Buffer, ExitOffset);
+        }
+        
+        // Patch the rel32 (the buffer may have moved, so always index from the base)
+        int32_t Relative = (int32_t)(Destination - (Fixup->Position + sizeof(int32_t)));
+        if(!Buffer->Failed)
+            memcpy(Buffer->Data + Fixup->Position, &Relative, sizeof(int32_t));
+    }
+    
+    /*** Map Native Code ***/
+    
+    cbJitProgram* Program = NULL;
+    if(IsValid && !Buffer->Failed)
+        Program = malloc(sizeof(cbJitProgram));
+    if(Program != NULL)
+    {
+        // Write, then flip to executable (never both at once)
+        Program->CodeSize = Buffer->Size;
+        Program->Code = mmap(NULL, Program->CodeSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        Program->Addresses = malloc((Count + 1) * sizeof(const void*));
+        Program->Count = Count;
+        
+        if(Program->Code == MAP_FAILED || Program->Addresses == NULL)
+        {
+            if(Program->Code != MAP_FAILED)
+                munmap(Program->Code, Program->CodeSize);
+            free(Program->Addresses);
+            free(Program);
+            Program = NULL;
+        }
+        else
+        {
+            memcpy(Program->Code, Buffer->Data, Buffer->Size);
+            for(size_t i = 0; i <= Count; i++)
+                Program->Addresses[i] = Program->Code + Offsets[i];
+        }
+        
+        // Left to the interpreter if the code can't be made executable (i.e. W^X is enforced)
+        if(Program != NULL && mprotect(Program->Code, Program->CodeSize, PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(Program->Code, Program->CodeSize);
+            free(Program->Addresses);
+            free(Program);
+            Program = NULL;
+        }
+    }
+    
+    // Release the generation buffers
+    free(Buffer->Data);
+    free(Buffer->Fixups);
+    free(Offsets);
+    
+    Processor->JitProgram = Program;
+    return Program != NULL;
+}
+
+cbError cbJit_Run(cbVirtualMachine* Processor, size_t MaxTicks)
+{
+    cbJitProgram* Program = Processor->JitProgram;
+    if(Program == NULL)
+        return cbError_Null;
+    
+    // Start from the current instruction; anything out of the code lands on the sentinel
+    size_t Index = Processor->InstructionPointer / sizeof(cbInstruction);
+    if(Index > Program->Count)
+        Index = Program->Count;
+    
+    // Run, then account for the ticks taken
+    size_t TicksLeft = MaxTicks;
+    cbError Error = ((cbJitEntry)Program->Code)(Processor, &TicksLeft, Program->Addresses[Index]);
+    Processor->Ticks += MaxTicks - TicksLeft;
+    
+    return Error;
+}
+
+void cbJit_Release(cbVirtualMachine* Processor)
+{
+    cbJitProgram* Program = Processor->JitProgram;
+    if(Program == NULL)
+        return;
+    
+    munmap(Program->Code, Program->CodeSize);
+    free(Program->Addresses);
+    free(Program);
+    Processor->JitProgram = NULL;
+}
+
+#undef __cbEmit
+#undef __cbField
+
+#else
+
+/*** Unsupported Platforms ***/
+
+bool cbJit_Compile(cbVirtualMachine* Processor)
+{
+    // Always left to the interpreter
+    return false;
+}
+
+cbError cbJit_Run(cbVirtualMachine* Processor, size_t MaxTicks)
+{
+    return cbError_Null;
+}
+
+void cbJit_Release(cbVirtualMachine* Processor)
+{
+}
+
+#endif
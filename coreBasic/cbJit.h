@@ -0,0 +1,39 @@
+/***************************************************************
+ 
+ cBasic - coreBasic - BASIC Language Interpreter on iOS
+ Copyright 2011 Jeremy Bridon - See License.txt for info
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: cbJit.h/c
+ Desc: Baseline JIT compiler for Linux x86-64: translates the
+ (stack machine) code segment into native code, keeping the
+ same memory layout and processor state as the interpreter.
+ 
+***************************************************************/
+
+#ifndef __CBJIT_H__
+#define __CBJIT_H__
+
+/*** Needed includes ***/
+
+#include "cbUtil.h"
+#include "cbTypes.h"
+#include "cbProcess.h"
+
+/*** JIT Functions ***/
+
+// Compile the processor's code segment into native code, replacing any previous compilation;
+// returns false if the platform or code format (register machine code) is not supported, or
+// if the code is invalid, in which case the program is left to the interpreter
+bool cbJit_Compile(cbVirtualMachine* Processor);
+
+// Run the compiled native code from the current instruction pointer; same contract as the
+// cbRun engines: stops on halts, interrupts, errors, or once MaxTicks instructions have run
+cbError cbJit_Run(cbVirtualMachine* Processor, size_t MaxTicks);
+
+// Release the processor's native code, if any
+void cbJit_Release(cbVirtualMachine* Processor);
+
+#endif
@@ -12,13 +12,13 @@
 
 /*** General Function Implementation ***/
 
-bool cbInit_LoadSourceCode(cbVirtualMachine* Processor, unsigned long MemorySize, const char* Code, FILE* StreamOut, FILE* StreamIn, size_t ScreenWidth, size_t ScreenHeight, cbList* ErrorList)
+bool cbInit_LoadSourceCode(cbVirtualMachine* Processor, unsigned long MemorySize, const char* Code, FILE* StreamOut, FILE* StreamIn, size_t ScreenWidth, size_t ScreenHeight, unsigned int Options, cbList* ErrorList)
 {
     // Reset the error list
     cbList_Init(ErrorList);
     
     // Ignore if any arg is null
-    if(Processor == NULL || Code == NULL || StreamOut == NULL || StreamIn == NULL)
+    if(Processor == NULL || Code == NULL)
     {
         cbUtil_RaiseError(ErrorList, cbError_Null, -1);
         return false;
@@ -34,19 +34,28 @@ bool cbInit_LoadSourceCode(cbVirtualMachine* Processor, unsigned long MemorySize
     Processor->MemorySize = MemorySize;
     Processor->Memory = malloc(MemorySize);
     
-    // Alocate screen
-    Processor->ScreenWidth = ScreenWidth;
-    Processor->ScreenHeight = ScreenHeight;
-    Processor->ScreenBuffer = malloc(ScreenWidth * ScreenHeight);
-    
-    // Save standard I/O buffers immediately
-    Processor->StreamOut = StreamOut;
-    Processor->StreamIn = StreamIn;
+    // Read and write the given I/O streams (if any) until the host sets its own sink and provider,
+    // and buffer output with the default policy
+    if(StreamOut != NULL)
+        cbStep_SetOutputSink(Processor, cbStep_FileOutputSink, StreamOut);
+    if(StreamIn != NULL)
+        cbStep_SetInputProvider(Processor, cbStep_FileInputProvider, StreamIn);
+    cbStep_SetOutputPolicy(Processor, cbFlushDefault, cbOutputBufferSize);
     
     // Initialize stack pointers to the highest address (stack size set to 0)
     Processor->StackBasePointer = Processor->MemorySize;
     Processor->StackPointer = Processor->MemorySize;
     
+    // Save the options; the compiler clears the ones it could not apply
+    Processor->Options = Options;
+    
+    // Alocate screen, in the format the options ask for
+    if(cbStep_InitScreen(Processor, ScreenWidth, ScreenHeight) != cbError_None)
+    {
+        cbUtil_RaiseError(ErrorList, cbError_Overflow, -1);
+        return false;
+    }
+    
     /*** Parse & Compile Code ***/
     
     // Parse code into a lex tree (stores in symbols table)
@@ -63,66 +72,86 @@ bool cbInit_LoadSourceCode(cbVirtualMachine* Processor, unsigned long MemorySize
 
 cbError cbInit_LoadByteCode(cbVirtualMachine* Processor, unsigned long MemorySize, FILE* InFile, FILE* StreamOut, FILE* StreamIn, size_t ScreenWidth, size_t ScreenHeight)
 {
-    // TODO: NEED TO UPDATE
-    /*
     // Ignore if any arg is null
-    if(Processor == NULL || InFile == NULL || StreamOut == NULL || StreamIn == NULL)
+    if(Processor == NULL || InFile == NULL)
         return cbError_Null;
     
-    // Allocate the processor memory size and save streams
-    Processor->Memory = malloc(MemorySize);
-    Processor->MemorySize = MemorySize;
-    Processor->StreamOut = StreamOut;
-    Processor->StreamIn = StreamIn;
+    /*** VM Init. ***/
     
-    // Save screen size
-    Processor->ScreenWidth = ScreenWidth;
-    Processor->ScreenHeight = ScreenHeight;
+    // Null out the processor and set default values
+    memset((void*)Processor, 0, sizeof(cbVirtualMachine));
     
-    // Initialize default pointers and vars
-    Processor->StackBasePointer = Processor->StackPointer = MemorySize;
-    Processor->InstructionPointer = 0;
-    Processor->Halted = false;
+    // Allocate the memory map
     Processor->InterruptState = cbInterrupt_None;
-    Processor->Ticks = 0;
-    Processor->LineIndex = 1;
+    Processor->MemorySize = MemorySize;
+    Processor->Memory = malloc(MemorySize);
     
-    // Copy the code and data pointer
-    fread((void*)(&Processor->DataVarCount), sizeof(size_t), 1, InFile);
-    fread((void*)(&Processor->DataPointer), sizeof(size_t), 1, InFile);
-    fread((void*)(&Processor->HeapPointer), sizeof(size_t), 1, InFile);
+    // Read and write the given I/O streams (if any) until the host sets its own sink and provider,
+    // and buffer output with the default policy
+    if(StreamOut != NULL)
+        cbStep_SetOutputSink(Processor, cbStep_FileOutputSink, StreamOut);
+    if(StreamIn != NULL)
+        cbStep_SetInputProvider(Processor, cbStep_FileInputProvider, StreamIn);
+    cbStep_SetOutputPolicy(Processor, cbFlushDefault, cbOutputBufferSize);
+    
+    // Initialize stack pointers to the highest address (stack size set to 0)
+    Processor->StackBasePointer = Processor->MemorySize;
+    Processor->StackPointer = Processor->MemorySize;
     
-    // Copy code segment to first segment
-    fread((void*)Processor->Memory, Processor->DataPointer, 1, InFile);
+    /*** Load Code ***/
     
-    // Copy text (data) segment to second segment
-    fread((void*)Processor->Memory + Processor->DataPointer, Processor->HeapPointer - Processor->DataPointer, 1, InFile);
-    */
-    // No error
-    return cbError_None;
+    // Copy the code and data pointer, and the options (which define the code format)
+    size_t Options = 0;
+    if(fread((void*)(&Processor->DataVarCount), sizeof(size_t), 1, InFile) != 1 ||
+       fread((void*)(&Processor->DataPointer), sizeof(size_t), 1, InFile) != 1 ||
+       fread((void*)(&Processor->HeapPointer), sizeof(size_t), 1, InFile) != 1 ||
+       fread((void*)(&Options), sizeof(size_t), 1, InFile) != 1 ||
+       fread((void*)(&Processor->LineTablePointer), sizeof(size_t), 1, InFile) != 1 ||
+       fread((void*)(&Processor->LineCount), sizeof(size_t), 1, InFile) != 1)
+        return cbError_Null;
+    Processor->Options = (unsigned int)Options;
+    
+    // Alocate screen, in the format the program was compiled for
+    if(cbStep_InitScreen(Processor, ScreenWidth, ScreenHeight) != cbError_None)
+        return cbError_Overflow;
+    
+    // The code and static data must fit in memory, with the line table in the static data
+    if(Processor->DataPointer > Processor->HeapPointer || Processor->HeapPointer >= Processor->MemorySize ||
+       Processor->LineTablePointer < Processor->DataPointer || Processor->LineTablePointer % sizeof(int) != 0 ||
+       Processor->LineCount > (Processor->HeapPointer - Processor->LineTablePointer) / sizeof(cbLineEntry))
+        return cbError_Overflow;
+    
+    // Copy code segment to first segment, then the text (data) segment to the second segment
+    if(fread(Processor->Memory, Processor->HeapPointer, 1, InFile) != 1)
+        return cbError_Null;
+    
+    // Pre-decode into the internal execution form
+    return cbStep_Decode(Processor);
 }
 
 cbError cbInit_SaveByteCode(cbVirtualMachine* Processor, FILE* OutFile)
 {
-    // TODO: NEED TO UPDATE
-    /*
     // Fail if either is null
     if(Processor == NULL || OutFile == NULL)
         return cbError_Null;
     
     // All we need to copy is the code and static data
-    // The first size_t represents the end of the data segment
-    // The second size_t represents the end of the static-data segment
+    // The first size_t represents the number of static variables
+    // The second size_t represents the end of the code segment
+    // The third size_t represents the end of the static-data segment
+    // The fourth size_t represents the options the code was compiled with (not the run-time ones)
+    // The fifth and sixth size_t represent the start and entry count of the line table (within the static data)
+    size_t Options = Processor->Options & ~cbOption_Jit;
     fwrite((void*)(&Processor->DataVarCount), sizeof(size_t), 1, OutFile);
     fwrite((void*)(&Processor->DataPointer), sizeof(size_t), 1, OutFile);
     fwrite((void*)(&Processor->HeapPointer), sizeof(size_t), 1, OutFile);
+    fwrite((void*)(&Options), sizeof(size_t), 1, OutFile);
+    fwrite((void*)(&Processor->LineTablePointer), sizeof(size_t), 1, OutFile);
+    fwrite((void*)(&Processor->LineCount), sizeof(size_t), 1, OutFile);
     
-    // Dump the code segment
-    fwrite(Processor->Memory, Processor->DataPointer, 1, OutFile);
+    // Dump the code segment and the static data segment
+    fwrite(Processor->Memory, Processor->HeapPointer, 1, OutFile);
     
-    // Dump the static data segment
-    fwrite(Processor->Memory + Processor->DataPointer, Processor->HeapPointer - Processor->DataPointer, 1, OutFile);
-    */
     // No error
     return cbError_None;
 }
@@ -133,9 +162,22 @@ cbError cbRelease(cbVirtualMachine* Processor)
     if(Processor == NULL)
         return cbError_Null;
     
-    // Release the allocated processor memory and graphics map
+    // Write out any pending output (compared, if comparing), and the last frame of any recording
+    cbStep_FlushOutput(Processor);
+    cbCompare_Stop(Processor);
+    cbRecord_Stop(Processor);
+    
+    // Release the allocated processor memory, output buffer, graphics map with its changes and draw queue, decoded code, and native code
+    cbJit_Release(Processor);
     free(Processor->Memory);
+    free(Processor->OutputBuffer);
     free(Processor->ScreenBuffer);
+    free(Processor->FrontBuffer);
+    free(Processor->SpareBuffer);
+    free(Processor->DirtyRows);
+    free(Processor->BackDirtyRows);
+    free(Processor->DrawQueue);
+    free(Processor->DecodedCode);
     
     // Null out the processor
     memset((void*)Processor, 0, sizeof(cbVirtualMachine));
@@ -230,8 +272,23 @@ void cbDebug_PrintInstructions(cbVirtualMachine* Processor, FILE* OutHandle)
     fprintf(OutHandle, "===  coreBasic(%d.%d) Instructions  ===\n", Major, Minor);
     
     // Get the instruction count
-    size_t InstructionCount = Processor->DataPointer / sizeof(cbInstruction);
+    size_t InstructionCount = cbDebug_GetInstructionCount(Processor);
     fprintf(OutHandle, " Instruction Count: %lu\n", InstructionCount);
+    
+    // Register machine code has three operands per instruction
+    if(Processor->Options & cbOption_RegisterMachine)
+    {
+        fprintf(OutHandle, " Addr:    Op.   |    out   |     a    |     b    |\n\n");
+        for(size_t InstructionIndex = 0; InstructionIndex < InstructionCount; InstructionIndex++)
+        {
+            cbRegInstruction* Instruction = (cbRegInstruction*)Processor->Memory + InstructionIndex;
+            fprintf(OutHandle, " %04lu: %8s | %8d | %8d | %8d |\n", InstructionIndex * sizeof(cbRegInstruction), cbOpsNames[Instruction->Op], Instruction->Out, Instruction->A, Instruction->B);
+        }
+        
+        fprintf(OutHandle, "\n");
+        return;
+    }
+    
     fprintf(OutHandle, " Addr:    Op.   |    arg.  |\n\n");
     
     // For each instruction
@@ -246,6 +303,15 @@ void cbDebug_PrintInstructions(cbVirtualMachine* Processor, FILE* OutHandle)
         for(int i = 0; i < 8 - strlen(InstructionStr); i++)
             fprintf(OutHandle, "%c", ' ');
         fprintf(OutHandle, "%s | %8d |\n", InstructionStr, Instruction->Arg);
+
+        // Fused ops keep their operands in the following slots; list them as part of the op
+        size_t OperandSlots = cbUtil_GetOperandSlots(Instruction->Op);
+        for(size_t i = 1; i <= OperandSlots && InstructionIndex + 1 < InstructionCount; i++)
+        {
+            InstructionIndex++;
+            Instruction++;
+            fprintf(OutHandle, " %04lu:  > %6s | %8d |\n", InstructionIndex * sizeof(cbInstruction), cbOpsNames[Instruction->Op], Instruction->Arg);
+        }
     }
     
     fprintf(OutHandle, "\n");
@@ -283,8 +349,8 @@ void cbDebug_PrintMemory(cbVirtualMachine* Processor, FILE* OutHandle)
             fprintf(OutHandle, " [Offset  ]  %d\n", Variable->Data.Offset);
     }
     
-    // Print the rest of the data
-    for(size_t DataIndex = VariableCount * sizeof(cbVariable); Processor->DataPointer + DataIndex < Processor->HeapPointer; DataIndex += sizeof(cbVariable))
+    // Print the rest of the data (up to the line table)
+    for(size_t DataIndex = VariableCount * sizeof(cbVariable); Processor->DataPointer + DataIndex < Processor->LineTablePointer; DataIndex += sizeof(cbVariable))
     {
         // Retrieve single-byte data
         char* Data = Processor->Memory + Processor->DataPointer + DataIndex;
@@ -308,7 +374,10 @@ void cbDebug_PrintMemory(cbVirtualMachine* Processor, FILE* OutHandle)
 
 size_t cbDebug_GetInstructionCount(cbVirtualMachine* Processor)
 {
-    return Processor->DataPointer / sizeof(cbInstruction);
+    if(Processor->Options & cbOption_RegisterMachine)
+        return Processor->DataPointer / sizeof(cbRegInstruction);
+    else
+        return Processor->DataPointer / sizeof(cbInstruction);
 }
 
 size_t cbDebug_GetVariableCount(cbVirtualMachine* Processor)
@@ -323,7 +392,25 @@ size_t cbDebug_GetTicks(cbVirtualMachine* Processor)
 
 size_t cbDebug_GetLine(cbVirtualMachine* Processor)
 {
-    return Processor->LineIndex;
+    // The instruction pointer is always past the last instruction run (i.e. the one that failed)
+    size_t InstrSize = (Processor->Options & cbOption_RegisterMachine) ? sizeof(cbRegInstruction) : sizeof(cbInstruction);
+    size_t Index = Processor->InstructionPointer / InstrSize;
+    Index = (Index > 0) ? Index - 1 : 0;
+    
+    // Binary search for the last line starting at or before that instruction
+    cbLineEntry* LineTable = (cbLineEntry*)((char*)Processor->Memory + Processor->LineTablePointer);
+    size_t Low = 0, High = Processor->LineCount;
+    while(Low < High)
+    {
+        size_t Middle = (Low + High) / 2;
+        if((size_t)LineTable[Middle].Instruction <= Index)
+            Low = Middle + 1;
+        else
+            High = Middle;
+    }
+    
+    // No line if we haven't reached the first one yet
+    return (Low > 0) ? (size_t)LineTable[Low - 1].Line : 0;
 }
 
 const char* const cbDebug_GetOpName(cbOps Op)
@@ -20,13 +20,18 @@
 #include "cbTypes.h"
 #include "cbParse.h"
 #include "cbCompile.h"
+#include "cbJit.h"
+#include "cbRecord.h"
+#include "cbCompare.h"
 
 /*** Init / Release Functions ***/
 
 // Initialize a new virtual machine executing the given source code, within the given memory limitation, input and output streams, and screen size
 // If there are any language, parsing, or formatting issues, a false is returned and a list of errors is posted. Else, true is returned
 // Any and all errors are posted to the error list , a list of cbParseError objects which need to be released by the end-developer
-__cbEXPORT bool cbInit_LoadSourceCode(cbVirtualMachine* Processor, unsigned long MemorySize, const char* Code, FILE* StreamOut, FILE* StreamIn, size_t ScreenWidth, size_t ScreenHeight, cbList* ErrorList);
+// Options is a set of cbOption flags (cbOption_None for defaults)
+// Either stream may be null, leaving that side of the I/O to cbStep_SetOutputSink / cbStep_SetInputProvider
+__cbEXPORT bool cbInit_LoadSourceCode(cbVirtualMachine* Processor, unsigned long MemorySize, const char* Code, FILE* StreamOut, FILE* StreamIn, size_t ScreenWidth, size_t ScreenHeight, unsigned int Options, cbList* ErrorList);
 
 // Initiaize a new virtual machine with the execisting byte code, within the given memory limitation, input and output streams, and screen size
 __cbEXPORT cbError cbInit_LoadByteCode(cbVirtualMachine* Processor, unsigned long MemorySize, FILE* InFile, FILE* StreamOut, FILE* StreamIn, size_t ScreenWidth, size_t ScreenHeight);
@@ -62,7 +67,7 @@ __cbEXPORT size_t cbDebug_GetVariableCount(cbVirtualMachine* Processor);
 // Get the number of ticks from a process
 __cbEXPORT size_t cbDebug_GetTicks(cbVirtualMachine* Processor);
 
-// Get the active line we are executing
+// Get the active line we are executing, looked up in the line table from the instruction pointer
 __cbEXPORT size_t cbDebug_GetLine(cbVirtualMachine* Processor);
 
 // Get the formal operator name of a given instruction
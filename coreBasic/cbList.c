@@ -209,7 +209,7 @@ int cbList_FindOffset(cbList* List, void* Data, bool (*ComparisonFunc)(void* A,
     while(Node != NULL)
     {
         // Is this the node we want?
-        if(ComparisonFunc(Data, Node->Data))
+        if(ComparisonFunc(Node->Data, Data))
             break;
         
         // Not found, look at the next node
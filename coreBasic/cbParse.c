@@ -344,9 +344,10 @@ cbLexNode* cbParse_IsExpression(cbList* Tokens, size_t LineCount, cbList* ErrorL
     cbLexNode* Node = NULL;
     
     // Function-call validation:
-    // If it is at least four operators, check if we can apply the function product "ID(ExpressionList)"
+    // If it is at least three operators, check if we can apply the function product "ID(ExpressionList)",
+    // where the list may be empty (i.e. "flip()")
     size_t TokenCount = cbList_GetCount(Tokens);
-    if(TokenCount >= 4)
+    if(TokenCount >= 3)
     {
         // Make sure it is an ID and parenth group
         char* ID = cbList_PeekFront(Tokens);
@@ -9,28 +9,264 @@
 ***************************************************************/
 
 #include "cbProcess.h"
+#include "cbJit.h"
+#include "cbRecord.h"
+#include "cbCompare.h"
 
-cbError cbStep(cbVirtualMachine* Processor, cbInterrupt* InterruptState)
+// Grow the stack up (positive) or down (negative) by the given number of bytes, zeroing out any new space
+static inline cbError cbStep_GrowStack(cbVirtualMachine* Processor, int Bytes)
 {
-    // Ignore if null
-    if(Processor == NULL)
-        return cbError_Null;
+    Processor->StackPointer += Bytes;
     
-    // If proc. is halted, return halt state (not an error, just finalized)
-    if(Processor->Halted)
-        return cbError_Halted;
+    // Bounds check (can't grow up if no space, can't grow down if full)
+    if(Processor->StackPointer >= Processor->MemorySize && Bytes > 0)
+        return cbError_Overflow;
+    else if(Processor->StackPointer < Processor->HeapPointer && Bytes < 0)
+        return cbError_Overflow;
     
-    // If proc. is interrupted, we are waiting for user input on stdin
-    if(Processor->InterruptState != cbInterrupt_None)
-        return cbError_None;
+    // Zero-out the segment being grown
+    else if(Bytes < 0)
+        memset(((char*)Processor->Memory + Processor->StackPointer), 0, -Bytes);
+    return cbError_None;
+}
+
+// Append the given text to the output buffer, writing the buffer out to the output sink whenever it
+// fills up; without a buffer, the text is handed to the sink as is. Any comparison sees it right away
+static void cbStep_WriteOutput(cbVirtualMachine* Processor, const char* Text, size_t Length)
+{
+    if(Processor->Comparator != NULL)
+        cbCompare_Output(Processor, Text, Length);
+    
+    if(Processor->OutputSize == 0)
+    {
+        if(Processor->OutputSink != NULL)
+            Processor->OutputSink(Processor->OutputContext, Text, Length);
+        return;
+    }
+    
+    while(Length > 0)
+    {
+        if(Processor->OutputLength == Processor->OutputSize)
+            cbStep_FlushOutput(Processor);
+        
+        size_t Count = Processor->OutputSize - Processor->OutputLength;
+        Count = (Count < Length) ? Count : Length;
+        memcpy(Processor->OutputBuffer + Processor->OutputLength, Text, Count);
+        Processor->OutputLength += Count;
+        Text += Count;
+        Length -= Count;
+    }
+}
+
+// Find the characters and length of the given string variable; returns an error if they are not
+// within the static data
+static cbError cbStep_GetString(cbVirtualMachine* Processor, cbVariable* A, const char** Text, size_t* Length)
+{
+    // The string's length is stored right before it; both must be within the static data
+    size_t Offset = (size_t)A->Data.String;
+    size_t DataSize = Processor->HeapPointer - Processor->DataPointer;
+    if(Offset < sizeof(int) || Offset > DataSize)
+        return cbError_Overflow;
     
-    // Instruction pointer bounds check
-    if(Processor->InstructionPointer > Processor->MemorySize - sizeof(cbInstruction))
+    int StringLength = *(int*)((char*)Processor->Memory + Processor->DataPointer + Offset - sizeof(int));
+    if(StringLength < 0 || (size_t)StringLength > DataSize - Offset)
         return cbError_Overflow;
     
-    // Error state defaults to none and load the instruction
+    *Text = (char*)Processor->Memory + Processor->DataPointer + Offset;
+    *Length = (size_t)StringLength;
+    return cbError_None;
+}
+
+// Grow the given row's changed columns over [Start, End), of whichever buffer is drawn into
+static inline void cbStep_MarkDirty(cbVirtualMachine* Processor, size_t Y, size_t Start, size_t End)
+{
+    size_t* Dirty = ((Processor->BackDirtyRows != NULL) ? Processor->BackDirtyRows : Processor->DirtyRows) + Y * 2;
+    if(Dirty[0] >= Dirty[1])
+    {
+        Dirty[0] = Start;
+        Dirty[1] = End;
+    }
+    else
+    {
+        if(Start < Dirty[0])
+            Dirty[0] = Start;
+        if(End > Dirty[1])
+            Dirty[1] = End;
+    }
+}
+
+// Set the pixel of the given row to the given color (0 - 3), without any bounds checks
+static inline void cbStep_PutPixel(cbVirtualMachine* Processor, unsigned char* Row, size_t X, int Color)
+{
+    if(Processor->Options & cbOption_PackedScreen)
+    {
+        int Shift = (X % 4) * 2;
+        Row[X / 4] = (Row[X / 4] & ~(3 << Shift)) | (Color << Shift);
+    }
+    else
+        Row[X] = Color;
+}
+
+// Post the given draw event to the host, if the draw queue is on; when it is full, the event is dropped
+// and the host told to redraw everything instead. The processor is the only producer
+static void cbStep_PostDrawEvent(cbVirtualMachine* Processor, cbDrawEventType Type, int X, int Y, int EndX, int EndY, int Width, int Height, int Color, const char* Sprite)
+{
+    if(Processor->DrawQueue == NULL)
+        return;
+    
+    size_t Head = Processor->DrawHead;
+    if(Head - __cbAtomicLoad(Processor->DrawTail) == Processor->DrawQueueSize)
+    {
+        __cbAtomicStore(Processor->DrawOverflow, true);
+        return;
+    }
+    
+    cbDrawEvent* Event = &Processor->DrawQueue[Head & (Processor->DrawQueueSize - 1)];
+    Event->Type = Type;
+    Event->X = X;
+    Event->Y = Y;
+    Event->EndX = EndX;
+    Event->EndY = EndY;
+    Event->Width = Width;
+    Event->Height = Height;
+    Event->Color = Color;
+    Event->Sprite = Sprite;
+    
+    // Only published once written
+    __cbAtomicStore(Processor->DrawHead, Head + 1);
+}
+
+// Fill the columns [X0, X1) of the given row with the given color (0 - 3), clipped to the screen; whole
+// bytes are set at once, so packed rows only take pixel-by-pixel writes at their ends
+static void cbStep_FillSpan(cbVirtualMachine* Processor, long X0, long X1, long Y, int Color)
+{
+    if(Y < 0 || Y >= (long)Processor->ScreenHeight)
+        return;
+    if(X0 < 0)
+        X0 = 0;
+    if(X1 > (long)Processor->ScreenWidth)
+        X1 = Processor->ScreenWidth;
+    if(X0 >= X1)
+        return;
+    
+    unsigned char* Row = Processor->ScreenBuffer + Processor->ScreenPitch * Y;
+    if(Processor->Options & cbOption_PackedScreen)
+    {
+        long X = X0;
+        for(; X < X1 && X % 4 != 0; X++)
+            cbStep_PutPixel(Processor, Row, X, Color);
+        
+        long Bytes = (X1 - X) / 4;
+        memset(Row + X / 4, Color * 0x55, Bytes);
+        
+        for(X += Bytes * 4; X < X1; X++)
+            cbStep_PutPixel(Processor, Row, X, Color);
+    }
+    else
+        memset(Row + X0, Color, X1 - X0);
+    
+    cbStep_MarkDirty(Processor, Y, X0, X1);
+}
+
+// Offset along the minor axis of a line at the given step along its major axis, rounded to the nearest pixel
+static inline long cbStep_LineOffset(long Step, long MinorDelta, long MajorDelta)
+{
+    if(MajorDelta == 0)
+        return 0;
+    
+    // Floored division of (Step * MinorDelta / MajorDelta + 1/2)
+    long long Numerator = 2 * (long long)Step * MinorDelta + MajorDelta;
+    long long Denominator = 2 * (long long)MajorDelta;
+    long long Offset = Numerator / Denominator;
+    if(Numerator % Denominator != 0 && Numerator < 0)
+        Offset--;
+    return (long)Offset;
+}
+
+// Draw a line between both (inclusive) end points, only walking its major axis within the screen;
+// mostly-horizontal lines are filled as one span per row
+static void cbStep_DrawLine(cbVirtualMachine* Processor, long X0, long Y0, long X1, long Y1, int Color)
+{
+    if(labs(X1 - X0) >= labs(Y1 - Y0))
+    {
+        if(X1 < X0)
+        {
+            long Temp = X0; X0 = X1; X1 = Temp;
+            Temp = Y0; Y0 = Y1; Y1 = Temp;
+        }
+        
+        long Start = (X0 > 0) ? X0 : 0;
+        long End = (X1 < (long)Processor->ScreenWidth - 1) ? X1 : (long)Processor->ScreenWidth - 1;
+        if(Start > End)
+            return;
+        
+        // Collect the run of pixels on the same row, filling it once the line steps off the row
+        long RunX = Start, RunY = Y0 + cbStep_LineOffset(Start - X0, Y1 - Y0, X1 - X0);
+        for(long X = Start + 1; X <= End; X++)
+        {
+            long Y = Y0 + cbStep_LineOffset(X - X0, Y1 - Y0, X1 - X0);
+            if(Y != RunY)
+            {
+                cbStep_FillSpan(Processor, RunX, X, RunY, Color);
+                RunX = X;
+                RunY = Y;
+            }
+        }
+        cbStep_FillSpan(Processor, RunX, End + 1, RunY, Color);
+    }
+    else
+    {
+        if(Y1 < Y0)
+        {
+            long Temp = X0; X0 = X1; X1 = Temp;
+            Temp = Y0; Y0 = Y1; Y1 = Temp;
+        }
+        
+        long Start = (Y0 > 0) ? Y0 : 0;
+        long End = (Y1 < (long)Processor->ScreenHeight - 1) ? Y1 : (long)Processor->ScreenHeight - 1;
+        for(long Y = Start; Y <= End; Y++)
+        {
+            long X = X0 + cbStep_LineOffset(Y - Y0, X1 - X0, Y1 - Y0);
+            cbStep_FillSpan(Processor, X, X + 1, Y, Color);
+        }
+    }
+}
+
+// Draw the sprite's rows of the given width at the given position, skipping transparent pixels
+static void cbStep_DrawSprite(cbVirtualMachine* Processor, long X, long Y, long Width, const char* Sprite, size_t Length)
+{
+    if(Width <= 0)
+        return;
+    
+    // Only the columns within the screen are looked at
+    long Start = (X > 0) ? 0 : -X;
+    long End = ((long)Processor->ScreenWidth - X < Width) ? (long)Processor->ScreenWidth - X : Width;
+    long Height = ((long)Length + Width - 1) / Width;
+    for(long Row = 0; Row < Height && Start < End; Row++)
+    {
+        if(Y + Row < 0 || Y + Row >= (long)Processor->ScreenHeight)
+            continue;
+        
+        unsigned char* Pixels = Processor->ScreenBuffer + Processor->ScreenPitch * (Y + Row);
+        const char* Colors = Sprite + Row * Width;
+        long RowEnd = ((long)Length - Row * Width < End) ? (long)Length - Row * Width : End;
+        for(long Column = Start; Column < RowEnd; Column++)
+        {
+            if(Colors[Column] >= '0' && Colors[Column] <= '3')
+                cbStep_PutPixel(Processor, Pixels, X + Column, Colors[Column] - '0');
+        }
+        
+        if(Start < RowEnd)
+            cbStep_MarkDirty(Processor, Y + Row, X + Start, X + RowEnd);
+    }
+}
+
+// Execute the given instruction against the processor state; does not grow the tick count nor
+// the instruction pointer, which is left to the calling loop (either cbStep or cbRun)
+static inline cbError cbStep_Execute(cbVirtualMachine* Processor, cbInstruction* Instruction)
+{
+    // Error state defaults to none
     cbError Error = cbError_None;
-    cbInstruction* Instruction = (cbInstruction*)((char*)Processor->Memory + Processor->InstructionPointer);
     
     // Execute the instruction
     switch(Instruction->Op)
@@ -66,17 +302,32 @@ cbError cbStep(cbVirtualMachine* Processor, cbInterrupt* InterruptState)
             Error = cbStep_LogicOp(Processor, Instruction);
             break;
         
+        // Type-specialized math and comparison ops.
+        case cbOps_AddInt:
+        case cbOps_SubInt:
+        case cbOps_MulInt:
+        case cbOps_DivInt:
+        case cbOps_ModInt:
+        case cbOps_EqInt:
+        case cbOps_NotEqInt:
+        case cbOps_GreaterInt:
+        case cbOps_GreaterEqInt:
+        case cbOps_LessInt:
+        case cbOps_LessEqInt:
+            Error = cbStep_IntOp(Processor, Instruction);
+            break;
+        
         // Program control ops.
         case cbOps_Goto:
-            // When jumping, make sure to jump one less since we grow the instruction ptr. next loop
-            Processor->InstructionPointer += Instruction->Arg - sizeof(cbInstruction);
+            // Arg is an instruction count; jump one less since we grow the instruction ptr. next loop
+            Processor->InstructionPointer += (Instruction->Arg - 1) * sizeof(cbInstruction);
             break;
         case cbOps_Halt:
             Processor->Halted = true;
             break;
         
         // Memory control
-        case cbOps_Set:
+        case cbOps_StoreToSlot:
             Error = cbStep_Store(Processor, Instruction);
             break;
         case cbOps_LoadData:
@@ -87,41 +338,36 @@ cbError cbStep(cbVirtualMachine* Processor, cbInterrupt* InterruptState)
             else
                 memcpy((char*)Processor->Memory + Processor->StackPointer, (char*)Processor->Memory + Processor->DataPointer + Instruction->Arg, sizeof(cbVariable));
             break;
-        case cbOps_LoadVar:
-            // Stack grows, and set variable to be a reference to the var from the base stack address
+        case cbOps_LoadValue:
+            // Stack grows, and copy over the variable's value from the base stack address
             Processor->StackPointer -= sizeof(cbVariable);
             if(Processor->StackPointer < Processor->HeapPointer)
                 Error = cbError_Overflow;
             else
-            {
-                ((cbVariable*)((char*)Processor->Memory + Processor->StackPointer))->Type = cbVariableType_Offset;
-                ((cbVariable*)((char*)Processor->Memory + Processor->StackPointer))->Data.Offset = Instruction->Arg;
-            }
+                memcpy((char*)Processor->Memory + Processor->StackPointer, (char*)Processor->Memory + Processor->StackBasePointer + Instruction->Arg, sizeof(cbVariable));
             break;
         case cbOps_AddStack:
-            // Grow stack up (positive) or down (negative)
-            Processor->StackPointer += Instruction->Arg;
-            
-            // Bounds check (can't grow up if no space, can't grow down if full)
-            if(Processor->StackPointer >= Processor->MemorySize && Instruction->Arg > 0)
-                Error = cbError_Overflow;
-            else if(Processor->StackPointer < Processor->HeapPointer && Instruction->Arg < 0)
-                Error = cbError_Overflow;
-            
-            // Zero-out the segment being grown
-            else if(Instruction->Arg < 0)
-                memset(((char*)Processor->Memory + Processor->StackPointer), 0, -(Instruction->Arg));
+            Error = cbStep_GrowStack(Processor, Instruction->Arg);
+            break;
+        
+        // Fused ops.
+        case cbOps_SetMath:
+            Error = cbStep_SetMath(Processor, Instruction);
+            break;
+        case cbOps_IfComp:
+            Error = cbStep_IfComp(Processor, Instruction);
             break;
         
-        // Input control (i.e. interrupts)
+        // Input control (i.e. interrupts, unless the input was given up front)
         case cbOps_Pause:
             Processor->InterruptState = cbInterrupt_Pause;
             break;
         case cbOps_Input:
-            Processor->InterruptState = cbInterrupt_Input;
-            break;
         case cbOps_GetKey:
-            Processor->InterruptState = cbInterrupt_GetKey;
+            Error = cbStep_Input(Processor, Instruction);
+            break;
+        case cbOps_Wait:
+            Error = cbStep_Wait(Processor, Instruction);
             break;
         
         // Output control
@@ -134,6 +380,14 @@ cbError cbStep(cbVirtualMachine* Processor, cbInterrupt* InterruptState)
         case cbOps_Clear:
             Error = cbStep_Clear(Processor, Instruction);
             break;
+        case cbOps_Flip:
+            Error = cbStep_Flip(Processor, Instruction);
+            break;
+        case cbOps_Line:
+        case cbOps_Rect:
+        case cbOps_Blit:
+            Error = cbStep_Draw(Processor, Instruction);
+            break;
         
         // TODO
         case cbOps_Exec:
@@ -141,9 +395,192 @@ cbError cbStep(cbVirtualMachine* Processor, cbInterrupt* InterruptState)
         case cbOps_Return:
             break;
         
-        // Nop: Does nothing except stalls a cycle and saves the current line number
+        // Nop: Does nothing except stalls a cycle
+        case cbOps_Nop:
+            break;
+        
+        // Keywords that are not to become operators
+        default:
+            Error = cbError_UnknownOp;
+            break;
+    }
+    
+    return Error;
+}
+
+// Resolve an operand of a register machine instruction: negative offsets are frame slots from the
+// stack base (variables and temporaries), all others are static data offsets from the data pointer
+static inline cbVariable* cbStep_GetOperand(cbVirtualMachine* Processor, int Offset)
+{
+    return (cbVariable*)((char*)Processor->Memory + ((Offset < 0) ? Processor->StackBasePointer : Processor->DataPointer) + Offset);
+}
+
+// Execute the given register machine instruction; same as cbStep_Execute, but operands are read from
+// and written to the variable slots directly, never through the stack
+static inline cbError cbStep_ExecuteRegister(cbVirtualMachine* Processor, cbRegInstruction* Instruction)
+{
+    // Error state defaults to none
+    cbError Error = cbError_None;
+    
+    // Execute the instruction
+    switch(Instruction->Op)
+    {
+        // Conditional ops.
+        case cbOps_If:
+        {
+            // Int, float, and bool are accepted
+            cbVariable* A = cbStep_GetOperand(Processor, Instruction->A);
+            if(A->Type != cbVariableType_Int && A->Type != cbVariableType_Float && A->Type != cbVariableType_Bool)
+                Error = cbError_TypeMismatch;
+            
+            // Jump outside of the conditional block if false (one less, since the loop grows the instruction ptr.)
+            else if((A->Type == cbVariableType_Int && A->Data.Int == 0) ||
+                    (A->Type == cbVariableType_Float && A->Data.Float == 0) ||
+                    (A->Type == cbVariableType_Bool && A->Data.Bool == 0))
+                Processor->InstructionPointer += (Instruction->Out - 1) * sizeof(cbRegInstruction);
+            break;
+        }
+        
+        // Math and comparison ops. (integer-only)
+        case cbOps_Add:
+        case cbOps_Sub:
+        case cbOps_Mul:
+        case cbOps_Div:
+        case cbOps_Mod:
+        case cbOps_Eq:
+        case cbOps_NotEq:
+        case cbOps_Greater:
+        case cbOps_GreaterEq:
+        case cbOps_Less:
+        case cbOps_LessEq:
+        case cbOps_AddInt:
+        case cbOps_SubInt:
+        case cbOps_MulInt:
+        case cbOps_DivInt:
+        case cbOps_ModInt:
+        case cbOps_EqInt:
+        case cbOps_NotEqInt:
+        case cbOps_GreaterInt:
+        case cbOps_GreaterEqInt:
+        case cbOps_LessInt:
+        case cbOps_LessEqInt:
+        {
+            // Type-specialized ops skip the type check
+            cbVariable* A = cbStep_GetOperand(Processor, Instruction->A);
+            cbVariable* B = cbStep_GetOperand(Processor, Instruction->B);
+            if(Instruction->Op < cbOps_AddInt && (A->Type != cbVariableType_Int || B->Type != cbVariableType_Int))
+                return cbError_TypeMismatch;
+            
+            int Result = 0;
+            switch(cbUtil_GetGenericOp(Instruction->Op))
+            {
+                case cbOps_Add:         Result = A->Data.Int + B->Data.Int;     break;
+                case cbOps_Sub:         Result = A->Data.Int - B->Data.Int;     break;
+                case cbOps_Mul:         Result = A->Data.Int * B->Data.Int;     break;
+                case cbOps_Eq:          Result = A->Data.Int == B->Data.Int;    break;
+                case cbOps_NotEq:       Result = A->Data.Int != B->Data.Int;    break;
+                case cbOps_Greater:     Result = A->Data.Int > B->Data.Int;     break;
+                case cbOps_GreaterEq:   Result = A->Data.Int >= B->Data.Int;    break;
+                case cbOps_Less:        Result = A->Data.Int < B->Data.Int;     break;
+                case cbOps_LessEq:      Result = A->Data.Int <= B->Data.Int;    break;
+                case cbOps_Mod:
+                    if(B->Data.Int == 0)
+                        return cbError_DivZero;
+                    Result = A->Data.Int % B->Data.Int;
+                    break;
+                default:
+                    if(B->Data.Int == 0)
+                        return cbError_DivZero;
+                    Result = A->Data.Int / B->Data.Int;
+                    break;
+            }
+            
+            // The output, for now, will always be integers
+            cbVariable* Out = cbStep_GetOperand(Processor, Instruction->Out);
+            Out->Type = cbVariableType_Int;
+            Out->Data.Int = Result;
+            break;
+        }
+        
+        // Boolean ops.
+        case cbOps_Not:
+        {
+            // Only support boolean or integers
+            cbVariable* A = cbStep_GetOperand(Processor, Instruction->A);
+            if(A->Type != cbVariableType_Int && A->Type != cbVariableType_Bool)
+                return cbError_TypeMismatch;
+            
+            cbVariable Result = *A;
+            Result.Data.Int = !(A->Data.Int);
+            *cbStep_GetOperand(Processor, Instruction->Out) = Result;
+            break;
+        }
+        case cbOps_And:
+        case cbOps_Or:
+        {
+            // Only support boolean or integers
+            cbVariable* A = cbStep_GetOperand(Processor, Instruction->A);
+            cbVariable* B = cbStep_GetOperand(Processor, Instruction->B);
+            if((A->Type != cbVariableType_Int && A->Type != cbVariableType_Bool) || (B->Type != cbVariableType_Int && B->Type != cbVariableType_Bool))
+                return cbError_TypeMismatch;
+            
+            int Result = (Instruction->Op == cbOps_And) ? (A->Data.Int && B->Data.Int) : (A->Data.Int || B->Data.Int);
+            cbVariable* Out = cbStep_GetOperand(Processor, Instruction->Out);
+            Out->Type = cbVariableType_Int;
+            Out->Data.Int = Result;
+            break;
+        }
+        
+        // Program control ops.
+        case cbOps_Goto:
+            Processor->InstructionPointer += (Instruction->Out - 1) * sizeof(cbRegInstruction);
+            break;
+        case cbOps_Halt:
+            Processor->Halted = true;
+            break;
+        
+        // Memory control
+        case cbOps_StoreToSlot:
+            *cbStep_GetOperand(Processor, Instruction->Out) = *cbStep_GetOperand(Processor, Instruction->A);
+            break;
+        case cbOps_AddStack:
+            Error = cbStep_GrowStack(Processor, Instruction->Out);
+            break;
+        
+        // Input control (i.e. interrupts, unless the input was given up front); the result is posted into the out operand
+        case cbOps_Pause:
+            Processor->InterruptState = cbInterrupt_Pause;
+            break;
+        case cbOps_Input:
+        case cbOps_GetKey:
+        {
+            cbInterrupt Interrupt = (Instruction->Op == cbOps_Input) ? cbInterrupt_Input : cbInterrupt_GetKey;
+            if(!cbStep_TakeInput(Processor, Interrupt, cbStep_GetOperand(Processor, Instruction->Out)))
+                Processor->InterruptState = Interrupt;
+            break;
+        }
+        case cbOps_Wait:
+            Error = cbStep_WaitFor(Processor, cbStep_GetOperand(Processor, Instruction->A));
+            break;
+        
+        // Output control
+        case cbOps_Disp:
+            Error = cbStep_DispVariable(Processor, cbStep_GetOperand(Processor, Instruction->A));
+            break;
+        case cbOps_Output:
+            Error = cbStep_OutputPixel(Processor, cbStep_GetOperand(Processor, Instruction->A), cbStep_GetOperand(Processor, Instruction->B), cbStep_GetOperand(Processor, Instruction->Out));
+            break;
+        case cbOps_Clear:
+            Error = cbStep_Clear(Processor, NULL);
+            break;
+        case cbOps_Flip:
+            Error = cbStep_Flip(Processor, NULL);
+            break;
+        
+        // Nop: Does nothing except stalls a cycle; exec and return are no-ops too
+        case cbOps_Exec:
+        case cbOps_Return:
         case cbOps_Nop:
-            Processor->LineIndex = Instruction->Arg;
             break;
         
         // Keywords that are not to become operators
@@ -152,82 +589,1561 @@ cbError cbStep(cbVirtualMachine* Processor, cbInterrupt* InterruptState)
             break;
     }
     
-    // Grow tick count and instruction pointer
-    Processor->Ticks++;
-    Processor->InstructionPointer += sizeof(cbInstruction);
+    return Error;
+}
+
+// Returns the error runs fail with while the given requests are posted, or none if they only hold the processor
+static cbError cbStep_GetRequestError(unsigned int Requests)
+{
+    if(Requests & cbRequest_Stop)
+        return cbError_Stopped;
+    else if(Requests & cbRequest_Mismatch)
+        return cbError_WrongOutput;
+    return cbError_None;
+}
+
+// Ticks run between looks at the clock, while there is a deadline
+static const size_t cbRun_DeadlineTicks = 65536;
+
+// Returns true once the program used up its ticks, or ran past its deadline (see cbStep_SetTimeLimit); the
+// clock is only looked at if asked to, since reading it costs far more than a step
+static bool cbStep_IsOverLimit(cbVirtualMachine* Processor, bool IsClockRead)
+{
+    if(Processor->TickLimit != 0 && Processor->Ticks >= Processor->TickLimit)
+        return true;
+    return IsClockRead && Processor->Deadline != 0 && cbUtil_GetTime() >= Processor->Deadline;
+}
+
+cbError cbStep(cbVirtualMachine* Processor, cbInterrupt* InterruptState)
+{
+    // Ignore if null
+    if(Processor == NULL)
+        return cbError_Null;
+    
+    // If proc. is halted, return halt state (not an error, just finalized)
+    if(Processor->Halted)
+        return cbError_Halted;
+    
+    // Out of time, for good; as with runs, the clock is only looked at every so many ticks
+    if(cbStep_IsOverLimit(Processor, Processor->Ticks % cbRun_DeadlineTicks == 0))
+        return cbError_TimeLimit;
+    
+    // Held by a request, or interrupted and waiting for user input, unless the input provider has it;
+    // no ticks go by meanwhile, so a wait past the deadline is caught by looking at the clock each time
+    unsigned int Requests = __cbAtomicLoad(Processor->Request);
+    if(Requests != cbRequest_None || !cbStep_PollInput(Processor))
+    {
+        *InterruptState = Processor->InterruptState;
+        if(Requests == cbRequest_None && cbStep_IsOverLimit(Processor, true))
+            return cbError_TimeLimit;
+        return cbStep_GetRequestError(Requests);
+    }
+    
+    // Instruction pointer bounds check (must be within the code segment)
+    if(Processor->InstructionPointer >= Processor->DataPointer)
+        return cbError_Overflow;
+    
+    // Load and execute the instruction, in whichever code format we were compiled to
+    cbError Error = cbError_None;
+    if(Processor->Options & cbOption_RegisterMachine)
+    {
+        Error = cbStep_ExecuteRegister(Processor, (cbRegInstruction*)((char*)Processor->Memory + Processor->InstructionPointer));
+        Processor->InstructionPointer += sizeof(cbRegInstruction);
+    }
+    else
+    {
+        Error = cbStep_Execute(Processor, (cbInstruction*)((char*)Processor->Memory + Processor->InstructionPointer));
+        Processor->InstructionPointer += sizeof(cbInstruction);
+    }
+    
+    // Grow tick count
+    Processor->Ticks++;
+    
+    // Post interrupt (if any), and any output the host should see by now
+    *InterruptState = Processor->InterruptState;
+    cbStep_FlushOnState(Processor, Error);
+    
+    // All done!
+    return Error;
+}
+
+// Register machine engine: same semantics as cbRun_Switch, on three-address register code
+static cbError cbRun_Register(cbVirtualMachine* Processor, size_t MaxTicks)
+{
+    cbError Error = cbError_None;
+    
+    // Keep executing until we run out of ticks, halt, are interrupted, or fail
+    for(size_t TicksLeft = MaxTicks; TicksLeft > 0; TicksLeft--)
+    {
+        // Instruction pointer bounds check (must be within the code segment)
+        if(Processor->InstructionPointer >= Processor->DataPointer)
+        {
+            Error = cbError_Overflow;
+            break;
+        }
+        
+        // Load and execute the instruction
+        size_t Origin = Processor->InstructionPointer;
+        cbRegInstruction* Instruction = (cbRegInstruction*)((char*)Processor->Memory + Origin);
+        Error = cbStep_ExecuteRegister(Processor, Instruction);
+        
+        // Grow tick count and instruction pointer
+        Processor->Ticks++;
+        Processor->InstructionPointer += sizeof(cbRegInstruction);
+        
+        // Stop on any change of state, or a request seen on a jump back
+        if(Error != cbError_None || Processor->Halted || Processor->InterruptState != cbInterrupt_None)
+            break;
+        if(Processor->InstructionPointer <= Origin && __cbAtomicLoad(Processor->Request) != cbRequest_None)
+            break;
+    }
+    
+    return Error;
+}
+
+#ifndef __cbTHREADED_DISPATCH__
+
+// Switch-based dispatch engine: executes up to MaxTicks instructions, one shared dispatch branch per
+// instruction; this is the portable reference engine, and the same switch is always used by cbStep
+static cbError cbRun_Switch(cbVirtualMachine* Processor, size_t MaxTicks)
+{
+    cbError Error = cbError_None;
+    
+    // Keep executing until we run out of ticks, halt, are interrupted, or fail
+    // Note that the halt and interrupt states are only ever changed by instructions, never from the outside;
+    // requests are, so they are looked for on every jump back (which every loop takes)
+    for(size_t TicksLeft = MaxTicks; TicksLeft > 0; TicksLeft--)
+    {
+        // Instruction pointer bounds check (must be within the code segment)
+        if(Processor->InstructionPointer >= Processor->DataPointer)
+        {
+            Error = cbError_Overflow;
+            break;
+        }
+        
+        // Load and execute the instruction
+        size_t Origin = Processor->InstructionPointer;
+        cbInstruction* Instruction = (cbInstruction*)((char*)Processor->Memory + Origin);
+        Error = cbStep_Execute(Processor, Instruction);
+        
+        // Grow tick count and instruction pointer
+        Processor->Ticks++;
+        Processor->InstructionPointer += sizeof(cbInstruction);
+        
+        // Stop on any change of state, or a request seen on a jump back
+        if(Error != cbError_None || Processor->Halted || Processor->InterruptState != cbInterrupt_None)
+            break;
+        if(Processor->InstructionPointer <= Origin && __cbAtomicLoad(Processor->Request) != cbRequest_None)
+            break;
+    }
+    
+    return Error;
+}
+
+#else
+
+// Threaded handler table layout: one handler per op in cbOps order, the end-of-code sentinel, then
+// the fused op handlers, specialized per inner op (math ops add to mod, comparisons eq to lesseq)
+// The same layout is then repeated with the handlers to use while the top of the stack is cached
+#define __cbHANDLER_ENDOFCODE__ (cbOpsCount)
+#define __cbHANDLER_SETMATH__   (cbOpsCount + 1)
+#define __cbHANDLER_IFCOMP__    (cbOpsCount + 1 + (cbOps_Mod - cbOps_Add + 1))
+#define __cbHANDLER_CACHED__    (__cbHANDLER_IFCOMP__ + (cbOps_LessEq - cbOps_Eq + 1))
+
+// Direct-threaded dispatch engine: same semantics as cbRun_Switch, but runs on the pre-decoded code
+// where each handler jumps straight into the next instruction's handler (labels-as-values), so every
+// op has its own indirect branch. If HandlerTable is given, only the handler table is posted
+// The top of the stack is cached in a local across instructions (stack caching): which handler
+// runs tells whether it is cached, so there are no run-time checks. Math and comparisons leave
+// their result cached, and the next push or an op without a cached variant writes it back
+static cbError cbRun_Threaded(cbVirtualMachine* Processor, size_t MaxTicks, const void* const** HandlerTable)
+{
+    // Handler of each op, in the exact order of the cbOps enumeration, followed by the end-of-code
+    // sentinel and the specialized fused ops (the plain fused ops are always rebound while decoding)
+    static const void* const DispatchTable[] =
+    {
+        &&Op_If, &&Op_Unknown, &&Op_Unknown, &&Op_Unknown, &&Op_Unknown, &&Op_Unknown,
+        &&Op_Pause, &&Op_Unknown, &&Op_Goto, &&Op_Nop, &&Op_Nop, &&Op_Halt,
+        &&Op_Input, &&Op_Disp, &&Op_Output, &&Op_Input, &&Op_Clear, &&Op_Draw, &&Op_Draw, &&Op_Draw, &&Op_Flip, &&Op_Wait,
+        &&Op_Unknown, &&Op_Unknown,
+        &&Op_Add, &&Op_Sub, &&Op_Mul, &&Op_Div, &&Op_Mod,
+        &&Op_Eq, &&Op_NotEq, &&Op_Greater, &&Op_GreaterEq, &&Op_Less, &&Op_LessEq,
+        &&Op_Logic, &&Op_Logic, &&Op_Logic,
+        &&Op_Load, &&Op_Load, &&Op_StoreToSlot, &&Op_AddStack,
+        &&Op_AddInt, &&Op_SubInt, &&Op_MulInt, &&Op_DivInt, &&Op_ModInt,
+        &&Op_EqInt, &&Op_NotEqInt, &&Op_GreaterInt, &&Op_GreaterEqInt, &&Op_LessInt, &&Op_LessEqInt,
+        &&Op_Unknown, &&Op_Unknown,
+        &&Op_Nop,
+        &&Exit_Overflow,
+        &&Op_SetAdd, &&Op_SetSub, &&Op_SetMul, &&Op_SetDiv, &&Op_SetMod,
+        &&Op_IfEq, &&Op_IfNotEq, &&Op_IfGreater, &&Op_IfGreaterEq, &&Op_IfLess, &&Op_IfLessEq,
+        
+        // Cached top of the stack: ops without their own variant write the top back first
+        &&Op_IfCached, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush,
+        &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush,
+        &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush,
+        &&Op_Flush, &&Op_Flush,
+        &&Op_AddCached, &&Op_SubCached, &&Op_MulCached, &&Op_DivCached, &&Op_ModCached,
+        &&Op_EqCached, &&Op_NotEqCached, &&Op_GreaterCached, &&Op_GreaterEqCached, &&Op_LessCached, &&Op_LessEqCached,
+        &&Op_Flush, &&Op_Flush, &&Op_Flush,
+        &&Op_LoadCached, &&Op_LoadCached, &&Op_StoreToSlotCached, &&Op_Flush,
+        &&Op_AddIntCached, &&Op_SubIntCached, &&Op_MulIntCached, &&Op_DivIntCached, &&Op_ModIntCached,
+        &&Op_EqIntCached, &&Op_NotEqIntCached, &&Op_GreaterIntCached, &&Op_GreaterEqIntCached, &&Op_LessIntCached, &&Op_LessEqIntCached,
+        &&Op_Flush, &&Op_Flush,
+        &&Op_NopCached,
+        &&Op_Flush,
+        &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush,
+        &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush, &&Op_Flush,
+    };
+    
+    // Only asked for the handlers (while decoding)
+    if(HandlerTable != NULL)
+    {
+        *HandlerTable = DispatchTable;
+        return cbError_None;
+    }
+    
+    // Keep the hot registers in locals, only written back on exit or around helper calls
+    char* Memory = (char*)Processor->Memory;
+    size_t StackPointer = Processor->StackPointer;
+    size_t StackBasePointer = Processor->StackBasePointer;
+    size_t HeapPointer = Processor->HeapPointer;
+    size_t Ticks = Processor->Ticks;
+    size_t TicksLeft = MaxTicks;
+    cbDecodedInstruction* Code = Processor->DecodedCode;
+    cbError Error = cbError_None;
+    
+    // The cached top of the stack (the variable at the stack pointer), only valid in the cached handlers
+    cbVariable Top;
+    
+    // Anything past the code segment lands on the end-of-code sentinel
+    size_t InstructionIndex = Processor->InstructionPointer / sizeof(cbInstruction);
+    cbDecodedInstruction* Instruction = Code + ((InstructionIndex < Processor->DecodedCount) ? InstructionIndex : Processor->DecodedCount);
+    
+    // Jump to the instruction's handler; ops were validated and bound while decoding. The
+    // other forms first retire the active instruction, and end every handler; the cached form
+    // lands on the next instruction's cached handler, leaving the top of the stack in Top
+    #define __cbDispatchFirst() \
+        if(TicksLeft == 0) \
+            goto Exit; \
+        goto *Instruction->Handler
+    
+    #define __cbDispatch() \
+        Ticks++; \
+        Instruction++; \
+        TicksLeft--; \
+        __cbDispatchFirst()
+    
+    #define __cbDispatchCached() \
+        Ticks++; \
+        Instruction++; \
+        TicksLeft--; \
+        if(TicksLeft == 0) \
+            goto Exit_Cached; \
+        goto *Instruction->CachedHandler
+    
+    #define __cbJump(Destination) \
+        Ticks++; \
+        Instruction = (Destination); \
+        TicksLeft--; \
+        __cbDispatchFirst()
+    
+    // Stop execution after retiring the active instruction (errors, halts, and interrupts)
+    #define __cbStop(ErrorCode) \
+        { \
+            Error = (ErrorCode); \
+            goto Exit_Retire; \
+        }
+    
+    // The top of the stack in memory; handlers pop either this or the cached top (their source)
+    #define __cbMemoryTop (*(cbVariable*)(Memory + StackPointer))
+    
+    // Call one of the shared cbStep_* helpers, which work off of the processor's own stack pointer
+    #define __cbCallHelper(Helper) \
+        Processor->StackPointer = StackPointer; \
+        Error = Helper(Processor, &Instruction->Raw); \
+        StackPointer = Processor->StackPointer; \
+        if(Error != cbError_None) \
+            goto Exit_Retire
+    
+    // Pop A from the source and replace B with the result of the integer-only math or comparison
+    // expression; the result is left in the cached top
+    #define __cbBinaryOperands(Source) \
+        cbVariable A = (Source); \
+        StackPointer += sizeof(cbVariable); \
+        cbVariable B = __cbMemoryTop
+    
+    #define __cbSetTop(Expression) \
+        Top = (cbVariable){ cbVariableType_Int, { .Int = (Expression) } }
+    
+    #define __cbBinaryOp(Source, Expression) \
+        __cbBinaryOperands(Source); \
+        if(A.Type != cbVariableType_Int || B.Type != cbVariableType_Int) \
+            __cbStop(cbError_TypeMismatch); \
+        __cbSetTop(Expression)
+    
+    // Same as a binary op, for operands proven to be integers: nothing is checked for
+    #define __cbIntOp(Source, Expression) \
+        __cbBinaryOperands(Source); \
+        __cbSetTop(Expression)
+    
+    // Same as a binary or int op for division and modulo (Op), but check against zero before writing out
+    #define __cbDivOp(Source, Op) \
+        __cbBinaryOperands(Source); \
+        if(A.Type != cbVariableType_Int || B.Type != cbVariableType_Int) \
+            __cbStop(cbError_TypeMismatch); \
+        if(A.Data.Int == 0) \
+            __cbStop(cbError_DivZero); \
+        __cbSetTop(B.Data.Int Op A.Data.Int)
+    
+    #define __cbIntDivOp(Source, Op) \
+        __cbBinaryOperands(Source); \
+        if(A.Data.Int == 0) \
+            __cbStop(cbError_DivZero); \
+        __cbSetTop(B.Data.Int Op A.Data.Int)
+    
+    // Pop A from the source and jump to the target if false; int, float, and bool are accepted
+    #define __cbIf(Source) \
+        cbVariable A = (Source); \
+        StackPointer += sizeof(cbVariable); \
+        if(A.Type != cbVariableType_Int && A.Type != cbVariableType_Float && A.Type != cbVariableType_Bool) \
+            __cbStop(cbError_TypeMismatch); \
+        if((A.Type == cbVariableType_Int && A.Data.Int == 0) || \
+           (A.Type == cbVariableType_Float && A.Data.Float == 0) || \
+           (A.Type == cbVariableType_Bool && A.Data.Bool == 0)) \
+        { \
+            __cbJump(Instruction->Operand.Target); \
+        } \
+        __cbDispatch()
+    
+    // Pop the value from the source into the (decoded) variable
+    #define __cbStore(Source) \
+        *Instruction->Operand.Data = (Source); \
+        StackPointer += sizeof(cbVariable); \
+        __cbDispatch()
+    
+    // Fused ops: B is the variable (arg) and A the literal; set-math writes the integer-only result
+    // into B, while if-comp jumps to the trailing if's target when false. Both skip their operand slots
+    #define __cbFusedOperands() \
+        cbVariable* A = Instruction->Operand.Data; \
+        cbVariable* B = (cbVariable*)(Memory + StackBasePointer + Instruction->Raw.Arg); \
+        if(A->Type != cbVariableType_Int || B->Type != cbVariableType_Int) \
+            __cbStop(cbError_TypeMismatch)
+    
+    #define __cbSetMath(Expression) \
+        __cbFusedOperands(); \
+        B->Data.Int = (Expression); \
+        Instruction += 1; \
+        __cbDispatch()
+    
+    #define __cbIfComp(Expression) \
+        __cbFusedOperands(); \
+        if(!(Expression)) \
+        { \
+            __cbJump(Instruction[2].Operand.Target); \
+        } \
+        Instruction += 2; \
+        __cbDispatch()
+    
+    // Start execution
+    __cbDispatchFirst();
+    
+    /*** Program Control ***/
+    
+    Op_If:
+    {
+        __cbIf(__cbMemoryTop);
+    }
+    Op_Goto:
+    {
+        // Loops close with a jump back, where a posted request ends the run once the jump is taken
+        if(Instruction->Operand.Target <= Instruction && __cbAtomicLoad(Processor->Request) != cbRequest_None)
+            TicksLeft = 1;
+        __cbJump(Instruction->Operand.Target);
+    }
+    Op_Halt:
+    {
+        Processor->Halted = true;
+        __cbStop(cbError_None);
+    }
+    Op_Nop:
+    {
+        // Exec and return land here too: as with cbStep, they do nothing
+        __cbDispatch();
+    }
+    Op_Unknown:
+    {
+        __cbStop(cbError_UnknownOp);
+    }
+    
+    /*** Math and Comparison ***/
+    
+    Op_Add:
+    {
+        __cbBinaryOp(__cbMemoryTop, B.Data.Int + A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_Sub:
+    {
+        __cbBinaryOp(__cbMemoryTop, B.Data.Int - A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_Mul:
+    {
+        __cbBinaryOp(__cbMemoryTop, B.Data.Int * A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_Div:
+    {
+        __cbDivOp(__cbMemoryTop, /);
+        __cbDispatchCached();
+    }
+    Op_Mod:
+    {
+        __cbDivOp(__cbMemoryTop, %);
+        __cbDispatchCached();
+    }
+    Op_Eq:
+    {
+        __cbBinaryOp(__cbMemoryTop, B.Data.Int == A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_NotEq:
+    {
+        __cbBinaryOp(__cbMemoryTop, B.Data.Int != A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_Greater:
+    {
+        __cbBinaryOp(__cbMemoryTop, B.Data.Int > A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_GreaterEq:
+    {
+        __cbBinaryOp(__cbMemoryTop, B.Data.Int >= A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_Less:
+    {
+        __cbBinaryOp(__cbMemoryTop, B.Data.Int < A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_LessEq:
+    {
+        __cbBinaryOp(__cbMemoryTop, B.Data.Int <= A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_Logic:
+    {
+        __cbCallHelper(cbStep_LogicOp);
+        __cbDispatch();
+    }
+    
+    /*** Type-Specialized Math and Comparison ***/
+    
+    Op_AddInt:
+    {
+        __cbIntOp(__cbMemoryTop, B.Data.Int + A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_SubInt:
+    {
+        __cbIntOp(__cbMemoryTop, B.Data.Int - A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_MulInt:
+    {
+        __cbIntOp(__cbMemoryTop, B.Data.Int * A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_DivInt:
+    {
+        __cbIntDivOp(__cbMemoryTop, /);
+        __cbDispatchCached();
+    }
+    Op_ModInt:
+    {
+        __cbIntDivOp(__cbMemoryTop, %);
+        __cbDispatchCached();
+    }
+    Op_EqInt:
+    {
+        __cbIntOp(__cbMemoryTop, B.Data.Int == A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_NotEqInt:
+    {
+        __cbIntOp(__cbMemoryTop, B.Data.Int != A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_GreaterInt:
+    {
+        __cbIntOp(__cbMemoryTop, B.Data.Int > A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_GreaterEqInt:
+    {
+        __cbIntOp(__cbMemoryTop, B.Data.Int >= A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_LessInt:
+    {
+        __cbIntOp(__cbMemoryTop, B.Data.Int < A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_LessEqInt:
+    {
+        __cbIntOp(__cbMemoryTop, B.Data.Int <= A.Data.Int);
+        __cbDispatchCached();
+    }
+    
+    /*** Fused Ops ***/
+    
+    Op_SetAdd:
+    {
+        __cbSetMath(B->Data.Int + A->Data.Int);
+    }
+    Op_SetSub:
+    {
+        __cbSetMath(B->Data.Int - A->Data.Int);
+    }
+    Op_SetMul:
+    {
+        __cbSetMath(B->Data.Int * A->Data.Int);
+    }
+    Op_SetDiv:
+    {
+        __cbFusedOperands();
+        if(A->Data.Int == 0)
+            __cbStop(cbError_DivZero);
+        B->Data.Int = B->Data.Int / A->Data.Int;
+        Instruction += 1;
+        __cbDispatch();
+    }
+    Op_SetMod:
+    {
+        __cbFusedOperands();
+        if(A->Data.Int == 0)
+            __cbStop(cbError_DivZero);
+        B->Data.Int = B->Data.Int % A->Data.Int;
+        Instruction += 1;
+        __cbDispatch();
+    }
+    Op_IfEq:
+    {
+        __cbIfComp(B->Data.Int == A->Data.Int);
+    }
+    Op_IfNotEq:
+    {
+        __cbIfComp(B->Data.Int != A->Data.Int);
+    }
+    Op_IfGreater:
+    {
+        __cbIfComp(B->Data.Int > A->Data.Int);
+    }
+    Op_IfGreaterEq:
+    {
+        __cbIfComp(B->Data.Int >= A->Data.Int);
+    }
+    Op_IfLess:
+    {
+        __cbIfComp(B->Data.Int < A->Data.Int);
+    }
+    Op_IfLessEq:
+    {
+        __cbIfComp(B->Data.Int <= A->Data.Int);
+    }
+    
+    /*** Memory Control ***/
+    
+    Op_StoreToSlot:
+    {
+        __cbStore(__cbMemoryTop);
+    }
+    
+    // Loads of literals and variable values both copy their decoded variable, leaving the new top
+    // cached; with one already cached, it is written back first
+    Op_LoadCached:
+    {
+        __cbMemoryTop = Top;
+    }
+    Op_Load:
+    {
+        StackPointer -= sizeof(cbVariable);
+        if(StackPointer < HeapPointer)
+            __cbStop(cbError_Overflow);
+        Top = *Instruction->Operand.Data;
+        __cbDispatchCached();
+    }
+    Op_AddStack:
+    {
+        // Grow stack up (positive) or down (negative), with bounds check, zeroing out new space
+        StackPointer += Instruction->Raw.Arg;
+        if(StackPointer >= Processor->MemorySize && Instruction->Raw.Arg > 0)
+            __cbStop(cbError_Overflow);
+        if(StackPointer < HeapPointer && Instruction->Raw.Arg < 0)
+            __cbStop(cbError_Overflow);
+        if(Instruction->Raw.Arg < 0)
+            memset(Memory + StackPointer, 0, -(Instruction->Raw.Arg));
+        __cbDispatch();
+    }
+    
+    /*** Input and Output ***/
+    
+    Op_Pause:
+    {
+        Processor->InterruptState = cbInterrupt_Pause;
+        __cbStop(cbError_None);
+    }
+    Op_Input:
+    {
+        __cbCallHelper(cbStep_Input);
+        if(Processor->InterruptState != cbInterrupt_None)
+            __cbStop(cbError_None);
+        __cbDispatch();
+    }
+    Op_Wait:
+    {
+        __cbCallHelper(cbStep_Wait);
+        __cbStop(cbError_None);
+    }
+    Op_Disp:
+    {
+        __cbCallHelper(cbStep_Disp);
+        __cbDispatch();
+    }
+    Op_Output:
+    {
+        __cbCallHelper(cbStep_Output);
+        __cbDispatch();
+    }
+    Op_Clear:
+    {
+        __cbCallHelper(cbStep_Clear);
+        __cbDispatch();
+    }
+    Op_Draw:
+    {
+        __cbCallHelper(cbStep_Draw);
+        __cbDispatch();
+    }
+    Op_Flip:
+    {
+        __cbCallHelper(cbStep_Flip);
+        __cbDispatch();
+    }
+    
+    /*** Cached Top of the Stack ***/
+    
+    // Write the cached top back, then run the op's regular handler (the instruction is not retired)
+    Op_Flush:
+    {
+        __cbMemoryTop = Top;
+        goto *Instruction->Handler;
+    }
+    Op_NopCached:
+    {
+        __cbDispatchCached();
+    }
+    Op_IfCached:
+    {
+        __cbIf(Top);
+    }
+    Op_StoreToSlotCached:
+    {
+        __cbStore(Top);
+    }
+    Op_AddCached:
+    {
+        __cbBinaryOp(Top, B.Data.Int + A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_SubCached:
+    {
+        __cbBinaryOp(Top, B.Data.Int - A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_MulCached:
+    {
+        __cbBinaryOp(Top, B.Data.Int * A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_DivCached:
+    {
+        __cbDivOp(Top, /);
+        __cbDispatchCached();
+    }
+    Op_ModCached:
+    {
+        __cbDivOp(Top, %);
+        __cbDispatchCached();
+    }
+    Op_EqCached:
+    {
+        __cbBinaryOp(Top, B.Data.Int == A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_NotEqCached:
+    {
+        __cbBinaryOp(Top, B.Data.Int != A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_GreaterCached:
+    {
+        __cbBinaryOp(Top, B.Data.Int > A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_GreaterEqCached:
+    {
+        __cbBinaryOp(Top, B.Data.Int >= A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_LessCached:
+    {
+        __cbBinaryOp(Top, B.Data.Int < A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_LessEqCached:
+    {
+        __cbBinaryOp(Top, B.Data.Int <= A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_AddIntCached:
+    {
+        __cbIntOp(Top, B.Data.Int + A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_SubIntCached:
+    {
+        __cbIntOp(Top, B.Data.Int - A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_MulIntCached:
+    {
+        __cbIntOp(Top, B.Data.Int * A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_DivIntCached:
+    {
+        __cbIntDivOp(Top, /);
+        __cbDispatchCached();
+    }
+    Op_ModIntCached:
+    {
+        __cbIntDivOp(Top, %);
+        __cbDispatchCached();
+    }
+    Op_EqIntCached:
+    {
+        __cbIntOp(Top, B.Data.Int == A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_NotEqIntCached:
+    {
+        __cbIntOp(Top, B.Data.Int != A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_GreaterIntCached:
+    {
+        __cbIntOp(Top, B.Data.Int > A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_GreaterEqIntCached:
+    {
+        __cbIntOp(Top, B.Data.Int >= A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_LessIntCached:
+    {
+        __cbIntOp(Top, B.Data.Int < A.Data.Int);
+        __cbDispatchCached();
+    }
+    Op_LessEqIntCached:
+    {
+        __cbIntOp(Top, B.Data.Int <= A.Data.Int);
+        __cbDispatchCached();
+    }
+    
+    /*** Exit Paths ***/
+    
+    // Ran off the code segment (the sentinel is never retired, just like a failed bounds check)
+    Exit_Overflow:
+    Error = cbError_Overflow;
+    goto Exit;
+    
+    // Ran out of ticks with the top of the stack cached: write it back
+    Exit_Cached:
+    __cbMemoryTop = Top;
+    goto Exit;
+    
+    // Retire the active instruction, then write back all registers
+    Exit_Retire:
+    Ticks++;
+    Instruction++;
+    
+    Exit:
+    Processor->StackPointer = StackPointer;
+    Processor->Ticks = Ticks;
+    Processor->InstructionPointer = (Instruction - Code) * sizeof(cbInstruction);
+    return Error;
+    
+    #undef __cbDispatchFirst
+    #undef __cbDispatch
+    #undef __cbDispatchCached
+    #undef __cbJump
+    #undef __cbStop
+    #undef __cbMemoryTop
+    #undef __cbCallHelper
+    #undef __cbBinaryOperands
+    #undef __cbSetTop
+    #undef __cbBinaryOp
+    #undef __cbIntOp
+    #undef __cbDivOp
+    #undef __cbIntDivOp
+    #undef __cbIf
+    #undef __cbStore
+    #undef __cbFusedOperands
+    #undef __cbSetMath
+    #undef __cbIfComp
+}
+
+#endif
+
+// Run up to MaxTicks instructions on whichever engine fits the processor
+static cbError cbRun_Engine(cbVirtualMachine* Processor, size_t MaxTicks)
+{
+    // Register machine code has its own engine; stack code runs as native code if enabled and
+    // supported (falling back for good otherwise), else on the build's dispatch engine
+    if(Processor->Options & cbOption_RegisterMachine)
+        return cbRun_Register(Processor, MaxTicks);
+    else if((Processor->Options & cbOption_Jit) && (Processor->JitProgram != NULL || cbJit_Compile(Processor)))
+        return cbJit_Run(Processor, MaxTicks);
+    
+    Processor->Options &= ~cbOption_Jit;
+    #ifdef __cbTHREADED_DISPATCH__
+        // Make sure we have the pre-decoded program to work with
+        if(Processor->DecodedCode == NULL)
+        {
+            cbError DecodeError = cbStep_Decode(Processor);
+            if(DecodeError != cbError_None)
+                return DecodeError;
+        }
+        return cbRun_Threaded(Processor, MaxTicks, NULL);
+    #else
+        return cbRun_Switch(Processor, MaxTicks);
+    #endif
+}
+
+cbError cbRun(cbVirtualMachine* Processor, size_t MaxTicks, cbInterrupt* InterruptState)
+{
+    // Ignore if null
+    if(Processor == NULL)
+        return cbError_Null;
+    
+    // If proc. is halted, return halt state (not an error, just finalized)
+    if(Processor->Halted)
+        return cbError_Halted;
+    
+    // Out of time, for good
+    *InterruptState = Processor->InterruptState;
+    if(cbStep_IsOverLimit(Processor, true))
+        return cbError_TimeLimit;
+    
+    // Held by a request, or interrupted and still waiting for user input, unless the input provider has it
+    unsigned int Requests = __cbAtomicLoad(Processor->Request);
+    if(Requests != cbRequest_None || !cbStep_PollInput(Processor))
+        return cbStep_GetRequestError(Requests);
+    
+    // The tick limit only ever shortens the run, so the engines' own tick count enforces it for free
+    if(Processor->TickLimit != 0 && MaxTicks > Processor->TickLimit - Processor->Ticks)
+        MaxTicks = Processor->TickLimit - Processor->Ticks;
+    
+    // With a deadline, run in slices, looking at the clock only in between; a slice
+    // cut short by the program (or a request) ends the run as usual
+    size_t SliceTicks = (Processor->Deadline != 0) ? cbRun_DeadlineTicks : MaxTicks;
+    cbError Error = cbError_None;
+    while(MaxTicks > 0 && Error == cbError_None)
+    {
+        size_t Ticks = (MaxTicks < SliceTicks) ? MaxTicks : SliceTicks;
+        size_t Start = Processor->Ticks;
+        Error = cbRun_Engine(Processor, Ticks);
+        if(Processor->Ticks - Start < Ticks || Processor->Halted || Processor->InterruptState != cbInterrupt_None)
+            break;
+        if(__cbAtomicLoad(Processor->Request) != cbRequest_None || (Processor->Deadline != 0 && cbUtil_GetTime() >= Processor->Deadline))
+            break;
+        MaxTicks -= Ticks;
+    }
+    
+    // A stop (or a mismatch) cut the run short, so report it right away; likewise once out of time, unless the
+    // program was interrupted on its last tick: the interrupt is reported first, and the limit on the next run
+    if(Error == cbError_None)
+        Error = cbStep_GetRequestError(__cbAtomicLoad(Processor->Request));
+    if(Error == cbError_None && !Processor->Halted && Processor->InterruptState == cbInterrupt_None && cbStep_IsOverLimit(Processor, true))
+        Error = cbError_TimeLimit;
+    
+    // Post interrupt (if any), and any output the host should see by now
+    *InterruptState = Processor->InterruptState;
+    cbStep_FlushOnState(Processor, Error);
+    
+    // Report a halt right away, rather than on the next run
+    if(Error == cbError_None && Processor->Halted)
+        return cbError_Halted;
+    
+    // All done!
+    return Error;
+}
+
+void cbStep_PostRequest(cbVirtualMachine* Processor, unsigned int Requests)
+{
+    if(Processor != NULL)
+        __cbAtomicOr(Processor->Request, Requests);
+}
+
+unsigned int cbStep_TakeRequests(cbVirtualMachine* Processor, unsigned int Requests)
+{
+    if(Processor == NULL)
+        return cbRequest_None;
+    return __cbAtomicAnd(Processor->Request, ~Requests) & Requests;
+}
+
+cbError cbStep_ExecuteInstruction(cbVirtualMachine* Processor, cbInstruction* Instruction)
+{
+    return cbStep_Execute(Processor, Instruction);
+}
+
+cbError cbStep_Decode(cbVirtualMachine* Processor)
+{
+    // Ignore if null
+    if(Processor == NULL)
+        return cbError_Null;
+    
+    // Release any previous decoding, and native code (rebuilt on the next run)
+    cbJit_Release(Processor);
+    free(Processor->DecodedCode);
+    Processor->DecodedCode = NULL;
+    Processor->DecodedCount = 0;
+    
+    // Register machine code is executed as-is
+    if(Processor->Options & cbOption_RegisterMachine)
+        return cbError_None;
+    
+    // Allocate one decoded instruction per instruction, plus the end-of-code sentinel
+    size_t InstructionCount = Processor->DataPointer / sizeof(cbInstruction);
+    cbDecodedInstruction* Code = malloc((InstructionCount + 1) * sizeof(cbDecodedInstruction));
+    if(Code == NULL)
+        return cbError_Overflow;
+    
+    // Handlers are only needed by the threaded dispatch engine
+    const void* const* HandlerTable = NULL;
+    #ifdef __cbTHREADED_DISPATCH__
+        cbRun_Threaded(Processor, 0, &HandlerTable);
+    #endif
+    
+    // For each instruction
+    for(size_t i = 0; i < InstructionCount; i++)
+    {
+        cbInstruction* Instruction = (cbInstruction*)Processor->Memory + i;
+        cbDecodedInstruction* Decoded = Code + i;
+        Decoded->Raw = *Instruction;
+        Decoded->Operand.Target = NULL;
+        
+        // Ops are never checked at run-time, so reject the program now
+        if((unsigned int)Instruction->Op >= (unsigned int)cbOpsCount)
+        {
+            free(Code);
+            return cbError_UnknownOp;
+        }
+        
+        // Handler of the op (threaded dispatch only)
+        #ifdef __cbTHREADED_DISPATCH__
+            size_t HandlerIndex = Instruction->Op;
+        #endif
+        
+        // Jumps are relative instruction counts; anything out of the code lands on the sentinel
+        if(Instruction->Op == cbOps_If || Instruction->Op == cbOps_Goto)
+        {
+            long Destination = (long)i + Instruction->Arg;
+            if(Destination < 0 || Destination > (long)InstructionCount)
+                Destination = InstructionCount;
+            Decoded->Operand.Target = Code + Destination;
+        }
+        
+        // Data offsets are relative to the data pointer, and must be within the static data
+        // Fused ops take theirs from the operand slot, which must hold the kind of op they fuse
+        else if(Instruction->Op == cbOps_LoadData || Instruction->Op == cbOps_SetMath || Instruction->Op == cbOps_IfComp)
+        {
+            cbInstruction* Operand = Instruction;
+            if(Instruction->Op != cbOps_LoadData)
+            {
+                if(i + cbUtil_GetOperandSlots(Instruction->Op) >= InstructionCount)
+                {
+                    free(Code);
+                    return cbError_Overflow;
+                }
+                
+                Operand = Instruction + 1;
+                bool IsMath = Operand->Op >= cbOps_Add && Operand->Op <= cbOps_Mod;
+                bool IsComp = Operand->Op >= cbOps_Eq && Operand->Op <= cbOps_LessEq;
+                if((Instruction->Op == cbOps_SetMath && !IsMath) || (Instruction->Op == cbOps_IfComp && (!IsComp || Instruction[2].Op != cbOps_If)))
+                {
+                    free(Code);
+                    return cbError_UnknownOp;
+                }
+                
+                // Bind the handler specialized for the inner op
+                #ifdef __cbTHREADED_DISPATCH__
+                    if(Instruction->Op == cbOps_SetMath)
+                        HandlerIndex = __cbHANDLER_SETMATH__ + Operand->Op - cbOps_Add;
+                    else
+                        HandlerIndex = __cbHANDLER_IFCOMP__ + Operand->Op - cbOps_Eq;
+                #endif
+            }
+            
+            if(Operand->Arg < 0 || Processor->DataPointer + Operand->Arg + sizeof(cbVariable) > Processor->HeapPointer)
+            {
+                free(Code);
+                return cbError_Overflow;
+            }
+            Decoded->Operand.Data = (cbVariable*)((char*)Processor->Memory + Processor->DataPointer + Operand->Arg);
+        }
+        
+        // Variable slots are relative to the stack base, and must be within the stack
+        else if(Instruction->Op == cbOps_LoadValue || Instruction->Op == cbOps_StoreToSlot)
+        {
+            if(Instruction->Arg >= 0 || (size_t)-(long)Instruction->Arg > Processor->StackBasePointer - Processor->HeapPointer)
+            {
+                free(Code);
+                return cbError_Overflow;
+            }
+            Decoded->Operand.Data = (cbVariable*)((char*)Processor->Memory + Processor->StackBasePointer + Instruction->Arg);
+        }
+
+        // Bind the handlers, for both states of the top of the stack
+        #ifdef __cbTHREADED_DISPATCH__
+            Decoded->Handler = HandlerTable[HandlerIndex];
+            Decoded->CachedHandler = HandlerTable[__cbHANDLER_CACHED__ + HandlerIndex];
+        #else
+            Decoded->Handler = NULL;
+            Decoded->CachedHandler = NULL;
+        #endif
+    }
+    
+    // The end-of-code sentinel
+    Code[InstructionCount].Raw.Op = cbOps_Halt;
+    Code[InstructionCount].Raw.Arg = 0;
+    #ifdef __cbTHREADED_DISPATCH__
+        Code[InstructionCount].Handler = HandlerTable[__cbHANDLER_ENDOFCODE__];
+        Code[InstructionCount].CachedHandler = HandlerTable[__cbHANDLER_CACHED__ + __cbHANDLER_ENDOFCODE__];
+    #else
+        Code[InstructionCount].Handler = NULL;
+        Code[InstructionCount].CachedHandler = NULL;
+    #endif
+    Code[InstructionCount].Operand.Target = NULL;
+    
+    // Save into the processor
+    Processor->DecodedCode = Code;
+    Processor->DecodedCount = InstructionCount;
+    return cbError_None;
+}
+
+// Post the result of a user input: the stack machine pushes it onto the stack, while register machine
+// code writes it into the out operand of the (already retired) interrupting instruction
+static void cbStep_PostInput(cbVirtualMachine* Processor, cbVariable* UserVar)
+{
+    if(Processor->Options & cbOption_RegisterMachine)
+    {
+        cbRegInstruction* Instruction = (cbRegInstruction*)((char*)Processor->Memory + Processor->InstructionPointer) - 1;
+        *cbStep_GetOperand(Processor, Instruction->Out) = *UserVar;
+    }
+    else
+    {
+        Processor->StackPointer -= sizeof(cbVariable);
+        memcpy(Processor->Memory + Processor->StackPointer, (void*)UserVar, sizeof(cbVariable));
+    }
+}
+
+void cbStep_ReleaseInterrupt(cbVirtualMachine* Processor, const char* UserInput)
+{
+    // Clear interrupt
+    cbInterrupt OldState = Processor->InterruptState;
+    Processor->InterruptState = cbInterrupt_None;
+    
+    // If pause or wait (possibly cut short by the host), just ignore
+    if(OldState == cbInterrupt_Pause || OldState == cbInterrupt_Wait)
+    {
+        return;
+    }
+    // If get key, just return the first index, or 0, on the stack
+    else if(OldState == cbInterrupt_GetKey)
+    {
+        // Turn into integer
+        cbVariable UserVar;
+        UserVar.Type = cbVariableType_Int;
+        UserVar.Data.Int = UserInput[0];
+        cbStep_PostInput(Processor, &UserVar);
+    }
+    // If asking for full line
+    else if(OldState == cbInterrupt_Input)
+    {
+        // Parse for each type
+        cbVariable UserVar;
+        cbStep_ParseInput(UserInput, strlen(UserInput), &UserVar);
+        
+        // Post variable into run-time memory
+        cbStep_PostInput(Processor, &UserVar);
+    }
+}
+
+unsigned long long cbStep_GetWakeTime(cbVirtualMachine* Processor)
+{
+    if(Processor == NULL)
+        return 0;
+    return Processor->WakeTime;
+}
+
+void cbStep_SetTimeLimit(cbVirtualMachine* Processor, size_t MaxTicks, unsigned long long MaxTime)
+{
+    if(Processor == NULL)
+        return;
+    
+    Processor->TickLimit = (MaxTicks > 0) ? Processor->Ticks + MaxTicks : 0;
+    Processor->Deadline = (MaxTime > 0) ? cbUtil_GetTime() + MaxTime : 0;
+}
+
+const unsigned char* const cbStep_GetScreenBuffer(cbVirtualMachine* Processor)
+{
+    // Without a back buffer, the screen is shown as it's drawn
+    unsigned char* Frame = __cbAtomicLoad(Processor->FrontBuffer);
+    if(Frame == NULL)
+        return Processor->ScreenBuffer;
+    
+    // Latch the front buffer, so flip() won't draw into it; it may have been flipped away before the latch was
+    // seen, in which case flip() may already be drawing into it, so latch the new one instead
+    unsigned char* Latched = NULL;
+    while(Latched != Frame)
+    {
+        Latched = Frame;
+        __cbAtomicStore(Processor->LatchedBuffer, Latched);
+        __cbAtomicFence();
+        Frame = __cbAtomicLoad(Processor->FrontBuffer);
+    }
+    return Frame;
+}
+
+size_t cbStep_GetFrameCount(cbVirtualMachine* Processor)
+{
+    if(Processor == NULL)
+        return 0;
+    return __cbAtomicLoad(Processor->FrameCount);
+}
+
+int cbStep_GetScreenPixel(cbVirtualMachine* Processor, size_t X, size_t Y)
+{
+    if(Processor == NULL || X >= Processor->ScreenWidth || Y >= Processor->ScreenHeight)
+        return 0;
+    
+    const unsigned char* Row = cbStep_GetScreenBuffer(Processor) + Processor->ScreenPitch * Y;
+    if(Processor->Options & cbOption_PackedScreen)
+        return (Row[X / 4] >> ((X % 4) * 2)) & 3;
+    else
+        return Row[X];
+}
+
+cbError cbStep_InitSurface(cbSurface* Surface, void* Pixels, ptrdiff_t Pitch, cbSurfaceFormat Format, size_t Scale, const unsigned char Palette[4][4])
+{
+    if(Surface == NULL || Pixels == NULL || Palette == NULL || Scale == 0)
+        return cbError_Null;
+    
+    Surface->Pixels = Pixels;
+    Surface->Pitch = Pitch;
+    Surface->Format = Format;
+    Surface->PixelSize = (Format == cbSurfaceFormat_RGBA32) ? 4 : 1;
+    Surface->Scale = Scale;
+    
+    // Each group of four pixels, left-most in the lowest bits, expands into their palette entries side by side
+    for(int Group = 0; Group < 256; Group++)
+    {
+        unsigned char* Out = Surface->Expansion[Group];
+        for(int i = 0; i < 4; i++, Out += Surface->PixelSize)
+            memcpy(Out, Palette[(Group >> (i * 2)) & 3], Surface->PixelSize);
+    }
+    
+    return cbError_None;
+}
+
+void cbStep_PresentScreen(cbVirtualMachine* Processor, const cbSurface* Surface, const cbScreenRegion* Regions, size_t RegionCount)
+{
+    if(Processor == NULL || Surface == NULL)
+        return;
+    
+    cbScreenRegion Whole = { 0, 0, Processor->ScreenWidth, Processor->ScreenHeight };
+    if(Regions == NULL)
+    {
+        Regions = &Whole;
+        RegionCount = 1;
+    }
+    
+    const unsigned char* Screen = cbStep_GetScreenBuffer(Processor);
+    bool IsPacked = (Processor->Options & cbOption_PackedScreen) != 0;
+    size_t Scale = Surface->Scale, PixelSize = Surface->PixelSize;
+    for(size_t i = 0; i < RegionCount; i++)
+    {
+        // Clip to the screen, starting on a group of four pixels (a packed byte)
+        const cbScreenRegion* Region = &Regions[i];
+        size_t Left = ((Region->X < Processor->ScreenWidth) ? Region->X : Processor->ScreenWidth) & ~(size_t)3;
+        size_t Right = (Region->X + Region->Width < Processor->ScreenWidth) ? Region->X + Region->Width : Processor->ScreenWidth;
+        size_t Bottom = (Region->Y + Region->Height < Processor->ScreenHeight) ? Region->Y + Region->Height : Processor->ScreenHeight;
+        
+        for(size_t Y = Region->Y; Y < Bottom && Left < Right; Y++)
+        {
+            const unsigned char* Row = Screen + Processor->ScreenPitch * Y;
+            unsigned char* First = Surface->Pixels + Surface->Pitch * (ptrdiff_t)(Y * Scale) + Left * Scale * PixelSize;
+            unsigned char* Out = First;
+            for(size_t X = Left; X < Right; X += 4)
+            {
+                // Gather the group's colors into a packed byte, unless they already are
+                size_t Count = (Right - X < 4) ? Right - X : 4;
+                unsigned int Group = 0;
+                if(IsPacked)
+                    Group = Row[X / 4];
+                else if(Count == 4)
+                    Group = (Row[X] & 3) | ((Row[X + 1] & 3) << 2) | ((Row[X + 2] & 3) << 4) | ((Row[X + 3] & 3) << 6);
+                else
+                    for(size_t j = 0; j < Count; j++)
+                        Group |= (Row[X + j] & 3) << (j * 2);
+                
+                // Write the group out whole, or each pixel repeated to scale
+                const unsigned char* Pixels = Surface->Expansion[Group];
+                if(Scale == 1)
+                {
+                    memcpy(Out, Pixels, Count * PixelSize);
+                    Out += Count * PixelSize;
+                }
+                else
+                {
+                    for(size_t j = 0; j < Count; j++)
+                        for(size_t k = 0; k < Scale; k++, Out += PixelSize)
+                            memcpy(Out, Pixels + j * PixelSize, PixelSize);
+                }
+            }
+            
+            // The rest of the scaled row is the same
+            for(size_t k = 1; k < Scale; k++)
+                memcpy(First + Surface->Pitch * (ptrdiff_t)k, First, Out - First);
+        }
+    }
+}
+
+cbError cbStep_SetDrawQueue(cbVirtualMachine* Processor, size_t QueueSize)
+{
+    if(Processor == NULL)
+        return cbError_Null;
+    
+    // Indices wrap around with a mask
+    size_t Size = 0;
+    if(QueueSize > 0)
+        for(Size = 1; Size < QueueSize; Size *= 2);
+    
+    free(Processor->DrawQueue);
+    Processor->DrawQueue = NULL;
+    Processor->DrawQueueSize = 0;
+    Processor->DrawHead = Processor->DrawTail = 0;
+    Processor->DrawOverflow = false;
+    
+    if(Size > 0)
+    {
+        Processor->DrawQueue = malloc(sizeof(cbDrawEvent) * Size);
+        if(Processor->DrawQueue == NULL)
+            return cbError_Overflow;
+        Processor->DrawQueueSize = Size;
+    }
+    
+    return cbError_None;
+}
+
+size_t cbStep_GetDrawEvents(cbVirtualMachine* Processor, cbDrawEvent* Events, size_t MaxEvents)
+{
+    if(Processor == NULL || Processor->DrawQueue == NULL || Events == NULL)
+        return 0;
+    
+    // The host is the only consumer: take whatever was published, then hand the slots back
+    size_t Tail = Processor->DrawTail;
+    size_t Available = __cbAtomicLoad(Processor->DrawHead) - Tail;
+    size_t Count = (Available < MaxEvents) ? Available : MaxEvents;
+    for(size_t i = 0; i < Count; i++)
+        Events[i] = Processor->DrawQueue[(Tail + i) & (Processor->DrawQueueSize - 1)];
+    __cbAtomicStore(Processor->DrawTail, Tail + Count);
+    
+    // Anything dropped is made up for by redrawing everything, after what was kept
+    if(Count < MaxEvents && __cbAtomicLoad(Processor->DrawOverflow) && __cbAtomicExchange(Processor->DrawOverflow, false))
+    {
+        memset(&Events[Count], 0, sizeof(cbDrawEvent));
+        Events[Count++].Type = cbDrawEvent_Resync;
+    }
+    
+    return Count;
+}
+
+size_t cbStep_GetDirtyRegions(cbVirtualMachine* Processor, cbScreenRegion* Regions, size_t MaxRegions)
+{
+    if(Processor == NULL || Processor->DirtyRows == NULL || Regions == NULL || MaxRegions == 0)
+        return 0;
+    
+    // Walk down the rows, growing the current region over the following rows with the same columns;
+    // once out of regions, the last one grows over anything else that changed
+    size_t Count = 0;
+    for(size_t Y = 0; Y < Processor->ScreenHeight; Y++)
+    {
+        size_t Start = Processor->DirtyRows[Y * 2], End = Processor->DirtyRows[Y * 2 + 1];
+        if(Start >= End)
+            continue;
+        
+        cbScreenRegion* Last = (Count > 0) ? &Regions[Count - 1] : NULL;
+        if(Last != NULL && Last->Y + Last->Height == Y && Last->X == Start && Last->Width == End - Start)
+            Last->Height++;
+        else if(Count < MaxRegions)
+        {
+            Regions[Count].X = Start;
+            Regions[Count].Y = Y;
+            Regions[Count].Width = End - Start;
+            Regions[Count].Height = 1;
+            Count++;
+        }
+        else
+        {
+            size_t Left = (Last->X < Start) ? Last->X : Start;
+            size_t Right = (Last->X + Last->Width > End) ? Last->X + Last->Width : End;
+            Last->X = Left;
+            Last->Width = Right - Left;
+            Last->Height = Y + 1 - Last->Y;
+        }
+        
+        // Now seen by the host
+        Processor->DirtyRows[Y * 2] = Processor->DirtyRows[Y * 2 + 1] = 0;
+    }
+    
+    return Count;
+}
+
+cbError cbStep_SetOutputPolicy(cbVirtualMachine* Processor, unsigned int FlushPolicy, size_t BufferSize)
+{
+    // Ignore if null
+    if(Processor == NULL)
+        return cbError_Null;
+    
+    // Anything buffered so far goes out under the old policy
+    cbStep_FlushOutput(Processor);
+    Processor->FlushPolicy = FlushPolicy;
+    
+    // Resize the buffer; without one, all output is written straight through
+    if(BufferSize != Processor->OutputSize)
+    {
+        char* Buffer = (BufferSize > 0) ? realloc(Processor->OutputBuffer, BufferSize) : NULL;
+        if(Buffer == NULL && BufferSize > 0)
+            return cbError_Overflow;
+        
+        if(BufferSize == 0)
+            free(Processor->OutputBuffer);
+        Processor->OutputBuffer = Buffer;
+        Processor->OutputSize = BufferSize;
+    }
+    
+    return cbError_None;
+}
+
+void cbStep_FlushOutput(cbVirtualMachine* Processor)
+{
+    if(Processor == NULL || Processor->OutputLength == 0)
+        return;
+    
+    // The sink reads straight out of our buffer; without a sink, the output is dropped
+    if(Processor->OutputSink != NULL)
+        Processor->OutputSink(Processor->OutputContext, Processor->OutputBuffer, Processor->OutputLength);
+    Processor->OutputLength = 0;
+}
+
+void cbStep_SetOutputSink(cbVirtualMachine* Processor, cbOutputSink Sink, void* Context)
+{
+    if(Processor == NULL)
+        return;
+    
+    cbStep_FlushOutput(Processor);
+    Processor->OutputSink = Sink;
+    Processor->OutputContext = Context;
+}
+
+void cbStep_SetInputProvider(cbVirtualMachine* Processor, cbInputProvider Provider, void* Context)
+{
+    if(Processor == NULL)
+        return;
+    
+    Processor->InputProvider = Provider;
+    Processor->InputContext = Context;
+}
+
+void cbStep_FileOutputSink(void* Context, const char* Text, size_t Length)
+{
+    FILE* StreamOut = (FILE*)Context;
+    fwrite(Text, 1, Length, StreamOut);
+    fflush(StreamOut);
+}
+
+bool cbStep_FileInputProvider(void* Context, cbInterrupt Interrupt, char* Input, size_t InputSize)
+{
+    FILE* StreamIn = (FILE*)Context;
+    
+    // Skip leading white space, then read up to the next white space (as with "%s")
+    int Char = fgetc(StreamIn);
+    while(Char != EOF && isspace(Char))
+        Char = fgetc(StreamIn);
+    
+    size_t Length = 0;
+    while(Char != EOF && !isspace(Char))
+    {
+        if(Length + 1 < InputSize)
+            Input[Length++] = (char)Char;
+        Char = fgetc(StreamIn);
+    }
+    
+    // Always done waiting, even if the stream ran out (posting no input)
+    if(InputSize > 0)
+        Input[Length] = '\0';
+    return true;
+}
+
+bool cbStep_PollInput(cbVirtualMachine* Processor)
+{
+    if(Processor->InterruptState == cbInterrupt_None)
+        return true;
     
-    // Post interrupt (if any)
-    *InterruptState = Processor->InterruptState;
+    // Waits are only over once their time passes
+    if(Processor->InterruptState == cbInterrupt_Wait)
+    {
+        if(cbUtil_GetTime() < Processor->WakeTime)
+            return false;
+        cbStep_ReleaseInterrupt(Processor, NULL);
+        return true;
+    }
+    if(Processor->InputProvider == NULL)
+        return false;
     
-    // All done!
-    return Error;
+    // Make sure the host sees whatever asked for the input before it is asked for
+    cbStep_FlushOnState(Processor, cbError_None);
+    
+    char Input[256];
+    if(!Processor->InputProvider(Processor->InputContext, Processor->InterruptState, Input, sizeof(Input)))
+        return false;
+    
+    cbStep_ReleaseInterrupt(Processor, Input);
+    return true;
 }
 
-void cbStep_ReleaseInterrupt(cbVirtualMachine* Processor, const char* UserInput)
+void cbStep_SetInputBuffer(cbVirtualMachine* Processor, const char* Buffer, size_t Length)
 {
-    // Clear interrupt
-    cbInterrupt OldState = Processor->InterruptState;
-    Processor->InterruptState = cbInterrupt_None;
+    if(Processor == NULL)
+        return;
     
-    // If pause, just ignore
-    if(OldState == cbInterrupt_Pause)
+    Processor->InputBuffer = Buffer;
+    Processor->InputLength = (Buffer != NULL) ? Length : 0;
+    Processor->InputOffset = 0;
+}
+
+void cbStep_ParseInput(const char* Text, size_t Length, cbVariable* UserVar)
+{
+    // Booleans
+    if(Length == 4 && strncmp(Text, "true", 4) == 0)
     {
+        UserVar->Type = cbVariableType_Bool;
+        UserVar->Data.Bool = true;
         return;
     }
-    // If get key, just return the first index, or 0, on the stack
-    else if(OldState == cbInterrupt_GetKey)
+    else if(Length == 5 && strncmp(Text, "false", 5) == 0)
     {
-        // Turn into integer
-        cbVariable UserVar;
-        UserVar.Type = cbVariableType_Int;
-        UserVar.Data.Int = UserInput[0];
-        
-        Processor->StackPointer -= sizeof(cbVariable);
-        memcpy(Processor->Memory + Processor->StackPointer, (void*)&UserVar, sizeof(cbVariable));
+        UserVar->Type = cbVariableType_Bool;
+        UserVar->Data.Bool = false;
+        return;
     }
-    // If asking for full line
-    else if(OldState == cbInterrupt_Input)
+    
+    // All of the digits make up the integer (wrapping around on overflow), while floats scale them down by
+    // the digits past the decimal point; a single rounding, from double, as when read in with sscanf
+    unsigned int Integer = 0;
+    double Digits = 0.0, Scale = 1.0;
+    bool IsFloat = false;
+    for(size_t i = 0; i < Length; i++)
     {
-        // Parse for each type
-        cbVariable UserVar;
-        
-        // Line length
-        size_t UserInputLength = strlen(UserInput);
-        
-        if(cbLang_IsInteger(UserInput, UserInputLength))
-        {
-            UserVar.Type = cbVariableType_Int;
-            sscanf(UserInput, "%d", &UserVar.Data.Int);
-        }
-        else if(cbLang_IsFloat(UserInput, UserInputLength))
-        {
-            UserVar.Type = cbVariableType_Float;
-            sscanf(UserInput, "%f", &UserVar.Data.Float);
-        }
-        else if(cbLang_IsBoolean(UserInput, UserInputLength))
+        unsigned int Digit = (unsigned char)Text[i] - '0';
+        if(Digit <= 9)
         {
-            UserVar.Type = cbVariableType_Bool;
-            if(UserInput[0] == 't')
-                UserVar.Data.Bool = true;
-            else
-                UserVar.Data.Bool = false;
+            Integer = Integer * 10 + Digit;
+            Digits = Digits * 10.0 + Digit;
+            if(IsFloat)
+                Scale *= 10.0;
         }
-        else // Not supported
+        else if(Text[i] == '.' && !IsFloat)
+            IsFloat = true;
+        else
         {
-            // Post -1 [int]
-            UserVar.Type = cbVariableType_Int;
-            UserVar.Data.Int = -1;
+            // Not supported: post -1 [int]
+            UserVar->Type = cbVariableType_Int;
+            UserVar->Data.Int = -1;
+            return;
         }
-        
-        // Push variable into run-time memory stack
-        Processor->StackPointer -= sizeof(cbVariable);
-        memcpy(Processor->Memory + Processor->StackPointer, (void*)&UserVar, sizeof(cbVariable));
+    }
+    
+    if(IsFloat)
+    {
+        UserVar->Type = cbVariableType_Float;
+        UserVar->Data.Float = (float)(Digits / Scale);
+    }
+    else
+    {
+        UserVar->Type = cbVariableType_Int;
+        UserVar->Data.Int = (int)Integer;
     }
 }
 
-const unsigned char* const cbStep_GetScreenBuffer(cbVirtualMachine* Processor)
+bool cbStep_TakeInput(cbVirtualMachine* Processor, cbInterrupt Interrupt, cbVariable* UserVar)
+{
+    // Skip leading white space, then take up to the next white space (as the file input provider does)
+    const char* Buffer = Processor->InputBuffer;
+    size_t Offset = Processor->InputOffset;
+    while(Offset < Processor->InputLength && isspace((unsigned char)Buffer[Offset]))
+        Offset++;
+    if(Offset >= Processor->InputLength)
+        return false;
+    
+    size_t Start = Offset;
+    while(Offset < Processor->InputLength && !isspace((unsigned char)Buffer[Offset]))
+        Offset++;
+    Processor->InputOffset = Offset;
+    
+    // A key is the first character of the word
+    if(Interrupt == cbInterrupt_GetKey)
+    {
+        UserVar->Type = cbVariableType_Int;
+        UserVar->Data.Int = Buffer[Start];
+    }
+    else
+        cbStep_ParseInput(Buffer + Start, Offset - Start, UserVar);
+    return true;
+}
+
+cbError cbStep_Input(cbVirtualMachine* Processor, cbInstruction* Instruction)
 {
-    return Processor->ScreenBuffer;
+    cbInterrupt Interrupt = (Instruction->Op == cbOps_Input) ? cbInterrupt_Input : cbInterrupt_GetKey;
+    cbVariable UserVar;
+    if(!cbStep_TakeInput(Processor, Interrupt, &UserVar))
+    {
+        Processor->InterruptState = Interrupt;
+        return cbError_None;
+    }
+    
+    // Stack grows
+    Processor->StackPointer -= sizeof(cbVariable);
+    if(Processor->StackPointer < Processor->HeapPointer)
+        return cbError_Overflow;
+    memcpy((char*)Processor->Memory + Processor->StackPointer, &UserVar, sizeof(cbVariable));
+    return cbError_None;
 }
 
 cbError cbStep_MathOp(cbVirtualMachine* Processor, cbInstruction* Instruction)
@@ -243,12 +2159,6 @@ cbError cbStep_MathOp(cbVirtualMachine* Processor, cbInstruction* Instruction)
     // Our result should be on the stack, not the actual memory
     cbVariable* Out = B;
     
-    // If A or B is an offset (i.e. pointer), correctly point to the variable itself, and not the reference
-    if(A->Type == cbVariableType_Offset)
-        A = (cbVariable*)((char*)Processor->Memory + Processor->StackBasePointer + A->Data.Offset);
-    if(B->Type == cbVariableType_Offset)
-        B = (cbVariable*)((char*)Processor->Memory + Processor->StackBasePointer + B->Data.Offset);
-    
     // Only integers are supported at the moment
     if(A->Type != cbVariableType_Int || B->Type != cbVariableType_Int)
         return cbError_TypeMismatch;
@@ -281,31 +2191,166 @@ cbError cbStep_MathOp(cbVirtualMachine* Processor, cbInstruction* Instruction)
     
     // If mod
     else if(Instruction->Op == cbOps_Mod)
-        Out->Data.Int = B->Data.Int % A->Data.Int;
+    {
+        if(A->Data.Int == 0)
+            return cbError_DivZero;
+        else
+            Out->Data.Int = B->Data.Int % A->Data.Int;
+    }
     
     // No problem
     return cbError_None;
 }
 
-cbError cbStep_Store(cbVirtualMachine* Processor, cbInstruction* Instruction)
+cbError cbStep_SetMath(cbVirtualMachine* Processor, cbInstruction* Instruction)
+{
+    // The operand slot must be within the code segment
+    if(Processor->InstructionPointer + 2 * sizeof(cbInstruction) > Processor->DataPointer)
+        return cbError_Overflow;
+    
+    // Arg is the variable, the next slot has the math op with the literal
+    cbInstruction* Operand = Instruction + 1;
+    cbVariable* A = (cbVariable*)((char*)Processor->Memory + Processor->DataPointer + Operand->Arg);
+    cbVariable* B = (cbVariable*)((char*)Processor->Memory + Processor->StackBasePointer + Instruction->Arg);
+    
+    // Only integers are supported at the moment
+    if(A->Type != cbVariableType_Int || B->Type != cbVariableType_Int)
+        return cbError_TypeMismatch;
+    
+    // Apply the op straight into the variable
+    switch(Operand->Op)
+    {
+        case cbOps_Add:
+            B->Data.Int = B->Data.Int + A->Data.Int;
+            break;
+        case cbOps_Sub:
+            B->Data.Int = B->Data.Int - A->Data.Int;
+            break;
+        case cbOps_Mul:
+            B->Data.Int = B->Data.Int * A->Data.Int;
+            break;
+        case cbOps_Div:
+            if(A->Data.Int == 0)
+                return cbError_DivZero;
+            B->Data.Int = B->Data.Int / A->Data.Int;
+            break;
+        case cbOps_Mod:
+            if(A->Data.Int == 0)
+                return cbError_DivZero;
+            B->Data.Int = B->Data.Int % A->Data.Int;
+            break;
+        default:
+            return cbError_UnknownOp;
+    }
+    
+    // Skip over the operand slot
+    Processor->InstructionPointer += sizeof(cbInstruction);
+    
+    // No problem
+    return cbError_None;
+}
+
+cbError cbStep_IfComp(cbVirtualMachine* Processor, cbInstruction* Instruction)
+{
+    // Both operand slots must be within the code segment
+    if(Processor->InstructionPointer + 3 * sizeof(cbInstruction) > Processor->DataPointer)
+        return cbError_Overflow;
+    
+    // Arg is the variable, the next slot has the comparison op with the literal, then the if
+    cbInstruction* Operand = Instruction + 1;
+    cbInstruction* If = Instruction + 2;
+    cbVariable* A = (cbVariable*)((char*)Processor->Memory + Processor->DataPointer + Operand->Arg);
+    cbVariable* B = (cbVariable*)((char*)Processor->Memory + Processor->StackBasePointer + Instruction->Arg);
+    
+    // Only integers are supported at the moment
+    if(A->Type != cbVariableType_Int || B->Type != cbVariableType_Int)
+        return cbError_TypeMismatch;
+    
+    // Apply logic
+    bool Result = false;
+    switch(Operand->Op)
+    {
+        case cbOps_Eq:
+            Result = B->Data.Int == A->Data.Int;
+            break;
+        case cbOps_NotEq:
+            Result = B->Data.Int != A->Data.Int;
+            break;
+        case cbOps_Greater:
+            Result = B->Data.Int > A->Data.Int;
+            break;
+        case cbOps_GreaterEq:
+            Result = B->Data.Int >= A->Data.Int;
+            break;
+        case cbOps_Less:
+            Result = B->Data.Int < A->Data.Int;
+            break;
+        case cbOps_LessEq:
+            Result = B->Data.Int <= A->Data.Int;
+            break;
+        default:
+            return cbError_UnknownOp;
+    }
+    
+    // Skip over the operand slots, and take the if's jump (relative to itself) if false
+    Processor->InstructionPointer += 2 * sizeof(cbInstruction);
+    if(!Result)
+        Processor->InstructionPointer += (If->Arg - 1) * sizeof(cbInstruction);
+    
+    // No problem
+    return cbError_None;
+}
+
+cbError cbStep_IntOp(cbVirtualMachine* Processor, cbInstruction* Instruction)
 {
-    // Get both variables off the stack; remove both completely
+    // Get both variables off the stack, as with the generic ops
     cbVariable* A = (cbVariable*)((char*)Processor->Memory + Processor->StackPointer);
     Processor->StackPointer += sizeof(cbVariable);
-    
     cbVariable* B = (cbVariable*)((char*)Processor->Memory + Processor->StackPointer);
-    Processor->StackPointer += sizeof(cbVariable);
+    cbVariable* Out = B;
+    
+    // Apply the op; both are known to be integers
+    int Result = 0;
+    switch(Instruction->Op)
+    {
+        case cbOps_AddInt:          Result = B->Data.Int + A->Data.Int;     break;
+        case cbOps_SubInt:          Result = B->Data.Int - A->Data.Int;     break;
+        case cbOps_MulInt:          Result = B->Data.Int * A->Data.Int;     break;
+        case cbOps_EqInt:           Result = B->Data.Int == A->Data.Int;    break;
+        case cbOps_NotEqInt:        Result = B->Data.Int != A->Data.Int;    break;
+        case cbOps_GreaterInt:      Result = B->Data.Int > A->Data.Int;     break;
+        case cbOps_GreaterEqInt:    Result = B->Data.Int >= A->Data.Int;    break;
+        case cbOps_LessInt:         Result = B->Data.Int < A->Data.Int;     break;
+        case cbOps_LessEqInt:       Result = B->Data.Int <= A->Data.Int;    break;
+        case cbOps_DivInt:
+            if(A->Data.Int == 0)
+                return cbError_DivZero;
+            Result = B->Data.Int / A->Data.Int;
+            break;
+        case cbOps_ModInt:
+            if(A->Data.Int == 0)
+                return cbError_DivZero;
+            Result = B->Data.Int % A->Data.Int;
+            break;
+        default:
+            return cbError_UnknownOp;
+    }
     
-    // If A is an offset (i.e. pointer), correctly point to the variable itself, and not the reference
-    if(A->Type == cbVariableType_Offset)
-        A = (cbVariable*)((char*)Processor->Memory + Processor->StackBasePointer + A->Data.Offset);
+    Out->Type = cbVariableType_Int;
+    Out->Data.Int = Result;
     
-    // If B is not a variable, fail out
-    if(B->Type != cbVariableType_Offset)
-        return cbError_ConstSet;
-    // Else, good
-    else
-        B = (cbVariable*)((char*)Processor->Memory + Processor->StackBasePointer + B->Data.Offset);
+    // No problem
+    return cbError_None;
+}
+
+cbError cbStep_Store(cbVirtualMachine* Processor, cbInstruction* Instruction)
+{
+    // Get the value off the stack; remove it completely
+    cbVariable* A = (cbVariable*)((char*)Processor->Memory + Processor->StackPointer);
+    Processor->StackPointer += sizeof(cbVariable);
+    
+    // The arg is the variable's slot from the stack base
+    cbVariable* B = (cbVariable*)((char*)Processor->Memory + Processor->StackBasePointer + Instruction->Arg);
     
     // Set data
     *B = *A;
@@ -320,50 +2365,65 @@ cbError cbStep_Disp(cbVirtualMachine* Processor, cbInstruction* Instruction)
     cbVariable* A = (cbVariable*)((char*)Processor->Memory + Processor->StackPointer);
     Processor->StackPointer += sizeof(cbVariable);
     
-    // Dereference if needed
-    if(A->Type == cbVariableType_Offset)
-        A = (cbVariable*)((char*)Processor->Memory + Processor->StackBasePointer + A->Data.Offset);
+    return cbStep_DispVariable(Processor, A);
+}
+
+cbError cbStep_DispVariable(cbVirtualMachine* Processor, cbVariable* A)
+{
+    // Text to write out, and room to format an integer into (from the back)
+    const char* Text = NULL;
+    size_t Length = 0;
+    char Digits[16];
     
     if(A->Type == cbVariableType_Int)
-        fprintf(Processor->StreamOut, "%d", A->Data.Int);
-    else if(A->Type == cbVariableType_String)
     {
-        // Pull out the string
-        char* String = (char*)((char*)Processor->Memory + Processor->DataPointer + (size_t)A->Data.String);
+        // Format by hand; the magnitude is unsigned so that the smallest integer is still negated
+        unsigned int Magnitude = (A->Data.Int < 0) ? -(unsigned int)A->Data.Int : (unsigned int)A->Data.Int;
+        char* Digit = Digits + sizeof(Digits);
+        do {
+            *(--Digit) = '0' + Magnitude % 10;
+            Magnitude /= 10;
+        } while(Magnitude > 0);
+        if(A->Data.Int < 0)
+            *(--Digit) = '-';
         
-        // For each character, print out, unless it is a system-character
-        for(size_t i = 0; i < strlen(String); i++)
-        {
-            // Apply system-chars
-            if(String[i] == '\\' && String[i + 1] == 'n')
-            {
-                i++;
-                fprintf(Processor->StreamOut, "\n");
-            }
-            else
-                fprintf(Processor->StreamOut, "%c", String[i]);
-        }
+        Text = Digit;
+        Length = Digits + sizeof(Digits) - Digit;
+    }
+    else if(A->Type == cbVariableType_String)
+    {
+        // Escape sequences were already applied by the compiler
+        cbError Error = cbStep_GetString(Processor, A, &Text, &Length);
+        if(Error != cbError_None)
+            return Error;
     }
     else
         return cbError_TypeMismatch;
     
-    // Flush out to the stream
-    fflush(Processor->StreamOut);
+    // Buffer, then flush out if the policy asks for it
+    cbStep_WriteOutput(Processor, Text, Length);
+    if((Processor->FlushPolicy & cbFlush_Always) || ((Processor->FlushPolicy & cbFlush_Newline) && memchr(Text, '\n', Length) != NULL))
+        cbStep_FlushOutput(Processor);
     
     // No problem
     return cbError_None;
 }
 
+void cbStep_FlushOnState(cbVirtualMachine* Processor, cbError Error)
+{
+    bool IsFailed = Error != cbError_None && Error != cbError_Halted;
+    if(((Processor->FlushPolicy & cbFlush_Interrupt) && Processor->InterruptState != cbInterrupt_None) ||
+       ((Processor->FlushPolicy & cbFlush_Halt) && (Processor->Halted || IsFailed)))
+        cbStep_FlushOutput(Processor);
+    cbRecord_OnState(Processor, Error);
+}
+
 cbError cbStep_If(cbVirtualMachine* Processor, cbInstruction* Instruction)
 {
     // Get variables off the stack; shrink as needed
     cbVariable* A = (cbVariable*)((char*)Processor->Memory + Processor->StackPointer);
     Processor->StackPointer += sizeof(cbVariable);
     
-    // Dereference if needed
-    if(A->Type == cbVariableType_Offset)
-        A = (cbVariable*)((char*)Processor->Memory + Processor->StackBasePointer + A->Data.Offset);
-    
     // Int, float, and bool are accepted
     if(A->Type != cbVariableType_Int && A->Type != cbVariableType_Float && A->Type != cbVariableType_Bool)
         return cbError_TypeMismatch;
@@ -393,12 +2453,6 @@ cbError cbStep_CompOp(cbVirtualMachine* Processor, cbInstruction* Instruction)
     // Our result should be on the stack, not the actual memory
     cbVariable* Out = B;
     
-    // If A or B is an offset (i.e. pointer), correctly point to the variable itself, and not the reference
-    if(A->Type == cbVariableType_Offset)
-        A = (cbVariable*)((char*)Processor->Memory + Processor->StackBasePointer + A->Data.Offset);
-    if(B->Type == cbVariableType_Offset)
-        B = (cbVariable*)((char*)Processor->Memory + Processor->StackBasePointer + B->Data.Offset);
-    
     // Only integers are supported at the moment
     if(A->Type != cbVariableType_Int || B->Type != cbVariableType_Int)
         return cbError_TypeMismatch;
@@ -444,10 +2498,6 @@ cbError cbStep_LogicOp(cbVirtualMachine* Processor, cbInstruction* Instruction)
     cbVariable* A = (cbVariable*)(Processor->Memory + Processor->StackPointer);
     Processor->StackPointer += sizeof(cbVariable);
     
-    // If offset, not actual variable, point to the true variable
-    if(A->Type == cbVariableType_Offset)
-        A = (cbVariable*)(Processor->Memory + Processor->StackBasePointer + A->Data.Offset);
-    
     // If the not operator, apply it just on the one variable A
     if(Instruction->Op == cbOps_Not)
     {
@@ -464,18 +2514,16 @@ cbError cbStep_LogicOp(cbVirtualMachine* Processor, cbInstruction* Instruction)
     {
         // Get the second variable out
         cbVariable* B = (cbVariable*)(Processor->Memory + Processor->StackPointer);
-        if(B->Type == cbVariableType_Offset)
-            B = (cbVariable*)(Processor->Memory + Processor->StackBasePointer + B->Data.Offset);
         
         // Only support boolean or integers
-        if(A->Type != cbVariableType_Int && A->Type != cbVariableType_Bool && B->Type != cbVariableType_Int && B->Type != cbVariableType_Bool)
+        if((A->Type != cbVariableType_Int && A->Type != cbVariableType_Bool) || (B->Type != cbVariableType_Int && B->Type != cbVariableType_Bool))
             return cbError_TypeMismatch;
         
         // Apply 'and' op
         if(Instruction->Op == cbOps_And)
             B->Data.Int = A->Data.Int && B->Data.Int;
         // Apply 'or' op
-        else if(Instruction->Op == cbOps_And)
+        else if(Instruction->Op == cbOps_Or)
             B->Data.Int = A->Data.Int || B->Data.Int;
     }
     
@@ -498,14 +2546,11 @@ cbError cbStep_Output(cbVirtualMachine* Processor, cbInstruction* Instruction)
     cbVariable* X = (cbVariable*)(Processor->Memory + Processor->StackPointer);
     Processor->StackPointer += sizeof(cbVariable);
     
-    // If offset, not actual variable, point to the true variable
-    if(X->Type == cbVariableType_Offset)
-        X = (cbVariable*)(Processor->Memory + Processor->StackBasePointer + X->Data.Offset);
-    if(Y->Type == cbVariableType_Offset)
-        Y = (cbVariable*)(Processor->Memory + Processor->StackBasePointer + Y->Data.Offset);
-    if(C->Type == cbVariableType_Offset)
-        C = (cbVariable*)(Processor->Memory + Processor->StackBasePointer + C->Data.Offset);
-    
+    return cbStep_OutputPixel(Processor, X, Y, C);
+}
+
+cbError cbStep_OutputPixel(cbVirtualMachine* Processor, cbVariable* X, cbVariable* Y, cbVariable* C)
+{
     /*** Render on-screen ***/
     
     // Type check
@@ -516,17 +2561,216 @@ cbError cbStep_Output(cbVirtualMachine* Processor, cbInstruction* Instruction)
     if(X->Data.Int < 0 || X->Data.Int >= Processor->ScreenWidth || Y->Data.Int < 0 || Y->Data.Int >= Processor->ScreenHeight)
         return cbError_Overflow;
     
-    // Find the byte position of the pixel
-    Processor->ScreenBuffer[Processor->ScreenWidth * Y->Data.Int + X->Data.Int] = C->Data.Int;
+    // Find the byte position of the pixel (and its bits if packed), and grow the row's changed columns over it
+    size_t PixelX = X->Data.Int, PixelY = Y->Data.Int;
+    unsigned char* Row = Processor->ScreenBuffer + Processor->ScreenPitch * PixelY;
+    if(Processor->Options & cbOption_PackedScreen)
+        cbStep_PutPixel(Processor, Row, PixelX, C->Data.Int & 3);
+    else
+        Row[PixelX] = C->Data.Int;
+    cbStep_MarkDirty(Processor, PixelY, PixelX, PixelX + 1);
+    cbStep_PostDrawEvent(Processor, cbDrawEvent_Pixel, X->Data.Int, Y->Data.Int, 0, 0, 1, 1, C->Data.Int & 3, NULL);
+    
+    // No problem
+    return cbError_None;
+}
+
+cbError cbStep_Draw(cbVirtualMachine* Processor, cbInstruction* Instruction)
+{
+    /*** Load Data ***/
+    
+    // Pop all arguments at once; the first one was pushed first, so it is the deepest
+    size_t ArgCount = (Instruction->Op == cbOps_Blit) ? 4 : 5;
+    cbVariable* Args = (cbVariable*)(Processor->Memory + Processor->StackPointer);
+    Processor->StackPointer += ArgCount * sizeof(cbVariable);
+    
+    // All are integers, but for the sprite
+    long Values[5];
+    for(size_t i = 0; i < ArgCount; i++)
+    {
+        cbVariable* Arg = &Args[ArgCount - 1 - i];
+        if(Instruction->Op == cbOps_Blit && i == 3)
+            continue;
+        if(Arg->Type != cbVariableType_Int)
+            return cbError_TypeMismatch;
+        Values[i] = Arg->Data.Int;
+    }
+    
+    /*** Render on-screen ***/
+    
+    switch(Instruction->Op)
+    {
+        case cbOps_Line:
+            cbStep_DrawLine(Processor, Values[0], Values[1], Values[2], Values[3], Values[4] & 3);
+            cbStep_PostDrawEvent(Processor, cbDrawEvent_Line, Values[0], Values[1], Values[2], Values[3], 0, 0, Values[4] & 3, NULL);
+            break;
+        case cbOps_Rect:
+        {
+            // Rows out of the screen are skipped outright
+            long Top = (Values[1] > 0) ? Values[1] : 0;
+            long Bottom = (Values[1] + Values[3] < (long)Processor->ScreenHeight) ? Values[1] + Values[3] : (long)Processor->ScreenHeight;
+            for(long Y = Top; Y < Bottom; Y++)
+                cbStep_FillSpan(Processor, Values[0], Values[0] + Values[2], Y, Values[4] & 3);
+            cbStep_PostDrawEvent(Processor, cbDrawEvent_Rect, Values[0], Values[1], 0, 0, Values[2], Values[3], Values[4] & 3, NULL);
+            break;
+        }
+        case cbOps_Blit:
+        {
+            const char* Sprite = NULL;
+            size_t Length = 0;
+            if(Args[0].Type != cbVariableType_String)
+                return cbError_TypeMismatch;
+            cbError Error = cbStep_GetString(Processor, &Args[0], &Sprite, &Length);
+            if(Error != cbError_None)
+                return Error;
+            cbStep_DrawSprite(Processor, Values[0], Values[1], Values[2], Sprite, Length);
+            if(Values[2] > 0)
+                cbStep_PostDrawEvent(Processor, cbDrawEvent_Blit, Values[0], Values[1], 0, 0, Values[2], (Length + Values[2] - 1) / Values[2], 0, Sprite);
+            break;
+        }
+        default:
+            return cbError_UnknownOp;
+    }
     
     // No problem
     return cbError_None;
 }
 
+cbError cbStep_Wait(cbVirtualMachine* Processor, cbInstruction* Instruction)
+{
+    // Get the duration off
+    cbVariable* Duration = (cbVariable*)(Processor->Memory + Processor->StackPointer);
+    Processor->StackPointer += sizeof(cbVariable);
+    
+    return cbStep_WaitFor(Processor, Duration);
+}
+
+cbError cbStep_WaitFor(cbVirtualMachine* Processor, cbVariable* Duration)
+{
+    // Type check; floats are cut down to whole milliseconds
+    long Milliseconds = 0;
+    if(Duration->Type == cbVariableType_Int)
+        Milliseconds = Duration->Data.Int;
+    else if(Duration->Type == cbVariableType_Float)
+        Milliseconds = (long)Duration->Data.Float;
+    else
+        return cbError_TypeMismatch;
+    
+    // Even a wait of nothing gives control back to the host once
+    Processor->WakeTime = cbUtil_GetTime() + ((Milliseconds > 0) ? Milliseconds : 0);
+    Processor->InterruptState = cbInterrupt_Wait;
+    return cbError_None;
+}
+
 cbError cbStep_Clear(cbVirtualMachine* Processor, cbInstruction* Instruction)
 {
-    // Clear buffer
-    memset((void*)Processor->ScreenBuffer, 0, Processor->ScreenWidth * Processor->ScreenHeight);
+    // Without a back buffer, the screen shown until now is a frame of its own
+    if(Processor->FrontBuffer == NULL)
+        cbRecord_Frame(Processor);
+    
+    // Clear buffer, all of which has now changed
+    memset((void*)Processor->ScreenBuffer, 0, Processor->ScreenPitch * Processor->ScreenHeight);
+    size_t* DirtyRows = (Processor->BackDirtyRows != NULL) ? Processor->BackDirtyRows : Processor->DirtyRows;
+    for(size_t Y = 0; Y < Processor->ScreenHeight; Y++)
+    {
+        DirtyRows[Y * 2] = 0;
+        DirtyRows[Y * 2 + 1] = Processor->ScreenWidth;
+    }
+    cbStep_PostDrawEvent(Processor, cbDrawEvent_Clear, 0, 0, 0, 0, Processor->ScreenWidth, Processor->ScreenHeight, 0, NULL);
+    
+    // No error, ever
+    return cbError_None;
+}
+
+cbError cbStep_InitScreen(cbVirtualMachine* Processor, size_t ScreenWidth, size_t ScreenHeight)
+{
+    // Rows are byte-aligned, even when packed
+    Processor->ScreenWidth = ScreenWidth;
+    Processor->ScreenHeight = ScreenHeight;
+    Processor->ScreenPitch = (Processor->Options & cbOption_PackedScreen) ? (ScreenWidth + 3) / 4 : ScreenWidth;
+    
+    // Exactly the (packed) screen, and a pair of columns per row; malloc(0) may give null, which would read
+    // as a failure (or as no back buffer), so an empty screen (i.e. on the console) still takes a byte
+    size_t ScreenSize = Processor->ScreenPitch * ScreenHeight;
+    size_t DirtySize = sizeof(size_t) * 2 * ScreenHeight;
+    ScreenSize = (ScreenSize > 0) ? ScreenSize : 1;
+    DirtySize = (DirtySize > 0) ? DirtySize : 1;
+    
+    Processor->ScreenBuffer = malloc(ScreenSize);
+    Processor->DirtyRows = malloc(DirtySize);
+    bool IsAllocated = (Processor->ScreenBuffer != NULL && Processor->DirtyRows != NULL);
+    if(IsAllocated && (Processor->Options & cbOption_DoubleBuffer))
+    {
+        Processor->FrontBuffer = malloc(ScreenSize);
+        Processor->SpareBuffer = malloc(ScreenSize);
+        Processor->BackDirtyRows = malloc(DirtySize);
+        IsAllocated = (Processor->FrontBuffer != NULL && Processor->SpareBuffer != NULL && Processor->BackDirtyRows != NULL);
+    }
+    
+    // Give back whatever was allocated, rather than leave the screen half set up
+    if(!IsAllocated)
+    {
+        free(Processor->ScreenBuffer);
+        free(Processor->DirtyRows);
+        free(Processor->FrontBuffer);
+        free(Processor->SpareBuffer);
+        free(Processor->BackDirtyRows);
+        Processor->ScreenBuffer = Processor->FrontBuffer = Processor->SpareBuffer = NULL;
+        Processor->DirtyRows = Processor->BackDirtyRows = NULL;
+        return cbError_Overflow;
+    }
+    
+    // Starts out cleared, which the host has yet to see; both buffers are, but no frame was shown yet
+    cbStep_Clear(Processor, NULL);
+    if(Processor->FrontBuffer != NULL)
+        cbStep_Flip(Processor, NULL);
+    Processor->FrameCount = 0;
+    return cbError_None;
+}
+
+cbError cbStep_Flip(cbVirtualMachine* Processor, cbInstruction* Instruction)
+{
+    if(Processor->FrontBuffer != NULL)
+    {
+        // Show what was drawn; the host's next read latches the new frame
+        unsigned char* Frame = Processor->ScreenBuffer;
+        unsigned char* Shown = Processor->FrontBuffer;
+        __cbAtomicStore(Processor->FrontBuffer, Frame);
+        __cbAtomicFence();
+        
+        // Draw on into the frame shown until now, unless the host is still reading it: then into the spare,
+        // which the host let go of when it latched since (it can only latch the front buffer)
+        if(__cbAtomicLoad(Processor->LatchedBuffer) == Shown)
+        {
+            Processor->ScreenBuffer = Processor->SpareBuffer;
+            Processor->SpareBuffer = Shown;
+        }
+        else
+            Processor->ScreenBuffer = Shown;
+        
+        // Keep drawing on top of the frame just shown
+        memcpy(Processor->ScreenBuffer, Frame, Processor->ScreenPitch * Processor->ScreenHeight);
+        
+        // What changed in the back buffer now changed on screen
+        for(size_t Y = 0; Y < Processor->ScreenHeight; Y++)
+        {
+            size_t Start = Processor->BackDirtyRows[Y * 2], End = Processor->BackDirtyRows[Y * 2 + 1];
+            if(Start >= End)
+                continue;
+            
+            size_t* Dirty = Processor->DirtyRows + Y * 2;
+            if(Dirty[0] >= Dirty[1] || Start < Dirty[0])
+                Dirty[0] = Start;
+            if(End > Dirty[1])
+                Dirty[1] = End;
+            Processor->BackDirtyRows[Y * 2] = Processor->BackDirtyRows[Y * 2 + 1] = 0;
+        }
+    }
+    
+    // Whether or not it was drawn in a back buffer, the frame is finished
+    cbRecord_Frame(Processor);
+    __cbAtomicStore(Processor->FrameCount, Processor->FrameCount + 1);
+    cbStep_PostDrawEvent(Processor, cbDrawEvent_Flip, 0, 0, 0, 0, Processor->ScreenWidth, Processor->ScreenHeight, 0, NULL);
     
     // No error, ever
     return cbError_None;
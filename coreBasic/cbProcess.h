@@ -25,29 +25,153 @@
 // Step through a single instruction; returns a failure description enumeration
 __cbEXPORT cbError cbStep(cbVirtualMachine* Processor, cbInterrupt* InterruptState);
 
+// Keep executing instructions until either the given number of ticks have run, the program halts,
+// an interrupt is raised, a request is posted, or an error occurs; returns a failure description enumeration,
+// where a halt is reported as cbError_Halted right away and an interrupt is posted as with cbStep
+__cbEXPORT cbError cbRun(cbVirtualMachine* Processor, size_t MaxTicks, cbInterrupt* InterruptState);
+
+// Post requests (cbRequest flags) to the processor; safe to call from any thread while it runs. Runs look for
+// them before starting and at every backward jump, so even a busy loop gives control back within a few
+// instructions, without the host having to run in small batches
+__cbEXPORT void cbStep_PostRequest(cbVirtualMachine* Processor, unsigned int Requests);
+
+// Take back the given requests (cbRequest flags), returning which of them were posted; safe to call from any thread
+__cbEXPORT unsigned int cbStep_TakeRequests(cbVirtualMachine* Processor, unsigned int Requests);
+
 // Release (set to false) the interrupt state; completing the input-interruption
 __cbEXPORT void cbStep_ReleaseInterrupt(cbVirtualMachine* Processor, const char* UserInput);
 
-// Allows read-access to the given screen buffer, copying n bytes from the screen buffer into the output
-// Note that n is defined as the total number of bytes representing the screen, but it is 2-bits per pixel,
-// thus n = (ScreenWidth * ScreenHeight) / 4, with the origin in the bottom left of the screen
+// Returns the time (of cbUtil_GetTime) the processor wakes up at, while waiting (cbInterrupt_Wait) in a wait(); runs
+// return right away until then, so a host or scheduler can put the processor aside and run others in the meantime.
+// Waits need no user input: the wait is over once the time passes, or the host releases the interrupt early
+__cbEXPORT unsigned long long cbStep_GetWakeTime(cbVirtualMachine* Processor);
+
+// Limit the program to the given number of ticks, and the given number of milliseconds of wall-clock time (waits
+// included), both from now on, where zero means no limit; replaces any previous limits. Past either, steps and runs
+// fail with cbError_TimeLimit. The tick limit only shortens runs, and the clock is only looked at every so many ticks
+// (and while waiting on input). A program interrupted on its last tick reports the interrupt first, then the limit
+__cbEXPORT void cbStep_SetTimeLimit(cbVirtualMachine* Processor, size_t MaxTicks, unsigned long long MaxTime);
+
+// Allows read-access to the screen buffer shown to the host (the front buffer, with a back buffer), of ScreenHeight rows ScreenPitch bytes apart, with the
+// origin in the bottom left of the screen. Each byte is a pixel's color (0 - 3), or if the screen is packed
+// (see cbOption_PackedScreen), four pixels of 2-bits each, with the left-most pixel in the lowest bits.
+// With a back buffer, the front buffer is latched: it stays a whole, unchanged frame until the next call, even
+// while the processor runs (and flips) on another thread; only one host thread may read the screen. Without
+// one, the screen is drawn into as it's read
 __cbEXPORT const unsigned char* const cbStep_GetScreenBuffer(cbVirtualMachine* Processor);
 
+// Returns the number of frames shown so far (see cbOption_DoubleBuffer), so a host only needs to render the
+// screen again once it changes; safe to call from another thread while the processor runs
+__cbEXPORT size_t cbStep_GetFrameCount(cbVirtualMachine* Processor);
+
+// Returns the color (0 - 3) of the given pixel, whichever the screen format; 0 if out of bounds. Reads
+// (and latches) the screen as cbStep_GetScreenBuffer does
+__cbEXPORT int cbStep_GetScreenPixel(cbVirtualMachine* Processor, size_t X, size_t Y);
+
+// Write the regions of the screen changed since the last call into the given array, returning the number
+// of regions written; once out of room, the last region grows to cover all of the remaining changes.
+// The screen is then considered clean, so a host only needs to redraw what these regions cover. Not safe to call
+// while the processor runs on another thread (see cbRunner.h); follow the draw queue or frame count instead
+__cbEXPORT size_t cbStep_GetDirtyRegions(cbVirtualMachine* Processor, cbScreenRegion* Regions, size_t MaxRegions);
+
+// Set when the output buffer is written out to the output sink (a set of cbFlush flags), and the size
+// of the buffer; any buffered output is written out first. Returns an error if the buffer can't be allocated
+__cbEXPORT cbError cbStep_SetOutputPolicy(cbVirtualMachine* Processor, unsigned int FlushPolicy, size_t BufferSize);
+
+// Write out all buffered output to the output sink
+__cbEXPORT void cbStep_FlushOutput(cbVirtualMachine* Processor);
+
+// Set the sink all output is written out to, with its context; any buffered output goes to the old sink
+// first. A null sink drops all output. With no output buffer (a size of 0), each disp is handed straight
+// from the static data or formatting buffer, without copies
+__cbEXPORT void cbStep_SetOutputSink(cbVirtualMachine* Processor, cbOutputSink Sink, void* Context);
+
+// Set the provider asked for user input whenever the processor is interrupted, with its context; a
+// null provider leaves input to the host (see cbStep_ReleaseInterrupt)
+__cbEXPORT void cbStep_SetInputProvider(cbVirtualMachine* Processor, cbInputProvider Provider, void* Context);
+
+// Attach all of the user input up front (i.e. from memory or a mapped file), which the host keeps around
+// while attached; null detaches it. Input and getKey then take it a word at a time, as the file input
+// provider would, straight from the buffer without interrupting; only once it runs out do they interrupt
+__cbEXPORT void cbStep_SetInputBuffer(cbVirtualMachine* Processor, const char* Buffer, size_t Length);
+
+// Default sink and provider, with a c-style file stream (FILE*) as context: output is written and flushed
+// as is, and input is read a word at a time (none if the stream ran out)
+__cbEXPORT void cbStep_FileOutputSink(void* Context, const char* Text, size_t Length);
+__cbEXPORT bool cbStep_FileInputProvider(void* Context, cbInterrupt Interrupt, char* Input, size_t InputSize);
+
+// Set the size of the draw queue (rounded up to a power of two), which records each drawing op as an event
+// for the host; a size of 0 (the default) turns it off. Any queued events are dropped. Must not be called
+// while the processor runs on another thread. Returns an error if the queue can't be allocated
+__cbEXPORT cbError cbStep_SetDrawQueue(cbVirtualMachine* Processor, size_t QueueSize);
+
+// Take up to the given number of events off the draw queue, in the order they were drawn, returning the number
+// of events taken; if any were dropped since the last call, a resync event follows them (once there is room).
+// Safe to call from one thread while the processor runs on another, so rendering can be decoupled from execution
+__cbEXPORT size_t cbStep_GetDrawEvents(cbVirtualMachine* Processor, cbDrawEvent* Events, size_t MaxEvents);
+
+// Set up a surface over the given host pixels, which must fit the screen at the given (integer) scale, with
+// the RGBA bytes of each of the four colors as its palette; returns an error if anything is null or the scale is 0
+__cbEXPORT cbError cbStep_InitSurface(cbSurface* Surface, void* Pixels, ptrdiff_t Pitch, cbSurfaceFormat Format, size_t Scale, const unsigned char Palette[4][4]);
+
+// Convert the given regions of the screen shown to the host (all of it if null) into the surface, row Y of the screen
+// becoming rows Y * Scale onwards; four pixels are expanded at a time through the surface's table, then rows are
+// copied to scale up. Pair with cbStep_GetDirtyRegions to only convert what changed, when on the processor's own
+// thread; from another thread, convert the whole screen instead. Reads (and latches) the screen as
+// cbStep_GetScreenBuffer does, so with a back buffer a whole frame is converted
+__cbEXPORT void cbStep_PresentScreen(cbVirtualMachine* Processor, const cbSurface* Surface, const cbScreenRegion* Regions, size_t RegionCount);
+
 /*** Helper Functions ***/
 
+// Allocate a cleared screen of the given size, in the format the processor's options ask for (with a back
+// buffer if asked for), with all of it marked as changed; returns an error if it can't be allocated
+cbError cbStep_InitScreen(cbVirtualMachine* Processor, size_t ScreenWidth, size_t ScreenHeight);
+
+// Execute a single (stack machine) instruction, without taking a tick nor moving past it; used by
+// the JIT compiler for the ops it does not translate itself
+cbError cbStep_ExecuteInstruction(cbVirtualMachine* Processor, cbInstruction* Instruction);
+
+// Pre-decode the code segment into the internal execution form used by cbRun, resolving jump targets,
+// data-segment and frame variable addresses, and op handlers; must be called once a program is placed into memory.
+// Returns an error if an op is unknown or data is out of bounds
+cbError cbStep_Decode(cbVirtualMachine* Processor);
+
 // Takes two variables from the stack that have been pushed previously and post the result in said stack
 // If there is an error (mismatched types), an error is returned, else no error is posted
 cbError cbStep_MathOp(cbVirtualMachine* Processor, cbInstruction* Instruction);
 
-// Takes the two variables from the stack (a and b, respect), and places A into B, assuming
-// B is a variable, while A can either be a literal or variable. If B is not a variable, an error
-// is returned
+// Pops the value off the stack and places it into the variable at the instruction's arg
+// (its slot from the stack base); never fails, since only the compiler names the variable
 cbError cbStep_Store(cbVirtualMachine* Processor, cbInstruction* Instruction);
 
-// Print the element on the stack, unless it is currently a variable reference (i.e. offset)
+// Print the element on the stack (always a value, never a variable reference)
 // Shrinks stack appropriatly appropriately
 cbError cbStep_Disp(cbVirtualMachine* Processor, cbInstruction* Instruction);
 
+// Print the given variable into the output buffer, flushing as the policy asks for; shared by all engines
+cbError cbStep_DispVariable(cbVirtualMachine* Processor, cbVariable* A);
+
+// Parse a word of user input the way the input op reads it: digits as an integer, digits around a decimal
+// point as a float, "true" or "false" as a boolean, else -1; in a single pass, with no copies
+void cbStep_ParseInput(const char* Text, size_t Length, cbVariable* UserVar);
+
+// Take the next word of the attached input buffer as the result of the given interrupt (input or getKey);
+// returns false, leaving the variable as is, if there is no input buffer or it ran out
+bool cbStep_TakeInput(cbVirtualMachine* Processor, cbInterrupt Interrupt, cbVariable* UserVar);
+
+// Push the user input taken from the input buffer onto the stack, or if there is none, raise the op's
+// interrupt (input or getKey) to wait on the host
+cbError cbStep_Input(cbVirtualMachine* Processor, cbInstruction* Instruction);
+
+// If interrupted, ask the input provider (if any) for the user input and release the interrupt with it;
+// returns true if the processor is no longer interrupted
+bool cbStep_PollInput(cbVirtualMachine* Processor);
+
+// Flush the output buffer if the processor's state (an interrupt, a halt, or the given run-time
+// error) is one the flush policy asks for, and let the screen recorder (if any) take a frame; called
+// once control goes back to the host
+void cbStep_FlushOnState(cbVirtualMachine* Processor, cbError Error);
+
 // If the integer on the stack is 0 (false), then jump to the instructions arg, else (true),
 // continue flow of execution without any interruption
 cbError cbStep_If(cbVirtualMachine* Processor, cbInstruction* Instruction);
@@ -56,14 +180,46 @@ cbError cbStep_If(cbVirtualMachine* Processor, cbInstruction* Instruction);
 // true or false on the stack (as booleans)
 cbError cbStep_CompOp(cbVirtualMachine* Processor, cbInstruction* Instruction);
 
+// Same as the math and comparison ops, for the type-specialized ops: both variables are
+// known to be integers, so no type checks are done
+cbError cbStep_IntOp(cbVirtualMachine* Processor, cbInstruction* Instruction);
+
+// Fused "var = var <op> literal": applies the math op of the following operand slot straight
+// into the variable, then skips over the operand slot
+cbError cbStep_SetMath(cbVirtualMachine* Processor, cbInstruction* Instruction);
+
+// Fused "if var <op> literal": compares the variable against the literal of the following operand
+// slot, then skips both operand slots, taking the jump of the trailing if when false
+cbError cbStep_IfComp(cbVirtualMachine* Processor, cbInstruction* Instruction);
+
 // Apply boolean logical operators of not, and, or on the stack
 cbError cbStep_LogicOp(cbVirtualMachine* Processor, cbInstruction* Instruction);
 
 // Takes and pops off the three integers from the stack for position (tuple), and pixel color (range from 0 - 3)
 cbError cbStep_Output(cbVirtualMachine* Processor, cbInstruction* Instruction);
 
-// Clear out the output (of the screen, not file streams) to white
-// This is done by placing a clear instruction (three MAX_UINT) integers into the screen buffer
+// Draw the pixel at the given position with the given color; shared by all engines
+cbError cbStep_OutputPixel(cbVirtualMachine* Processor, cbVariable* X, cbVariable* Y, cbVariable* C);
+
+// Takes and pops off the arguments of a bulk drawing op, and draws it clipped to the screen, a row at a time:
+// line(x0, y0, x1, y1, color), rect(x, y, width, height, color), or blit(x, y, width, sprite), where the
+// sprite is a string of the pixel colors ('0' - '3', anything else is transparent) in rows of the given width
+cbError cbStep_Draw(cbVirtualMachine* Processor, cbInstruction* Instruction);
+
+// Takes and pops off the number of milliseconds to wait for (an integer or float; none if negative), and
+// raises the wait interrupt until then
+cbError cbStep_Wait(cbVirtualMachine* Processor, cbInstruction* Instruction);
+
+// Wait for the given number of milliseconds; shared by all engines
+cbError cbStep_WaitFor(cbVirtualMachine* Processor, cbVariable* Duration);
+
+// Clear out the output (of the screen, not the text output) to white, marking the whole screen as changed
 cbError cbStep_Clear(cbVirtualMachine* Processor, cbInstruction* Instruction);
 
+// Finish the frame: with a back buffer, it becomes the front buffer shown to the host, then is copied into the
+// new back buffer to keep drawing on: the old front buffer, or the spare one if the host still has the old one
+// latched (see cbStep_GetScreenBuffer), so a frame the host reads is never drawn into while it reads it. Either
+// way, the frame count grows and a flip event is posted
+cbError cbStep_Flip(cbVirtualMachine* Processor, cbInstruction* Instruction);
+
 #endif
@@ -0,0 +1,148 @@
+/***************************************************************
+ 
+ cBasic - coreBasic - BASIC Language Interpreter on iOS
+ Copyright 2011 Jeremy Bridon - See License.txt for info
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+***************************************************************/
+
+#include "cbRecord.h"
+
+// Recorder state: the colors of the last frame (a pixel per byte), and the frame being encoded
+typedef struct __cbRecorder
+{
+    cbOutputSink Sink;
+    void* Context;
+    size_t TickInterval;
+    size_t LastTick;
+    
+    unsigned char* Frame;
+    unsigned char* Encoded;
+} cbRecorder;
+
+// Size of a frame's tick count and payload length
+static const size_t cbRecord_FrameHeaderSize = 12;
+
+// Write the given integer in little-endian order, returning past it
+static unsigned char* cbRecord_WriteInt(unsigned char* Out, unsigned long long Value, size_t Bytes)
+{
+    for(size_t i = 0; i < Bytes; i++)
+        *(Out++) = (unsigned char)(Value >> (i * 8));
+    return Out;
+}
+
+cbError cbRecord_Start(cbVirtualMachine* Processor, cbOutputSink Sink, void* Context, size_t TickInterval)
+{
+    if(Processor == NULL || Sink == NULL)
+        return cbError_Null;
+    
+    cbRecord_Stop(Processor);
+    
+    // Frames are at worst a run per pixel
+    size_t PixelCount = Processor->ScreenWidth * Processor->ScreenHeight;
+    cbRecorder* Recorder = malloc(sizeof(cbRecorder));
+    if(Recorder == NULL)
+        return cbError_Overflow;
+    Recorder->Frame = calloc(PixelCount + 1, 1);
+    Recorder->Encoded = malloc(cbRecord_FrameHeaderSize + PixelCount);
+    if(Recorder->Frame == NULL || Recorder->Encoded == NULL)
+    {
+        free(Recorder->Frame);
+        free(Recorder->Encoded);
+        free(Recorder);
+        return cbError_Overflow;
+    }
+    
+    Recorder->Sink = Sink;
+    Recorder->Context = Context;
+    Recorder->TickInterval = TickInterval;
+    Recorder->LastTick = Processor->Ticks;
+    Processor->Recorder = Recorder;
+    
+    // Stream header
+    unsigned char Header[10];
+    memcpy(Header, cbRecord_Magic, sizeof(cbRecord_Magic));
+    Header[4] = cbRecord_Version;
+    Header[5] = 0;
+    cbRecord_WriteInt(cbRecord_WriteInt(Header + 6, Processor->ScreenWidth, 2), Processor->ScreenHeight, 2);
+    Sink(Context, (const char*)Header, sizeof(Header));
+    
+    // Whatever is on screen already is the first frame
+    cbRecord_Frame(Processor);
+    return cbError_None;
+}
+
+void cbRecord_Stop(cbVirtualMachine* Processor)
+{
+    if(Processor == NULL || Processor->Recorder == NULL)
+        return;
+    
+    cbRecord_Frame(Processor);
+    
+    cbRecorder* Recorder = Processor->Recorder;
+    free(Recorder->Frame);
+    free(Recorder->Encoded);
+    free(Recorder);
+    Processor->Recorder = NULL;
+}
+
+void cbRecord_Frame(cbVirtualMachine* Processor)
+{
+    cbRecorder* Recorder = Processor->Recorder;
+    if(Recorder == NULL)
+        return;
+    Recorder->LastTick = Processor->Ticks;
+    
+    // XOR each pixel against the last frame (keeping the new one), collecting runs of the same value
+    // On the processor's own thread, so the front buffer is read as is, rather than latched as the host does
+    const unsigned char* Screen = (Processor->FrontBuffer != NULL) ? Processor->FrontBuffer : Processor->ScreenBuffer;
+    bool IsPacked = (Processor->Options & cbOption_PackedScreen) != 0;
+    unsigned char* Frame = Recorder->Frame;
+    unsigned char* Payload = Recorder->Encoded + cbRecord_FrameHeaderSize;
+    unsigned char* Out = Payload;
+    bool Changed = false;
+    int RunValue = 0, RunLength = 0;
+    for(size_t Y = 0; Y < Processor->ScreenHeight; Y++)
+    {
+        const unsigned char* Row = Screen + Processor->ScreenPitch * Y;
+        for(size_t X = 0; X < Processor->ScreenWidth; X++, Frame++)
+        {
+            int Color = (IsPacked ? (Row[X / 4] >> ((X % 4) * 2)) : Row[X]) & 3;
+            int Value = Color ^ *Frame;
+            *Frame = Color;
+            Changed |= (Value != 0);
+            
+            if(RunLength > 0 && (Value != RunValue || RunLength == 64))
+            {
+                *(Out++) = (unsigned char)((RunValue << 6) | (RunLength - 1));
+                RunLength = 0;
+            }
+            RunValue = Value;
+            RunLength++;
+        }
+    }
+    if(RunLength > 0)
+        *(Out++) = (unsigned char)((RunValue << 6) | (RunLength - 1));
+    
+    // Nothing to say if nothing changed
+    if(!Changed)
+        return;
+    
+    size_t PayloadLength = Out - Payload;
+    cbRecord_WriteInt(cbRecord_WriteInt(Recorder->Encoded, Processor->Ticks, 8), PayloadLength, 4);
+    Recorder->Sink(Recorder->Context, (const char*)Recorder->Encoded, cbRecord_FrameHeaderSize + PayloadLength);
+}
+
+void cbRecord_OnState(cbVirtualMachine* Processor, cbError Error)
+{
+    cbRecorder* Recorder = Processor->Recorder;
+    if(Recorder == NULL)
+        return;
+    
+    bool IsStopped = Processor->Halted || (Error != cbError_None && Error != cbError_Halted);
+    bool IsDue = Recorder->TickInterval > 0 && Processor->Ticks - Recorder->LastTick >= Recorder->TickInterval;
+    if(IsStopped || IsDue)
+        cbRecord_Frame(Processor);
+}
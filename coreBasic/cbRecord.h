@@ -0,0 +1,63 @@
+/***************************************************************
+ 
+ cBasic - coreBasic - BASIC Language Interpreter on iOS
+ Copyright 2011 Jeremy Bridon - See License.txt for info
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: cbRecord.h/c
+ Desc: Screen recorder: encodes what a program shows on screen
+ into a compact stream of frame deltas, for headless recording
+ or remote display.
+ 
+***************************************************************/
+
+#ifndef __CBRECORD_H__
+#define __CBRECORD_H__
+
+/*** Needed includes ***/
+
+#include "cbUtil.h"
+#include "cbTypes.h"
+#include "cbProcess.h"
+
+/*
+ Frame stream format (all integers little-endian):
+ 
+ Header: "cbFS", version (1 byte, currently 1), a zero byte, then the screen width and height (2 bytes each)
+ Frame:  tick count when taken (8 bytes), payload length (4 bytes), then the payload; the tick count is
+         only kept up to date between runs, so a frame taken within a run (on a clear or flip) may carry
+         the tick count the run started on
+ 
+ The payload is the XOR of each pixel's color (0 - 3) against the previous frame (all zero before the
+ first one), row by row from the screen's origin, as runs: each byte holds the XOR value in its two top
+ bits, and the run length minus one (1 - 64 pixels) in the other six. Frames only follow a change, so
+ an unchanged screen costs nothing; see tools/cbFrameDecode.c for a decoder
+*/
+
+// Frame stream signature and version
+static const char cbRecord_Magic[4] = { 'c', 'b', 'F', 'S' };
+static const unsigned char cbRecord_Version = 1;
+
+/*** Recording Functions ***/
+
+// Start recording the screen shown to the host into a frame stream written to the given sink (i.e.
+// cbStep_FileOutputSink with a FILE*), replacing any previous recording. A frame is taken on each flip (and
+// each clear without a back buffer), and whenever control goes back to the host once at least TickInterval ticks
+// went by since the last one (0 for never), or the program stops. Returns an error if the recorder can't be allocated
+__cbEXPORT cbError cbRecord_Start(cbVirtualMachine* Processor, cbOutputSink Sink, void* Context, size_t TickInterval);
+
+// Take a last frame (if the screen changed) and stop recording
+__cbEXPORT void cbRecord_Stop(cbVirtualMachine* Processor);
+
+/*** Helper Functions ***/
+
+// Encode the screen shown to the host as a frame, if it changed since the last one
+void cbRecord_Frame(cbVirtualMachine* Processor);
+
+// Take a frame if the tick interval is up, or the program stopped (a halt or the given run-time error);
+// called once control goes back to the host
+void cbRecord_OnState(cbVirtualMachine* Processor, cbError Error);
+
+#endif
@@ -0,0 +1,303 @@
+/***************************************************************
+ 
+ cBasic - coreBasic - BASIC Language Interpreter on iOS
+ Copyright 2011 Jeremy Bridon - See License.txt for info
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+***************************************************************/
+
+#include "cbRunner.h"
+
+#ifdef __cbRUNNER__
+
+#include <pthread.h>
+#include <time.h>
+
+// Runner state: the worker thread, the state it posts, and the output / input rings; the host's pause and
+// stop go through the processor's own requests. Ring indices run freely (wrapping with a mask), each written
+// by only one side, so the rings need no locks
+struct __cbRunner
+{
+    cbVirtualMachine* Processor;
+    pthread_t Thread;
+    bool IsJoined;
+    
+    int State;
+    cbError Error;
+    
+    char* Output;
+    size_t OutputSize;
+    size_t OutputHead, OutputTail;
+    
+    char* Input;
+    size_t InputSize;
+    size_t InputHead, InputTail;
+};
+
+// Ticks run per batch; requests cut a batch short, so it only bounds how often the output is flushed
+static const size_t cbRunner_BatchTicks = 65536;
+
+// Give the processor's time away for a while, when there is nothing to do
+static void cbRunner_Idle()
+{
+    struct timespec Wait = { 0, 500000 };
+    nanosleep(&Wait, NULL);
+}
+
+// Copy into and out of a ring, starting at the given (free-running) index
+static void cbRunner_CopyIn(char* Ring, size_t RingSize, size_t Index, const char* Data, size_t Length)
+{
+    size_t Start = Index & (RingSize - 1);
+    size_t First = (Length < RingSize - Start) ? Length : RingSize - Start;
+    memcpy(Ring + Start, Data, First);
+    memcpy(Ring, Data + First, Length - First);
+}
+
+static void cbRunner_CopyOut(const char* Ring, size_t RingSize, size_t Index, char* Data, size_t Length)
+{
+    size_t Start = Index & (RingSize - 1);
+    size_t First = (Length < RingSize - Start) ? Length : RingSize - Start;
+    memcpy(Data, Ring + Start, First);
+    memcpy(Data + First, Ring, Length - First);
+}
+
+// Output sink of the processor, on the worker: queue all of the text, waiting on the host to make room
+// if need be (output is never dropped, unless the host wants the worker stopped)
+static void cbRunner_OutputSink(void* Context, const char* Text, size_t Length)
+{
+    cbRunner* Runner = Context;
+    while(Length > 0)
+    {
+        size_t Head = Runner->OutputHead;
+        size_t Room = Runner->OutputSize - (Head - __cbAtomicLoad(Runner->OutputTail));
+        if(Room == 0)
+        {
+            if(__cbAtomicLoad(Runner->Processor->Request) & cbRequest_Stop)
+                return;
+            cbRunner_Idle();
+            continue;
+        }
+        
+        size_t Count = (Length < Room) ? Length : Room;
+        cbRunner_CopyIn(Runner->Output, Runner->OutputSize, Head, Text, Count);
+        __cbAtomicStore(Runner->OutputHead, Head + Count);
+        Text += Count;
+        Length -= Count;
+    }
+}
+
+// Input provider of the processor, on the worker: take the next whole (null-terminated) reply, if the host queued one
+static bool cbRunner_InputProvider(void* Context, cbInterrupt Interrupt, char* Input, size_t InputSize)
+{
+    cbRunner* Runner = Context;
+    size_t Tail = Runner->InputTail;
+    size_t Head = __cbAtomicLoad(Runner->InputHead);
+    
+    size_t Length = 0;
+    while(Tail + Length < Head && Runner->Input[(Tail + Length) & (Runner->InputSize - 1)] != 0)
+        Length++;
+    if(Tail + Length >= Head)
+        return false;
+    
+    // Anything past the given size is cut off; no longer waiting by the time the host sees the reply taken
+    size_t Count = (Length < InputSize - 1) ? Length : InputSize - 1;
+    cbRunner_CopyOut(Runner->Input, Runner->InputSize, Tail, Input, Count);
+    Input[Count] = 0;
+    __cbAtomicStore(Runner->State, cbRunnerState_Running);
+    __cbAtomicStore(Runner->InputTail, Tail + Length + 1);
+    return true;
+}
+
+// Worker thread: run the program in batches until it stops or the host asks it to, keeping the host posted
+static void* cbRunner_Main(void* Context)
+{
+    cbRunner* Runner = Context;
+    cbVirtualMachine* Processor = Runner->Processor;
+    cbError Error = cbError_None;
+    cbInterrupt Interrupt = cbInterrupt_None;
+    
+    while(Error == cbError_None)
+    {
+        // Whatever the batch wrote out is the host's right away
+        Error = cbRun(Processor, cbRunner_BatchTicks, &Interrupt);
+        cbStep_FlushOutput(Processor);
+        
+        // Held by the host (the run returned right away), or waiting around if the input isn't there yet
+        if(Error == cbError_None && __cbAtomicLoad(Processor->Request) != cbRequest_None)
+        {
+            __cbAtomicStore(Runner->State, cbRunnerState_Paused);
+            cbRunner_Idle();
+            continue;
+        }
+        bool IsWaiting = (Error == cbError_None && !cbStep_PollInput(Processor));
+        bool IsSleeping = (IsWaiting && Processor->InterruptState == cbInterrupt_Wait);
+        __cbAtomicStore(Runner->State, IsSleeping ? cbRunnerState_Sleeping : (IsWaiting ? cbRunnerState_Waiting : cbRunnerState_Running));
+        if(IsWaiting)
+            cbRunner_Idle();
+    }
+    
+    // Stopped by the host, rather than by the program
+    Runner->Error = (Error == cbError_Stopped) ? cbError_None : Error;
+    __cbAtomicStore(Runner->State, cbRunnerState_Stopped);
+    return NULL;
+}
+
+cbRunner* cbRunner_Start(cbVirtualMachine* Processor, size_t OutputSize, size_t InputSize)
+{
+    if(Processor == NULL)
+        return NULL;
+    
+    // Indices wrap around with a mask
+    cbRunner* Runner = calloc(1, sizeof(cbRunner));
+    if(Runner == NULL)
+        return NULL;
+    for(Runner->OutputSize = 1; Runner->OutputSize < OutputSize; Runner->OutputSize *= 2);
+    for(Runner->InputSize = 1; Runner->InputSize < InputSize; Runner->InputSize *= 2);
+    Runner->Output = malloc(Runner->OutputSize);
+    Runner->Input = malloc(Runner->InputSize);
+    if(Runner->Output == NULL || Runner->Input == NULL)
+    {
+        free(Runner->Output);
+        free(Runner->Input);
+        free(Runner);
+        return NULL;
+    }
+    
+    // All I/O now goes through the rings
+    Runner->Processor = Processor;
+    Runner->State = cbRunnerState_Running;
+    cbStep_SetOutputSink(Processor, cbRunner_OutputSink, Runner);
+    cbStep_SetInputProvider(Processor, cbRunner_InputProvider, Runner);
+    
+    if(pthread_create(&Runner->Thread, NULL, cbRunner_Main, Runner) != 0)
+    {
+        cbStep_SetOutputSink(Processor, NULL, NULL);
+        cbStep_SetInputProvider(Processor, NULL, NULL);
+        free(Runner->Output);
+        free(Runner->Input);
+        free(Runner);
+        return NULL;
+    }
+    return Runner;
+}
+
+void cbRunner_Pause(cbRunner* Runner, bool IsPaused)
+{
+    if(Runner == NULL || Runner->IsJoined)
+        return;
+    else if(IsPaused)
+        cbStep_PostRequest(Runner->Processor, cbRequest_Pause);
+    else
+        cbStep_TakeRequests(Runner->Processor, cbRequest_Pause);
+}
+
+cbError cbRunner_Stop(cbRunner* Runner)
+{
+    if(Runner == NULL)
+        return cbError_Null;
+    
+    // The processor is left as the worker stopped it, without the runner's own requests
+    if(!Runner->IsJoined)
+    {
+        cbStep_PostRequest(Runner->Processor, cbRequest_Stop);
+        pthread_join(Runner->Thread, NULL);
+        cbStep_TakeRequests(Runner->Processor, cbRequest_Stop | cbRequest_Pause);
+        Runner->IsJoined = true;
+    }
+    return Runner->Error;
+}
+
+void cbRunner_Release(cbRunner* Runner)
+{
+    if(Runner == NULL)
+        return;
+    
+    cbRunner_Stop(Runner);
+    cbStep_SetOutputSink(Runner->Processor, NULL, NULL);
+    cbStep_SetInputProvider(Runner->Processor, NULL, NULL);
+    free(Runner->Output);
+    free(Runner->Input);
+    free(Runner);
+}
+
+cbRunnerState cbRunner_GetState(cbRunner* Runner)
+{
+    if(Runner == NULL)
+        return cbRunnerState_Stopped;
+    
+    // Replies still queued are as good as taken
+    bool IsQueued = __cbAtomicLoad(Runner->InputTail) != Runner->InputHead;
+    int State = __cbAtomicLoad(Runner->State);
+    return (State == cbRunnerState_Waiting && IsQueued) ? cbRunnerState_Running : State;
+}
+
+size_t cbRunner_ReadOutput(cbRunner* Runner, char* Buffer, size_t BufferSize)
+{
+    if(Runner == NULL || Buffer == NULL)
+        return 0;
+    
+    size_t Tail = Runner->OutputTail;
+    size_t Available = __cbAtomicLoad(Runner->OutputHead) - Tail;
+    size_t Count = (Available < BufferSize) ? Available : BufferSize;
+    cbRunner_CopyOut(Runner->Output, Runner->OutputSize, Tail, Buffer, Count);
+    __cbAtomicStore(Runner->OutputTail, Tail + Count);
+    return Count;
+}
+
+bool cbRunner_PostInput(cbRunner* Runner, const char* Input)
+{
+    if(Runner == NULL || Input == NULL)
+        return false;
+    
+    // The reply goes in whole, terminator included, or not at all
+    size_t Length = strlen(Input) + 1;
+    size_t Head = Runner->InputHead;
+    if(Length > Runner->InputSize - (Head - __cbAtomicLoad(Runner->InputTail)))
+        return false;
+    
+    cbRunner_CopyIn(Runner->Input, Runner->InputSize, Head, Input, Length);
+    __cbAtomicStore(Runner->InputHead, Head + Length);
+    return true;
+}
+
+#else
+
+/*** Unsupported Platforms ***/
+
+cbRunner* cbRunner_Start(cbVirtualMachine* Processor, size_t OutputSize, size_t InputSize)
+{
+    // Left to the host to run
+    return NULL;
+}
+
+void cbRunner_Pause(cbRunner* Runner, bool IsPaused)
+{
+}
+
+cbError cbRunner_Stop(cbRunner* Runner)
+{
+    return cbError_Null;
+}
+
+void cbRunner_Release(cbRunner* Runner)
+{
+}
+
+cbRunnerState cbRunner_GetState(cbRunner* Runner)
+{
+    return cbRunnerState_Stopped;
+}
+
+size_t cbRunner_ReadOutput(cbRunner* Runner, char* Buffer, size_t BufferSize)
+{
+    return 0;
+}
+
+bool cbRunner_PostInput(cbRunner* Runner, const char* Input)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,67 @@
+/***************************************************************
+ 
+ cBasic - coreBasic - BASIC Language Interpreter on iOS
+ Copyright 2011 Jeremy Bridon - See License.txt for info
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: cbRunner.h/c
+ Desc: Runs a processor on its own worker thread, talking to the
+ host only through lock-free queues, so a program runs at full
+ speed while the host just drains what it produced.
+ 
+***************************************************************/
+
+#ifndef __CBRUNNER_H__
+#define __CBRUNNER_H__
+
+/*** Needed includes ***/
+
+#include "cbUtil.h"
+#include "cbTypes.h"
+#include "cbProcess.h"
+
+/*
+ The runner owns the processor's output sink and input provider while it runs: output text is
+ queued for the host (cbRunner_ReadOutput), and input is taken from the replies the host queues
+ (cbRunner_PostInput). Both are single-producer / single-consumer rings, so exactly one host thread
+ may talk to a runner. Drawing is already safe to follow from another thread: turn the draw queue on
+ (cbStep_SetDrawQueue) before starting the runner, then drain it with cbStep_GetDrawEvents, or watch
+ cbStep_GetFrameCount and present the screen with cbStep_PresentScreen. Only with a back buffer
+ (cbOption_DoubleBuffer) is a whole frame presented, since the host latches the front buffer while the
+ worker draws into another; without one, the screen may be presented half-drawn
+*/
+
+// Worker-thread runner of a processor (see cbRunner_Start)
+typedef struct __cbRunner cbRunner;
+
+/*** Runner Functions ***/
+
+// Start running the given (loaded) processor on a new worker thread, with rings of the given sizes (rounded up to
+// powers of two) for its output and input; the processor must not be touched by the host until the runner is stopped.
+// Returns null if the runner can't be allocated or started, or threads aren't supported
+__cbEXPORT cbRunner* cbRunner_Start(cbVirtualMachine* Processor, size_t OutputSize, size_t InputSize);
+
+// Ask the worker to pause (or resume) running the program, through the processor's requests (see cbStep_PostRequest),
+// so a busy program pauses within a few instructions
+__cbEXPORT void cbRunner_Pause(cbRunner* Runner, bool IsPaused);
+
+// Ask the worker to stop, and wait for it; any output still queued can be read afterwards. Returns the error the
+// program stopped on: cbError_Halted if it finished, cbError_None if it was stopped first
+__cbEXPORT cbError cbRunner_Stop(cbRunner* Runner);
+
+// Stop the runner if needed, and release it, giving the processor back to the host (without a sink nor provider)
+__cbEXPORT void cbRunner_Release(cbRunner* Runner);
+
+// Returns what the worker is up to, where waiting means the program asked for input and took every reply queued
+// so far; once stopped, cbRunner_Stop gives the error the program stopped on
+__cbEXPORT cbRunnerState cbRunner_GetState(cbRunner* Runner);
+
+// Take up to the given number of bytes of output, in order, returning the number of bytes taken (not null-terminated)
+__cbEXPORT size_t cbRunner_ReadOutput(cbRunner* Runner, char* Buffer, size_t BufferSize);
+
+// Queue a reply for the next time the program asks for input; returns false if there is no room for it yet
+__cbEXPORT bool cbRunner_PostInput(cbRunner* Runner, const char* Input);
+
+#endif
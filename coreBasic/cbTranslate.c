@@ -0,0 +1,354 @@
+/***************************************************************
+ 
+ cBasic - coreBasic - BASIC Language Interpreter on iOS
+ Copyright 2011 Jeremy Bridon - See License.txt for info
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+***************************************************************/
+
+#include "cbTranslate.h"
+
+// Templates of the translated instructions, written out at the top of every translated program. They
+// work on the same memory layout as the interpreter, with the stack pointer kept in a local (Sp) and
+// written back around anything that goes through the processor (interrupts and interpreter calls). Templates
+// that can fail take their instruction's index first, posting it as the instruction pointer for the line table
+static const char cbTranslate_Templates[] =
+    "/*** Instruction Templates ***/\n"
+    "\n"
+    "#define __cbTop ((cbVariable*)(Memory + Sp))\n"
+    "#define __cbFail(Index, ErrorCode) { Processor->InstructionPointer = ((Index) + 1) * sizeof(cbInstruction); Error = (ErrorCode); goto End; }\n"
+    "#define __cbPush(Index) Sp -= sizeof(cbVariable); if(Sp < Processor->HeapPointer) __cbFail(Index, cbError_Overflow)\n"
+    "#define __cbPop(V) (V) = __cbTop; Sp += sizeof(cbVariable)\n"
+    "\n"
+    "#define __cbLoadValue(Index, Var) { __cbPush(Index); *__cbTop = *(cbVariable*)(Frame + (Var)); }\n"
+    "#define __cbLoadData(Index, Literal) { __cbPush(Index); *__cbTop = *(cbVariable*)(Data + (Literal)); }\n"
+    "#define __cbIntOp(Op) { __cbPop(A); B = __cbTop; B->Data.Int = B->Data.Int Op A->Data.Int; B->Type = cbVariableType_Int; }\n"
+    "#define __cbIntDivOp(Index, Op) { __cbPop(A); B = __cbTop; if(A->Data.Int == 0) __cbFail(Index, cbError_DivZero); B->Data.Int = B->Data.Int Op A->Data.Int; B->Type = cbVariableType_Int; }\n"
+    "#define __cbStoreToSlot(Var) { __cbPop(A); *(cbVariable*)(Frame + (Var)) = *A; }\n"
+    "#define __cbIf(Index, Label) { __cbPop(A); \\\n"
+    "    if(A->Type == cbVariableType_Int) { if(A->Data.Int == 0) goto Label; } \\\n"
+    "    else if(A->Type == cbVariableType_Float) { if(A->Data.Float == 0) goto Label; } \\\n"
+    "    else if(A->Type == cbVariableType_Bool) { if(A->Data.Bool == 0) goto Label; } \\\n"
+    "    else __cbFail(Index, cbError_TypeMismatch); }\n"
+    "#define __cbSetMath(Index, Var, Op, Literal) { B = (cbVariable*)(Frame + (Var)); if(B->Type != cbVariableType_Int) __cbFail(Index, cbError_TypeMismatch); B->Data.Int = B->Data.Int Op (Literal); }\n"
+    "#define __cbSetMathFail(Index, Var, ErrorCode) { B = (cbVariable*)(Frame + (Var)); if(B->Type != cbVariableType_Int) __cbFail(Index, cbError_TypeMismatch); __cbFail(Index, ErrorCode); }\n"
+    "#define __cbIfComp(Index, Var, Op, Literal, Label) { B = (cbVariable*)(Frame + (Var)); if(B->Type != cbVariableType_Int) __cbFail(Index, cbError_TypeMismatch); if(!(B->Data.Int Op (Literal))) goto Label; }\n"
+    "#define __cbInterrupt(State) { Processor->InterruptState = (State); Processor->StackPointer = Sp; cbTranslate_Interrupt(Processor); Sp = Processor->StackPointer; }\n"
+    "#define __cbExecute(Index) { Processor->StackPointer = Sp; Error = cbStep_ExecuteInstruction(Processor, Code + (Index)); Sp = Processor->StackPointer; if(Error != cbError_None) __cbFail(Index, Error); }\n"
+    "#define __cbExecuteInterrupt(Index) { __cbExecute(Index); if(Processor->InterruptState != cbInterrupt_None) __cbInterrupt(Processor->InterruptState); }\n"
+    "\n";
+
+// C operator of each generic math and comparison op, from add to lesseq
+static const char cbTranslate_Operators[][3] = { "+", "-", "*", "/", "%", "==", "!=", ">", ">=", "<", "<=" };
+
+// Returns the instruction index a relative jump lands on, or the instruction count if it leaves the code
+static size_t cbTranslate_GetTarget(size_t Index, int Arg, size_t Count)
+{
+    long Destination = (long)Index + Arg;
+    if(Destination < 0 || Destination > (long)Count)
+        Destination = Count;
+    return (size_t)Destination;
+}
+
+// Write out the label name of the given jump target
+static void cbTranslate_WriteLabel(FILE* OutFile, size_t Target, size_t Count)
+{
+    if(Target >= Count)
+        fprintf(OutFile, "OutOfCode");
+    else
+        fprintf(OutFile, "I%lu", Target);
+}
+
+/*** Translation ***/
+
+cbError cbTranslate_WriteProgram(cbVirtualMachine* Processor, const char* SourceName, FILE* OutFile)
+{
+    // Ignore if null
+    if(Processor == NULL || OutFile == NULL)
+        return cbError_Null;
+    
+    // Only stack machine code is supported
+    if(Processor->Options & cbOption_RegisterMachine)
+        return cbError_UnknownOp;
+    
+    /*** Validate & Find Jump Targets ***/
+    
+    size_t Count = Processor->DataPointer / sizeof(cbInstruction);
+    cbInstruction* Code = (cbInstruction*)Processor->Memory;
+    
+    // Jump targets get labels; the operand slots of fused ops are not translated, so can't be jumped into
+    bool* IsTarget = calloc(Count + 1, sizeof(bool));
+    bool* IsOperand = calloc(Count + 1, sizeof(bool));
+    if(IsTarget == NULL || IsOperand == NULL)
+    {
+        free(IsTarget);
+        free(IsOperand);
+        return cbError_Overflow;
+    }
+    
+    cbError Error = cbError_None;
+    for(size_t i = 0; i < Count && Error == cbError_None; i++)
+    {
+        cbInstruction* Instruction = Code + i;
+        
+        // Ops are never checked in the translated program, so reject the program now
+        if((unsigned int)Instruction->Op >= (unsigned int)cbOpsCount)
+            Error = cbError_UnknownOp;
+        
+        // Jumps
+        else if(Instruction->Op == cbOps_If || Instruction->Op == cbOps_Goto)
+            IsTarget[cbTranslate_GetTarget(i, Instruction->Arg, Count)] = true;
+        
+        // Variable slots must be within the stack
+        else if((Instruction->Op == cbOps_LoadValue || Instruction->Op == cbOps_StoreToSlot) &&
+                (Instruction->Arg >= 0 || (size_t)-(long)Instruction->Arg > Processor->StackBasePointer - Processor->HeapPointer))
+            Error = cbError_Overflow;
+        
+        // Literals must be within the static data; fused ops must hold the kind of op they fuse
+        else if(Instruction->Op == cbOps_LoadData || Instruction->Op == cbOps_SetMath || Instruction->Op == cbOps_IfComp)
+        {
+            size_t OperandSlots = cbUtil_GetOperandSlots(Instruction->Op);
+            cbInstruction* Operand = (OperandSlots > 0) ? Instruction + 1 : Instruction;
+            if(i + OperandSlots >= Count)
+                Error = cbError_Overflow;
+            else if(Operand->Arg < 0 || Processor->DataPointer + Operand->Arg + sizeof(cbVariable) > Processor->HeapPointer)
+                Error = cbError_Overflow;
+            else if(Instruction->Op == cbOps_SetMath && !(Operand->Op >= cbOps_Add && Operand->Op <= cbOps_Mod))
+                Error = cbError_UnknownOp;
+            else if(Instruction->Op == cbOps_IfComp && (!(Operand->Op >= cbOps_Eq && Operand->Op <= cbOps_LessEq) || Instruction[2].Op != cbOps_If))
+                Error = cbError_UnknownOp;
+            
+            // The trailing if of a comparison jumps as well
+            if(Error == cbError_None && Instruction->Op == cbOps_IfComp)
+                IsTarget[cbTranslate_GetTarget(i + 2, Instruction[2].Arg, Count)] = true;
+            
+            for(size_t j = 1; j <= OperandSlots && Error == cbError_None; j++)
+                IsOperand[i + j] = true;
+        }
+    }
+    for(size_t i = 0; i < Count && Error == cbError_None; i++)
+    {
+        if(IsTarget[i] && IsOperand[i])
+            Error = cbError_UnknownOp;
+    }
+    
+    /*** Byte-Code Image ***/
+    
+    // The program is loaded from its byte-code, so everything is laid out exactly as when interpreted
+    FILE* ByteCodeFile = (Error == cbError_None) ? tmpfile() : NULL;
+    if(ByteCodeFile == NULL && Error == cbError_None)
+        Error = cbError_Null;
+    
+    if(Error == cbError_None)
+    {
+        cbInit_SaveByteCode(Processor, ByteCodeFile);
+        long ByteCodeSize = ftell(ByteCodeFile);
+        rewind(ByteCodeFile);
+        
+        // Header
+        unsigned int Major, Minor;
+        cbGetVersion(&Major, &Minor);
+        fprintf(OutFile, "/***************************************************************\n \n");
+        fprintf(OutFile, " Translated by coreBasic(%d.%d) from \"%s\"\n", Major, Minor, (SourceName != NULL) ? SourceName : "?");
+        fprintf(OutFile, " Build along with the coreBasic sources (all but main.c), i.e.:\n");
+        fprintf(OutFile, " cc -std=gnu99 -O2 -I<coreBasic> <this file> <coreBasic>/cb*.c\n \n");
+        fprintf(OutFile, "***************************************************************/\n\n");
+        fprintf(OutFile, "#include \"cbTranslate.h\"\n\n");
+        fprintf(OutFile, "%s", cbTranslate_Templates);
+        
+        // Image
+        fprintf(OutFile, "// Byte-code, as saved by cbInit_SaveByteCode\n");
+        fprintf(OutFile, "static const unsigned char cbProgram_ByteCode[%ld] =\n{", ByteCodeSize);
+        for(long i = 0; i < ByteCodeSize; i++)
+            fprintf(OutFile, "%s0x%02x,", (i % 16 == 0) ? "\n    " : " ", (unsigned int)fgetc(ByteCodeFile));
+        fprintf(OutFile, "\n};\n\n");
+        fclose(ByteCodeFile);
+    }
+    
+    /*** Instructions ***/
+    
+    if(Error == cbError_None)
+    {
+        fprintf(OutFile, "/*** Program ***/\n\n");
+        fprintf(OutFile, "static cbError cbProgram_Run(cbVirtualMachine* Processor)\n{\n");
+        fprintf(OutFile, "    char* Memory = (char*)Processor->Memory;\n");
+        fprintf(OutFile, "    char* Data = Memory + Processor->DataPointer;\n");
+        fprintf(OutFile, "    char* Frame = Memory + Processor->StackBasePointer;\n");
+        fprintf(OutFile, "    cbInstruction* Code = (cbInstruction*)Memory;\n");
+        fprintf(OutFile, "    size_t Sp = Processor->StackPointer;\n");
+        fprintf(OutFile, "    cbVariable *A, *B;\n");
+        fprintf(OutFile, "    cbError Error = cbError_None;\n    \n");
+        
+        bool IsHaltUsed = false;
+        cbLineEntry* LineTable = (cbLineEntry*)((char*)Processor->Memory + Processor->LineTablePointer);
+        size_t LineIndex = 0;
+        for(size_t i = 0; i < Count; i++)
+        {
+            cbInstruction* Instruction = Code + i;
+            int Arg = Instruction->Arg;
+            
+            // Lines are kept apart, named after the line table
+            for(; LineIndex < Processor->LineCount && (size_t)LineTable[LineIndex].Instruction <= i; LineIndex++)
+                fprintf(OutFile, "    \n    // Line %d\n", LineTable[LineIndex].Line);
+            if(IsTarget[i])
+                fprintf(OutFile, "I%lu:\n", i);
+            
+            switch(Instruction->Op)
+            {
+                case cbOps_Nop:
+                    break;
+                case cbOps_LoadValue:
+                    fprintf(OutFile, "    __cbLoadValue(%lu, %d);\n", i, Arg);
+                    break;
+                case cbOps_LoadData:
+                    fprintf(OutFile, "    __cbLoadData(%lu, %d);\n", i, Arg);
+                    break;
+                case cbOps_StoreToSlot:
+                    fprintf(OutFile, "    __cbStoreToSlot(%d);\n", Arg);
+                    break;
+                
+                // Type-specialized ops
+                case cbOps_AddInt:
+                case cbOps_SubInt:
+                case cbOps_MulInt:
+                case cbOps_DivInt:
+                case cbOps_ModInt:
+                case cbOps_EqInt:
+                case cbOps_NotEqInt:
+                case cbOps_GreaterInt:
+                case cbOps_GreaterEqInt:
+                case cbOps_LessInt:
+                case cbOps_LessEqInt:
+                {
+                    const char* Operator = cbTranslate_Operators[Instruction->Op - cbOps_AddInt];
+                    if(Instruction->Op == cbOps_DivInt || Instruction->Op == cbOps_ModInt)
+                        fprintf(OutFile, "    __cbIntDivOp(%lu, %s);\n", i, Operator);
+                    else
+                        fprintf(OutFile, "    __cbIntOp(%s);\n", Operator);
+                    break;
+                }
+                
+                // Program control
+                case cbOps_If:
+                    fprintf(OutFile, "    __cbIf(%lu, ", i);
+                    cbTranslate_WriteLabel(OutFile, cbTranslate_GetTarget(i, Arg, Count), Count);
+                    fprintf(OutFile, ");\n");
+                    break;
+                case cbOps_Goto:
+                    fprintf(OutFile, "    goto ");
+                    cbTranslate_WriteLabel(OutFile, cbTranslate_GetTarget(i, Arg, Count), Count);
+                    fprintf(OutFile, ";\n");
+                    break;
+                case cbOps_Halt:
+                    fprintf(OutFile, "    goto Halt;\n");
+                    IsHaltUsed = true;
+                    break;
+                case cbOps_Pause:
+                    fprintf(OutFile, "    __cbInterrupt(cbInterrupt_Pause);\n");
+                    break;
+                case cbOps_Input:
+                case cbOps_GetKey:
+                case cbOps_Wait:
+                    fprintf(OutFile, "    __cbExecuteInterrupt(%lu); // %s\n", i, cbOpsNames[Instruction->Op]);
+                    break;
+                
+                // Fused ops: the literal is static data, so it is written out as a constant
+                case cbOps_SetMath:
+                case cbOps_IfComp:
+                {
+                    cbInstruction* Operand = Instruction + 1;
+                    cbVariable* Literal = (cbVariable*)((char*)Processor->Memory + Processor->DataPointer + Operand->Arg);
+                    const char* Operator = cbTranslate_Operators[Operand->Op - cbOps_Add];
+                    
+                    // Only integers are supported
+                    if(Literal->Type != cbVariableType_Int)
+                        fprintf(OutFile, "    __cbFail(%lu, cbError_TypeMismatch);\n", i);
+                    else if(Instruction->Op == cbOps_SetMath && (Operand->Op == cbOps_Div || Operand->Op == cbOps_Mod) && Literal->Data.Int == 0)
+                        fprintf(OutFile, "    __cbSetMathFail(%lu, %d, cbError_DivZero);\n", i, Arg);
+                    else if(Instruction->Op == cbOps_SetMath)
+                        fprintf(OutFile, "    __cbSetMath(%lu, %d, %s, %d);\n", i, Arg, Operator, Literal->Data.Int);
+                    else
+                    {
+                        fprintf(OutFile, "    __cbIfComp(%lu, %d, %s, %d, ", i, Arg, Operator, Literal->Data.Int);
+                        cbTranslate_WriteLabel(OutFile, cbTranslate_GetTarget(i + 2, Instruction[2].Arg, Count), Count);
+                        fprintf(OutFile, ");\n");
+                    }
+                    break;
+                }
+                
+                // Everything else (generic ops, output, stack frames) goes through the interpreter
+                default:
+                    fprintf(OutFile, "    __cbExecute(%lu); // %s\n", i, cbOpsNames[Instruction->Op]);
+                    break;
+            }
+            
+            // Skip over operand slots
+            i += cbUtil_GetOperandSlots(Instruction->Op);
+        }
+        
+        // Running off the code is an overflow, as when interpreted
+        fprintf(OutFile, "    \n");
+        if(IsTarget[Count])
+            fprintf(OutFile, "OutOfCode:\n");
+        fprintf(OutFile, "    __cbFail(%lu, cbError_Overflow);\n", (Count > 0) ? Count - 1 : 0);
+        if(IsHaltUsed)
+            fprintf(OutFile, "Halt:\n    Processor->Halted = true;\n    Error = cbError_Halted;\n");
+        fprintf(OutFile, "End:\n    Processor->StackPointer = Sp;\n    return Error;\n}\n\n");
+        
+        // Entry point
+        fprintf(OutFile, "int main(int argc, const char* argv[])\n{\n");
+        fprintf(OutFile, "    return cbTranslate_Main(cbProgram_Run, cbProgram_ByteCode, sizeof(cbProgram_ByteCode), %lu);\n}\n", Processor->MemorySize);
+    }
+    
+    free(IsTarget);
+    free(IsOperand);
+    return Error;
+}
+
+/*** Translated Program Run-Time ***/
+
+int cbTranslate_Main(cbError (*Program)(cbVirtualMachine* Processor), const unsigned char* ByteCode, size_t ByteCodeSize, unsigned long MemorySize)
+{
+    // Load through the regular byte-code loader
+    cbVirtualMachine Processor;
+    FILE* ByteCodeFile = tmpfile();
+    if(ByteCodeFile == NULL)
+        return -1;
+    fwrite(ByteCode, ByteCodeSize, 1, ByteCodeFile);
+    rewind(ByteCodeFile);
+    cbError Error = cbInit_LoadByteCode(&Processor, MemorySize, ByteCodeFile, stdout, stdin, 0, 0);
+    fclose(ByteCodeFile);
+    
+    if(Error != cbError_None)
+    {
+        printf("> Program failed to load: \"%s\"\n", cbDebug_GetErrorMsg(Error));
+        cbRelease(&Processor);
+        return -1;
+    }
+    
+    // Run to completion, writing out the program's output before our own
+    printf("> Program executing\n");
+    Error = Program(&Processor);
+    cbStep_FlushOnState(&Processor, Error);
+    
+    // Error state:
+    if(Error != cbError_None && Error != cbError_Halted)
+        printf("> Error %d, line %lu: \"%s\"\n", Error, cbDebug_GetLine(&Processor), cbDebug_GetErrorMsg(Error));
+    else
+        printf("> Program terminated normally\n");
+    
+    cbRelease(&Processor);
+    return 0;
+}
+
+void cbTranslate_Interrupt(cbVirtualMachine* Processor)
+{
+    // Ask the input provider for the user input, posting it and removing the interrupt state; native
+    // code can't yield back to a host, so keep asking until there is some. Waits sleep until their time
+    if(Processor->InterruptState == cbInterrupt_Wait)
+        cbUtil_SleepUntil(Processor->WakeTime);
+    while(!cbStep_PollInput(Processor))
+        ;
+}
@@ -0,0 +1,41 @@
+/***************************************************************
+ 
+ cBasic - coreBasic - BASIC Language Interpreter on iOS
+ Copyright 2011 Jeremy Bridon - See License.txt for info
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: cbTranslate.h/c
+ Desc: Ahead-of-time translation of compiled programs into
+ standalone C source, and the small run-time such translated
+ programs are linked against (along with the other sources).
+ 
+***************************************************************/
+
+#ifndef __CBTRANSLATE_H__
+#define __CBTRANSLATE_H__
+
+/*** Needed includes ***/
+
+#include "cbUtil.h"
+#include "cbTypes.h"
+#include "cbLang.h"
+
+/*** Translation ***/
+
+// Write the processor's compiled (stack machine) program out as a standalone C translation unit,
+// one statement per instruction with labels on jump targets; the program's byte-code is embedded
+// to set up the same memory layout. Returns an error if the code can not be translated
+cbError cbTranslate_WriteProgram(cbVirtualMachine* Processor, const char* SourceName, FILE* OutFile);
+
+/*** Translated Program Run-Time ***/
+
+// Load the embedded byte-code and run the translated program, reporting the outcome the same
+// way the console interface does; returns the process exit code
+int cbTranslate_Main(cbError (*Program)(cbVirtualMachine* Processor), const unsigned char* ByteCode, size_t ByteCodeSize, unsigned long MemorySize);
+
+// Wait on the processor's interrupt (reading from its input stream, or sleeping through a wait), then release it
+void cbTranslate_Interrupt(cbVirtualMachine* Processor);
+
+#endif
@@ -19,16 +19,131 @@
 
 /*** Machine / Simulation Definition ***/
 
-// Interrupt types (only three actual interrupts, one "none")
-static const int cbInterruptCount = 4;
+// Interrupt types (four actual interrupts, one "none")
+static const int cbInterruptCount = 5;
 typedef enum __cbInterrupt
 {
     cbInterrupt_None,       // No interruption
     cbInterrupt_Pause,      // Wait for specific "enter" key, read it off
     cbInterrupt_GetKey,     // Wait on any key, read it off, push onto stack
     cbInterrupt_Input,      // Wait for specific "enter" key, push all read onto stack
+    cbInterrupt_Wait,       // Wait until the wake-up time (see cbStep_GetWakeTime), reading nothing
 } cbInterrupt;
 
+// Requests (bit flags) posted to a processor from any thread (see cbStep_PostRequest); each holds the
+// processor, with runs returning control right away, until taken back (see cbStep_TakeRequests)
+typedef enum __cbRequest
+{
+    cbRequest_None = 0,
+    cbRequest_Stop = 1 << 0,        // Stop the program: runs fail with cbError_Stopped
+    cbRequest_Pause = 1 << 1,       // Pause the program: runs return without running anything
+    cbRequest_Snapshot = 1 << 2,    // Return control at a consistent point, i.e. to save or inspect the processor's state
+    cbRequest_Mismatch = 1 << 3,    // The output went wrong (see cbCompare.h): runs fail with cbError_WrongOutput
+} cbRequest;
+
+// Program options (bit flags), given when loading source code
+typedef enum __cbOption
+{
+    cbOption_None = 0,
+    cbOption_RegisterMachine = 1 << 0,  // Compile to three-address register code rather than stack code, when possible
+    cbOption_Jit = 1 << 1,              // Run stack code as native code (see cbJit.h), where the platform is supported
+    cbOption_PackedScreen = 1 << 2,     // Store the screen at 2 bits per pixel, rather than a byte per pixel
+    cbOption_DoubleBuffer = 1 << 3,     // Draw into a back buffer, which is only shown to the host on flip()
+} cbOption;
+
+// Output sink: receives each span of program output (not null-terminated), pointing straight into
+// the processor's output buffer or static data, and only valid for the duration of the call
+typedef void (*cbOutputSink)(void* Context, const char* Text, size_t Length);
+
+// Input provider: writes the user input for the given interrupt into Input (null-terminated, at most
+// InputSize bytes, including the terminator); returns false if there is no input yet, leaving the
+// processor waiting on the interrupt until asked again
+typedef bool (*cbInputProvider)(void* Context, cbInterrupt Interrupt, char* Input, size_t InputSize);
+
+// Output flush policy (bit flags): when the output buffer is written out to the output sink,
+// besides whenever it is full and on release (see cbStep_SetOutputPolicy)
+typedef enum __cbFlush
+{
+    cbFlush_None = 0,                   // Only when the buffer is full
+    cbFlush_Newline = 1 << 0,           // After any output with a new line in it
+    cbFlush_Interrupt = 1 << 1,         // When waiting on user input
+    cbFlush_Halt = 1 << 2,              // When the program halts or fails
+    cbFlush_Always = 1 << 3,            // After every output (unbuffered)
+} cbFlush;
+
+// Default output buffer size and flush policy of new processors
+static const size_t cbOutputBufferSize = 1024;
+static const unsigned int cbFlushDefault = cbFlush_Newline | cbFlush_Interrupt | cbFlush_Halt;
+
+// A rectangle of screen pixels, in the same coordinates as the output instruction
+typedef struct __cbScreenRegion
+{
+    size_t X, Y;
+    size_t Width, Height;
+} cbScreenRegion;
+
+// Pixel formats of a host surface the screen is presented into (see cbStep_PresentScreen)
+typedef enum __cbSurfaceFormat
+{
+    cbSurfaceFormat_Gray8,  // A byte per pixel: the first byte of the color's palette entry
+    cbSurfaceFormat_RGBA32, // Four bytes per pixel: the color's palette entry as is (red, green, blue, then alpha)
+} cbSurfaceFormat;
+
+// A host-owned image the screen is presented into, each screen pixel becoming a square of Scale by Scale
+// surface pixels; set up with cbStep_InitSurface, which fills the expansion table with the surface pixels
+// of each group of four screen pixels (indexed the way a packed screen byte is)
+typedef struct __cbSurface
+{
+    unsigned char* Pixels;
+    ptrdiff_t Pitch;        // Bytes from one row to the next; negative to lay the rows out bottom-up
+    cbSurfaceFormat Format;
+    size_t PixelSize;
+    size_t Scale;
+    unsigned char Expansion[256][16];
+} cbSurface;
+
+// Kinds of draw events posted to the host (see cbStep_GetDrawEvents)
+typedef enum __cbDrawEventType
+{
+    cbDrawEvent_Pixel,      // A pixel was set, at (X, Y)
+    cbDrawEvent_Clear,      // The whole screen was cleared
+    cbDrawEvent_Line,       // A line from (X, Y) to (EndX, EndY), inclusive
+    cbDrawEvent_Rect,       // A rectangle of Width by Height at (X, Y)
+    cbDrawEvent_Blit,       // A sprite of Width by Height at (X, Y)
+    cbDrawEvent_Flip,       // A frame was finished; with a back buffer, everything since the last flip is now shown
+    cbDrawEvent_Resync,     // Events were dropped (the queue was full); the whole screen must be redrawn
+} cbDrawEventType;
+
+// A draw event, as given to the drawing op; nothing is clipped to the screen yet
+typedef struct __cbDrawEvent
+{
+    cbDrawEventType Type;
+    int X, Y;
+    int EndX, EndY;
+    int Width, Height;
+    int Color;
+    const char* Sprite;     // Pixels of a sprite (see cbStep_Draw), within the processor's static data
+} cbDrawEvent;
+
+// Outcome of comparing the output against the expected output (see cbCompare_GetResult)
+typedef enum __cbCompareResult
+{
+    cbCompareResult_Match,      // All of the expected output was written, and nothing else
+    cbCompareResult_Short,      // The output matched so far, but not all of the expected output was written
+    cbCompareResult_Mismatch,   // The output differed from the expected output
+    cbCompareResult_Excess,     // The output went on past the end of the expected output
+} cbCompareResult;
+
+// What a runner's worker thread is up to (see cbRunner_GetState)
+typedef enum __cbRunnerState
+{
+    cbRunnerState_Running,  // Running the program
+    cbRunnerState_Paused,   // Paused by the host (see cbRunner_Pause)
+    cbRunnerState_Waiting,  // Waiting on user input, with no replies left (see cbRunner_PostInput)
+    cbRunnerState_Sleeping, // Sleeping in a wait(), until its wake-up time
+    cbRunnerState_Stopped,  // The program halted or failed, or the host stopped it
+} cbRunnerState;
+
 // The processor / interpreter state
 typedef struct __cbVirtualMachine
 {
@@ -94,23 +209,90 @@ typedef struct __cbVirtualMachine
     // Interrupt state, waiting for user input event
     cbInterrupt InterruptState;
     
-    // I/O buffers (just c-style file streams; i.e. just like stdin)
-    FILE* StreamOut;
-    FILE* StreamIn;
+    // Pending requests (cbRequest flags), posted from any thread
+    unsigned int Request;
+    
+    // While waiting (cbInterrupt_Wait), the time to wake up at, on the clock of cbUtil_GetTime
+    unsigned long long WakeTime;
+    
+    // Limits (see cbStep_SetTimeLimit), zero if none: the tick count the program may not reach, and the
+    // deadline on the clock of cbUtil_GetTime, only looked at every so many ticks
+    size_t TickLimit;
+    unsigned long long Deadline;
+    
+    // I/O: output goes to the sink, and input on interrupts comes from the provider, each called with
+    // their own context (by default, c-style file streams; see cbStep_SetOutputSink / SetInputProvider)
+    cbOutputSink OutputSink;
+    void* OutputContext;
+    cbInputProvider InputProvider;
+    void* InputContext;
+    
+    // Input attached up front (see cbStep_SetInputBuffer), owned by the host, and read up to InputOffset so far
+    const char* InputBuffer;
+    size_t InputLength, InputOffset;
+    
+    // Output buffer, written out to the output sink as the flush policy (cbFlush flags) asks for
+    char* OutputBuffer;
+    size_t OutputLength, OutputSize;
+    unsigned int FlushPolicy;
     
     // Screen dimensions
-    // Note that the screen origin in the bottom-left
+    // Note that the screen origin in the bottom-left; rows are ScreenPitch bytes apart, each holding one
+    // pixel per byte, or four per byte if packed (see cbOption_PackedScreen and cbStep_GetScreenBuffer)
     size_t ScreenWidth, ScreenHeight;
+    size_t ScreenPitch;
     unsigned char* ScreenBuffer;
     
-    // The current line we are executing in a simulation
-    size_t LineIndex;
+    // With a back buffer (see cbOption_DoubleBuffer), ScreenBuffer is only drawn into, while the host is shown
+    // FrontBuffer; flip() publishes the back buffer as the front one, then bumps the count of frames shown.
+    // The host latches the front buffer it reads from into LatchedBuffer, which is never drawn into again until
+    // the host lets go of it (by latching another), so flip() draws on into SpareBuffer instead while it's held
+    unsigned char* FrontBuffer;
+    unsigned char* SpareBuffer;
+    unsigned char* LatchedBuffer;
+    size_t FrameCount;
+    
+    // Columns of each row changed since the host last asked (see cbStep_GetDirtyRegions), as
+    // pairs of [start, end) per row; a row is clean if its start is not less than its end
+    // With a back buffer, drawing marks BackDirtyRows instead, which flip() moves over
+    size_t* DirtyRows;
+    size_t* BackDirtyRows;
+    
+    // Draw queue (see cbStep_SetDrawQueue): a single-producer / single-consumer ring of DrawQueueSize (a power
+    // of two) events, pushed at DrawHead by the processor and taken from DrawTail by the host, which may be on
+    // another thread; both only ever grow. DrawOverflow is set when an event is dropped since the queue is full
+    cbDrawEvent* DrawQueue;
+    size_t DrawQueueSize;
+    size_t DrawHead, DrawTail;
+    bool DrawOverflow;
+    
+    // Line table (cbLineEntry, sorted by instruction) placed after the static data; the line being
+    // executed is only resolved from the instruction pointer when asked for (see cbDebug_GetLine)
+    size_t LineTablePointer;
+    size_t LineCount;
+    
+    // Options the program was compiled with (cbOption flags); notably selects the code format
+    unsigned int Options;
+    
+    // Pre-decoded internal execution form of the code segment (see cbStep_Decode), one
+    // entry per instruction plus a trailing end-of-code sentinel
+    struct __cbDecodedInstruction* DecodedCode;
+    size_t DecodedCount;
+    
+    // Native code of the JIT compiler (see cbJit.h), built on the first run if enabled
+    struct __cbJitProgram* JitProgram;
+    
+    // Screen recorder (see cbRecord.h), if recording
+    struct __cbRecorder* Recorder;
+    
+    // Expected output comparator (see cbCompare.h), if comparing
+    struct __cbComparator* Comparator;
     
 } cbVirtualMachine;
 
 // Operator set
-static const int cbOpsCount = 37;
-static const int cbOpsFuncCount = 17;
+static const int cbOpsCount = 56;
+static const int cbOpsFuncCount = 22;
 typedef enum __cbOps
 {
     // Program control
@@ -133,10 +315,15 @@ typedef enum __cbOps
     cbOps_Output,
     cbOps_GetKey,
     cbOps_Clear,
+    cbOps_Line,      // Bulk drawing ops, which pop all of their arguments (see cbStep_Draw)
+    cbOps_Rect,
+    cbOps_Blit,
+    cbOps_Flip,      // Show the drawn frame (see cbOption_DoubleBuffer)
+    cbOps_Wait,      // Pop a number of milliseconds, and wait that long (an interrupt, so the host gets control back)
     
     // Misc.
     cbOps_Func,
-    cbOps_Set,
+    cbOps_Set,       // Assignment; only ever a parse-tree op, compiled into a store into the variable
     
     // Primitive commands (i.e. algebra) (executes the last two on the stack)
     cbOps_Add,
@@ -158,11 +345,32 @@ typedef enum __cbOps
     
     // Memory loading and saving
     cbOps_LoadData,  // Push a literal from the data section (arg is the offset from the data base)
-    cbOps_LoadVar,   // Push the variable's offset from the stack base into the stack (arg is the offset from stack base)
+    cbOps_LoadValue, // Push a copy of the variable's value (arg is the variable's offset from the stack base)
+    cbOps_StoreToSlot,  // Pop the top of the stack into the variable (arg is the variable's offset from the stack base)
     cbOps_AddStack,  // Add the number of bytes (positive or negative) to the stack pointer by arg bytes
     
+    // Type-specialized ops, emitted where both operands are proven to be integers (see cbParse_InferTypes)
+    // Same as the generic ops of the same order, but without any type checks
+    cbOps_AddInt,
+    cbOps_SubInt,
+    cbOps_MulInt,
+    cbOps_DivInt,
+    cbOps_ModInt,
+    cbOps_EqInt,
+    cbOps_NotEqInt,
+    cbOps_GreaterInt,
+    cbOps_GreaterEqInt,
+    cbOps_LessInt,
+    cbOps_LessEqInt,
+    
+    // Fused superinstructions, built by the compiler out of common op sequences (see cbParse_FuseInstructions)
+    // Their operands are kept in the instruction slots that directly follow them
+    cbOps_SetMath,   // Var = var <op> literal (arg is the var offset); next slot is the math op with the literal's data offset
+    cbOps_IfComp,    // Jump unless var <op> literal (arg is the var offset); next slots are the comparison op with the literal's data offset, then the if
+    
     // No-Operator; commonly used to store meta information (i.e. debugging symbols) in the arg int
-    // For now it stores the line number of the next instructions to be executed
+    // The compiler marks the start of each line with one (the arg is the line number), but strips
+    // them into the line table before placing the code, so none are ever executed
     cbOps_Nop,
 } cbOps;
 
@@ -173,6 +381,25 @@ typedef struct __cbInstruction
     int Arg;        // Location, relative or global, as the arg (optional)
 } cbInstruction;
 
+// Three-address instructions of the register machine (see cbOption_RegisterMachine), applying the op to
+// A and B and writing the result to Out. Operands are offsets: negative ones are frame slots from the stack
+// base (variables, then temporaries), all others are static data offsets from the data pointer
+// Jumps keep their relative instruction count in Out, and output draws at (A, B) with color Out
+typedef struct __cbRegInstruction
+{
+    cbOps Op;       // Instruction we are to execute
+    int Out;        // Result operand
+    int A;          // Left operand
+    int B;          // Right operand
+} cbRegInstruction;
+
+// Line table entry: the source line starting at the given instruction (index into the code segment)
+typedef struct __cbLineEntry
+{
+    int Instruction;    // First instruction of the line
+    int Line;           // Source line number
+} cbLineEntry;
+
 // English-language op names (keywords)
 static const char cbOpsNames[cbOpsCount][16] =
 {
@@ -193,6 +420,11 @@ static const char cbOpsNames[cbOpsCount][16] =
     "output",
     "getKey",
     "clear",
+    "line",
+    "rect",
+    "blit",
+    "flip",
+    "wait",
     "func",
     "=",
     "+",
@@ -212,8 +444,22 @@ static const char cbOpsNames[cbOpsCount][16] =
     
     // Private:
     "loaddata",
-    "loadvar",
+    "loadval",
+    "store",
     "addstack",
+    "addint",
+    "subint",
+    "mulint",
+    "divint",
+    "modint",
+    "eqint",
+    "noteqint",
+    "gtint",
+    "gteqint",
+    "ltint",
+    "lteqint",
+    "setmath",
+    "ifcomp",
     "nop",
 };
 
@@ -280,7 +526,7 @@ typedef enum __cbVariableType
     cbVariableType_Float,
     cbVariableType_Bool,
     cbVariableType_String,
-    cbVariableType_Offset, // Equivalent to a pointer (internal use only)
+    cbVariableType_Offset, // Equivalent to a pointer (internal use only; never on the stack, variables are loaded by value)
 } cbVariableType;
 
 // Variable holders
@@ -292,11 +538,25 @@ typedef struct __cbVariable
         int Int;
         float Float;
         bool Bool;
-        char* String;
+        char* String;   // Offset from the data pointer to the characters, which follow their (int) length
         int Offset;
     } Data;
 } cbVariable;
 
+// Pre-decoded instructions: the internal execution form built once a program is placed in memory,
+// with all relative offsets resolved into absolute addresses so the hot loop does no address arithmetic
+typedef struct __cbDecodedInstruction
+{
+    cbInstruction Raw;      // The public op and arg, as found in the code segment
+    const void* Handler;    // Dispatch engine handler for this op (threaded dispatch only)
+    const void* CachedHandler;  // Same, for when the top of the stack is cached (threaded dispatch only)
+    union
+    {
+        struct __cbDecodedInstruction* Target;  // Absolute jump destination (if, goto)
+        cbVariable* Data;                       // Absolute data-segment variable (loaddata), or frame variable (loadval, store)
+    } Operand;
+} cbDecodedInstruction;
+
 
 /*** Lexical / Symbol-Products Tree ***/
 
@@ -375,6 +635,8 @@ typedef struct __cbSymbolsTable
     cbList JumpTable;           // Table of jump instructions (cbJump objects, heap-allocated)
     cbList LabelTable;          // Table of jump destinations (cbLabel objects, heap-allocated)
     cbList BlockStack;          // Active stack of blocks during program compilation (references are not unique, should never delete)
+    cbList UntypedVariables;    // Names of variables not proven to only ever hold integers (c-style strings, owned by the lex-tree)
+    cbList LineTable;           // Where each line's code starts, once line markers are stripped (cbLineEntry objects, heap-allocated)
     
 } cbSymbolsTable;
 
@@ -412,7 +674,7 @@ typedef struct __cbJumpTarget
 // Failure reasons
 // Note that these are both parsing, compiling,
 // and run-time error definitions
-static const int cbErrorCount = 15;
+static const int cbErrorCount = 18;
 typedef enum __cbError
 {
     cbError_None,
@@ -430,6 +692,9 @@ typedef enum __cbError
     cbError_MissingLabel,
     cbError_InvalidID,
     cbError_ConstSet,
+    cbError_Stopped,
+    cbError_WrongOutput,
+    cbError_TimeLimit,
 } cbError;
 
 // English-language error names
@@ -450,6 +715,9 @@ static const char cbErrorNames[cbErrorCount][64] =
     "Missing label",
     "Invalid variable name",
     "Assigning a constant",
+    "Process stopped",
+    "Output does not match the expected output",
+    "Time limit exceeded",
 };
 
 // Define a parsing error which is an error code and a line number
@@ -14,12 +14,43 @@
 
 #include "cbUtil.h"
 
+#ifdef _WIN32
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
 void cbGetVersion(unsigned int* Major, unsigned int* Minor)
 {
     *Major = __CBVERSION_MAJOR__;
     *Minor = __CBVERSION_MINOR__;
 }
 
+unsigned long long cbUtil_GetTime(void)
+{
+    #ifdef _WIN32
+        return GetTickCount64();
+    #else
+        struct timespec Now;
+        clock_gettime(CLOCK_MONOTONIC, &Now);
+        return (unsigned long long)Now.tv_sec * 1000 + Now.tv_nsec / 1000000;
+    #endif
+}
+
+void cbUtil_SleepUntil(unsigned long long Time)
+{
+    unsigned long long Now = cbUtil_GetTime();
+    if(Time <= Now)
+        return;
+    
+    #ifdef _WIN32
+        Sleep((DWORD)(Time - Now));
+    #else
+        struct timespec Wait = { (time_t)((Time - Now) / 1000), (long)((Time - Now) % 1000) * 1000000 };
+        nanosleep(&Wait, NULL);
+    #endif
+}
+
 bool cbLang_IsInteger(const char* String, size_t StringLength)
 {
     // Error check
@@ -218,32 +249,32 @@ bool cbUtil_OpFromStr(const char* str, cbOps* OutOp)
         }
         return true;
     }
-    else if(strcmp(str, ">="))
+    else if(strcmp(str, ">=") == 0)
     {
         *OutOp = cbOps_GreaterEq;
         return true;
     }
-    else if(strcmp(str, "<="))
+    else if(strcmp(str, "<=") == 0)
     {
         *OutOp = cbOps_LessEq;
         return true;
     }
-    else if(strcmp(str, "=="))
+    else if(strcmp(str, "==") == 0)
     {
         *OutOp = cbOps_Eq;
         return true;
     }
-    else if(strcmp(str, "!="))
+    else if(strcmp(str, "!=") == 0)
     {
         *OutOp = cbOps_NotEq;
         return true;
     }
-    else if(strcmp(str, "and"))
+    else if(strcmp(str, "and") == 0)
     {
         *OutOp = cbOps_And;
         return true;
     }
-    else if(strcmp(str, "or"))
+    else if(strcmp(str, "or") == 0)
     {
         *OutOp = cbOps_Or;
         return true;
@@ -253,6 +284,26 @@ bool cbUtil_OpFromStr(const char* str, cbOps* OutOp)
     return false;
 }
 
+cbOps cbUtil_GetGenericOp(cbOps Op)
+{
+    // Type-specialized ops are in the same order as the generic ones
+    if(Op >= cbOps_AddInt && Op <= cbOps_LessEqInt)
+        return (cbOps)(Op - cbOps_AddInt + cbOps_Add);
+    else
+        return Op;
+}
+
+size_t cbUtil_GetOperandSlots(cbOps Op)
+{
+    // Only the fused ops keep operands in the slots that follow them
+    if(Op == cbOps_SetMath)
+        return 1;
+    else if(Op == cbOps_IfComp)
+        return 2;
+    else
+        return 0;
+}
+
 int g2Util_imin(int a, int b)
 {
     return (a > b) ? b : a;
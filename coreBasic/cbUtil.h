@@ -22,6 +22,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <stddef.h>
 #include "cbList.h"
 
 #ifndef _WIN32
@@ -45,9 +46,45 @@
     #define __cbEXPORT // Todo (done in framework rules)
 #endif
 
+// Use the direct-threaded (computed-goto) dispatch engine in cbRun when the compiler supports
+// labels-as-values; define __cbSWITCH_DISPATCH__ to force the portable switch-based engine
+// Note: GCC merges the handlers' dispatch jumps back together unless built with -fno-gcse and
+// -fno-crossjumping, which costs most of the engine's branch prediction (clang keeps them apart)
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(__cbSWITCH_DISPATCH__)
+    #define __cbTHREADED_DISPATCH__
+#endif
+
+// Build the baseline JIT compiler (see cbJit.h) on Linux x86-64; define __cbNO_JIT__ to leave it out
+#if defined(__linux__) && defined(__x86_64__) && !defined(__cbNO_JIT__)
+    #define __cbJIT__
+#endif
+
+// Build the worker-thread runner (see cbRunner.h) on top of POSIX threads; define __cbNO_RUNNER__ to leave it out
+#if !defined(_WIN32) && !defined(__cbNO_RUNNER__)
+    #define __cbRUNNER__
+#endif
+
+// Atomic loads, stores, exchanges, and bit sets / clears (returning the old value) of state shared with
+// another thread (i.e. the draw queue's indices), with acquire / release ordering; built on the GCC / clang
+// atomic builtins. The fence orders a store before a later load of something else (see cbStep_Flip)
+#define __cbAtomicLoad(Value) __atomic_load_n(&(Value), __ATOMIC_ACQUIRE)
+#define __cbAtomicStore(Value, New) __atomic_store_n(&(Value), (New), __ATOMIC_RELEASE)
+#define __cbAtomicExchange(Value, New) __atomic_exchange_n(&(Value), (New), __ATOMIC_ACQ_REL)
+#define __cbAtomicOr(Value, Bits) __atomic_fetch_or(&(Value), (Bits), __ATOMIC_ACQ_REL)
+#define __cbAtomicAnd(Value, Bits) __atomic_fetch_and(&(Value), (Bits), __ATOMIC_ACQ_REL)
+#define __cbAtomicFence() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
 // Posts the major and minor version
 __cbEXPORT void cbGetVersion(unsigned int* Major, unsigned int* Minor);
 
+/*** Timing Functions ***/
+
+// Returns the time, in milliseconds, on a monotonic clock (with an arbitrary origin); used for wake-up times
+__cbEXPORT unsigned long long cbUtil_GetTime(void);
+
+// Give the processor's time away until the given time (of cbUtil_GetTime); returns right away if it already passed
+__cbEXPORT void cbUtil_SleepUntil(unsigned long long Time);
+
 /*** Validation Functions ***/
 
 // Returns true if the given string of given length is a number
@@ -99,6 +136,13 @@ inline bool cbUtil_IsComment(const char* str);
 // Returns the op associated with the given string, or Op_None if not found
 bool cbUtil_OpFromStr(const char* str, cbOps* OutOp);
 
+// Returns the generic op of a type-specialized op (i.e. add for addint), or the op itself
+cbOps cbUtil_GetGenericOp(cbOps Op);
+
+// Returns the number of instruction slots directly following the given op that hold its
+// operands rather than code; non-zero only for the fused ops
+size_t cbUtil_GetOperandSlots(cbOps Op);
+
 // Min/max integer functions
 inline int g2Util_imin(int a, int b);
 inline int g2Util_imax(int a, int b);
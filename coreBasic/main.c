@@ -12,8 +12,13 @@
 ***************************************************************/
 
 #include <stdio.h>
+#include <time.h>
 #include "cbLang.h"
 #include "cbProcess.h"
+#include "cbTranslate.h"
+#include "cbRecord.h"
+#include "cbCompare.h"
+#include "cbRunner.h"
 
 // Returns the number of bytes of the given file (note: will need +1
 // for null-term if storing as a string); also note that the read-head
@@ -26,6 +31,62 @@ static size_t getFileLength(FILE* FileHandle)
     return SourceFileLength;
 }
 
+// Read all of the given file into memory, writing out its length; returns null if it can't be opened
+static char* readFile(const char* FileName, size_t* Length)
+{
+    FILE* FileHandle = fopen(FileName, "rb");
+    if(FileHandle == NULL)
+        return NULL;
+    
+    // Room for a null-terminator, so even an empty file is read
+    *Length = getFileLength(FileHandle);
+    char* Data = malloc(*Length + 1);
+    *Length = fread(Data, 1, *Length, FileHandle);
+    fclose(FileHandle);
+    return Data;
+}
+
+// Run the program on a worker thread, with this thread only passing its output and input along; returns
+// the error the program stopped on
+static cbError runThreaded(cbVirtualMachine* Simulator)
+{
+    cbRunner* Runner = cbRunner_Start(Simulator, 4096, 256);
+    if(Runner == NULL)
+    {
+        printf("Unable to start a worker thread\n");
+        return cbError_Null;
+    }
+    
+    char Buffer[256];
+    cbRunnerState State;
+    do
+    {
+        // Everything written out before the state was posted is there to read
+        State = cbRunner_GetState(Runner);
+        size_t Length;
+        while((Length = cbRunner_ReadOutput(Runner, Buffer, sizeof(Buffer))) > 0)
+            fwrite(Buffer, 1, Length, stdout);
+        fflush(stdout);
+        
+        // Pass a word of input along when asked, else check back in a bit
+        if(State == cbRunnerState_Waiting)
+        {
+            cbStep_FileInputProvider(stdin, cbInterrupt_Input, Buffer, sizeof(Buffer));
+            cbRunner_PostInput(Runner, Buffer);
+        }
+        else if(State != cbRunnerState_Stopped)
+        {
+            struct timespec Wait = { 0, 1000000 };
+            nanosleep(&Wait, NULL);
+        }
+    }
+    while(State != cbRunnerState_Stopped);
+    
+    cbError Error = cbRunner_Stop(Runner);
+    cbRunner_Release(Runner);
+    return Error;
+}
+
 // Print the help / usage of this application
 static void help()
 {
@@ -34,7 +95,16 @@ static void help()
            "  None         Interprets the given source file, then executes code\n"
            "  -h           Prints this help message\n"
            "  -v           Verbose mode, printing the instructions and memory maps\n"
+           "  -r           Compiles to the register machine, rather than the stack machine\n"
+           "  -j           Runs the code as native code, where supported (x86-64 Linux)\n"
+           "  -t           Runs the code on a worker thread\n"
            "  -o <name>    Generates and stores byte-code into the given output file\n"
+           "  -c <name>    Translates the program into the given standalone C source file\n"
+           "  -f <name>    Records the screen into the given frame stream file\n"
+           "  -u <file>    Takes all user input from the given file up front, rather than from stdin\n"
+           "  -e <file>    Compares the output against the given expected output, stopping on a difference\n"
+           "  -l <ticks>   Stops the program once it ran the given number of instructions\n"
+           "  -d <ms>      Stops the program once it ran for the given number of milliseconds\n"
            "  -i <file>    Executes the given byte-code file\n");
 }
 
@@ -45,9 +115,17 @@ int main (int argc, const char * argv[])
     
     // Default arguments passed by the user
     bool IsVerbose = false;
+    bool IsThreaded = false;
+    unsigned int Options = cbOption_None;
     const char* SourceFileName = NULL;
     const char* OutFileName = NULL;
+    const char* TranslateFileName = NULL;
     const char* InFileName = NULL;
+    const char* RecordFileName = NULL;
+    const char* UserInputFileName = NULL;
+    const char* ExpectedFileName = NULL;
+    size_t MaxTicks = 0;
+    unsigned long long MaxTime = 0;
     
     // Print header info.
     unsigned int Major, Minor;
@@ -66,11 +144,53 @@ int main (int argc, const char * argv[])
         {
             IsVerbose = true;
         }
+        else if(strcmp(argv[i], "-r") == 0)
+        {
+            Options |= cbOption_RegisterMachine;
+        }
+        else if(strcmp(argv[i], "-j") == 0)
+        {
+            Options |= cbOption_Jit;
+        }
+        else if(strcmp(argv[i], "-t") == 0)
+        {
+            IsThreaded = true;
+        }
         else if(strcmp(argv[i], "-o") == 0)
         {
             if(i + 1 < argc)
                 OutFileName = argv[++i];
         }
+        else if(strcmp(argv[i], "-c") == 0)
+        {
+            if(i + 1 < argc)
+                TranslateFileName = argv[++i];
+        }
+        else if(strcmp(argv[i], "-f") == 0)
+        {
+            if(i + 1 < argc)
+                RecordFileName = argv[++i];
+        }
+        else if(strcmp(argv[i], "-u") == 0)
+        {
+            if(i + 1 < argc)
+                UserInputFileName = argv[++i];
+        }
+        else if(strcmp(argv[i], "-e") == 0)
+        {
+            if(i + 1 < argc)
+                ExpectedFileName = argv[++i];
+        }
+        else if(strcmp(argv[i], "-l") == 0)
+        {
+            if(i + 1 < argc)
+                MaxTicks = strtoul(argv[++i], NULL, 10);
+        }
+        else if(strcmp(argv[i], "-d") == 0)
+        {
+            if(i + 1 < argc)
+                MaxTime = strtoull(argv[++i], NULL, 10);
+        }
         else if(strcmp(argv[i], "-i") == 0)
         {
             if(i + 1 < argc)
@@ -115,6 +235,10 @@ int main (int argc, const char * argv[])
     cbVirtualMachine Simulator;
     cbList Errors;
     
+    // There is no screen to speak of on the console, unless it is recorded
+    size_t ScreenWidth = (RecordFileName != NULL) ? 96 : 0;
+    size_t ScreenHeight = (RecordFileName != NULL) ? 64 : 0;
+    
     // Attempt to open the source file (read-binary mode)
     if(SourceFileName != NULL)
     {
@@ -135,13 +259,37 @@ int main (int argc, const char * argv[])
         SourceCode[SourceFileLength] = 0;
         
         // Interprete code
-        cbInit_LoadSourceCode(&Simulator, 1024, SourceCode, stdout, stdin, 0, 0, &Errors);
+        cbInit_LoadSourceCode(&Simulator, 1024, SourceCode, stdout, stdin, ScreenWidth, ScreenHeight, Options, &Errors);
         
         // Close file stream
         free(SourceCode);
         fclose(SourceFile);
     }
     
+    // Else, it has to be compiled code
+    else
+    {
+        // Attempt to load file
+        FILE* CompiledFile = fopen(InFileName, "rb");
+        if(CompiledFile == NULL)
+        {
+            printf("Unable to open the given compiled file \"%s\"\n", InFileName);
+            return -1;
+        }
+        
+        // Load code, posting any failure as a line-less error
+        cbList_Init(&Errors);
+        cbError LoadError = cbInit_LoadByteCode(&Simulator, 1024, CompiledFile, stdout, stdin, ScreenWidth, ScreenHeight);
+        if(LoadError != cbError_None)
+            cbUtil_RaiseError(&Errors, LoadError, 0);
+        
+        // The code format comes from the file, but running as native code is up to us
+        Simulator.Options |= Options & cbOption_Jit;
+        
+        // Close file stream
+        fclose(CompiledFile);
+    }
+    
     // Check for error
     size_t ErrorCount = cbList_GetCount(&Errors);
     if(ErrorCount > 0)
@@ -157,8 +305,6 @@ int main (int argc, const char * argv[])
         return -1;
     }
     
-    /*
-     OLD FEATURE:
     // If the user wants to just write out to the file buffer
     if(OutFileName != NULL && SourceFileName != NULL)
     {
@@ -172,30 +318,35 @@ int main (int argc, const char * argv[])
         }
         
         // Write to file in the special format
-        Error = cbInit_SaveByteCode(&Simulator, OutFile);
+        cbInit_SaveByteCode(&Simulator, OutFile);
         
-        // Close file handle
+        // Close file handle and stop, since we only wanted to compile
         fclose(OutFile);
+        cbRelease(&Simulator);
+        return 0;
     }
     
-    // Else, it has to be compiled code
-    if(InFileName != NULL)
+    // If the user wants to translate the program into C
+    if(TranslateFileName != NULL)
     {
-        // Attempt to load file
-        FILE* CompiledFile = fopen(InFileName, "rb");
-        if(CompiledFile == NULL)
+        // Attempt to open
+        FILE* OutFile = fopen(TranslateFileName, "w");
+        if(OutFile == NULL)
         {
-            printf("Unable to open the given compiled file \"%s\"\n", InFileName);
+            printf("Unable to open \"%s\" to write to\n", TranslateFileName);
+            cbRelease(&Simulator);
             return -1;
         }
         
-        // Interprete code
-        Error = cbInit_LoadByteCode(&Simulator, 1024, CompiledFile, stdout, stdin, 0, 0);
+        // Translate, then stop, since we only wanted to compile
+        cbError TranslateError = cbTranslate_WriteProgram(&Simulator, (SourceFileName != NULL) ? SourceFileName : InFileName, OutFile);
+        if(TranslateError != cbError_None)
+            printf("Unable to translate the program: \"%s\"\n", cbDebug_GetErrorMsg(TranslateError));
         
-        // Close file stream
-        fclose(CompiledFile);
+        fclose(OutFile);
+        cbRelease(&Simulator);
+        return (TranslateError == cbError_None) ? 0 : -1;
     }
-    */
     
     /*** Simulation ***/
     
@@ -206,28 +357,66 @@ int main (int argc, const char * argv[])
         cbDebug_PrintMemory(&Simulator, stdout);
     }
     
+    // Record the screen as the program runs, if asked for
+    FILE* RecordFile = NULL;
+    if(RecordFileName != NULL)
+    {
+        RecordFile = fopen(RecordFileName, "wb");
+        if(RecordFile == NULL || cbRecord_Start(&Simulator, cbStep_FileOutputSink, RecordFile, 4096) != cbError_None)
+        {
+            printf("Unable to record into the given frame stream file \"%s\"\n", RecordFileName);
+            if(RecordFile != NULL)
+                fclose(RecordFile);
+            cbRelease(&Simulator);
+            return -1;
+        }
+    }
+    
+    // Read all of the user input at once, if given, so input is taken without any interrupts; and
+    // compare the output against the expected output as it is written, if given
+    char* UserInput = NULL;
+    char* Expected = NULL;
+    size_t UserInputLength = 0, ExpectedLength = 0;
+    if(UserInputFileName != NULL && (UserInput = readFile(UserInputFileName, &UserInputLength)) == NULL)
+        printf("Unable to open the given user input file \"%s\"\n", UserInputFileName);
+    else if(ExpectedFileName != NULL && (Expected = readFile(ExpectedFileName, &ExpectedLength)) == NULL)
+        printf("Unable to open the given expected output file \"%s\"\n", ExpectedFileName);
+    if((UserInputFileName != NULL && UserInput == NULL) || (ExpectedFileName != NULL && Expected == NULL))
+    {
+        cbRelease(&Simulator);
+        if(RecordFile != NULL)
+            fclose(RecordFile);
+        free(UserInput);
+        return -1;
+    }
+    if(UserInput != NULL)
+        cbStep_SetInputBuffer(&Simulator, UserInput, UserInputLength);
+    if(Expected != NULL)
+        cbCompare_Start(&Simulator, Expected, ExpectedLength);
+    
+    // Limit the run, if asked for; the clock starts now
+    cbStep_SetTimeLimit(&Simulator, MaxTicks, MaxTime);
+    unsigned long long Deadline = (MaxTime > 0) ? cbUtil_GetTime() + MaxTime : 0;
+    
     // Helper and simulation flags
     cbError Error = cbError_None;
     cbInterrupt InterruptState = cbInterrupt_None;
     
     // Simulate until done
     printf("> Program executing\n");
+    if(IsThreaded)
+        Error = runThreaded(&Simulator);
     while(Error == cbError_None)
     {
-        // Step, catching any errors or interruptions
-        Error = cbStep(&Simulator, &InterruptState);
+        // Run a batch of instructions, catching any errors; user input is read off stdin
+        // by the processor's input provider as the program asks for it
+        Error = cbRun(&Simulator, 4096, &InterruptState);
         
-        // If interrupted for input
-        if(Error == cbError_None && InterruptState != cbInterrupt_None)
+        // Sleep through waits, rather than spinning until they are over, but not past the deadline
+        if(Error == cbError_None && InterruptState == cbInterrupt_Wait)
         {
-            // Get user input string
-            char input[256];
-            do {
-                scanf("%s", input);
-            } while(InterruptState == cbInterrupt_Input && strlen(input) <= 0);
-            
-            // Remove the interrupt state, posting the result of the user input
-            cbStep_ReleaseInterrupt(&Simulator, input);
+            unsigned long long WakeTime = cbStep_GetWakeTime(&Simulator);
+            cbUtil_SleepUntil((Deadline != 0 && Deadline < WakeTime) ? Deadline : WakeTime);
         }
     }
     
@@ -237,11 +426,30 @@ int main (int argc, const char * argv[])
     else
         printf("> Program terminated normally\n");
     
+    // How the output compared, if it was
+    if(Expected != NULL)
+    {
+        size_t Offset = 0;
+        cbCompareResult Result = cbCompare_GetResult(&Simulator, &Offset);
+        if(Result == cbCompareResult_Match)
+            printf("> Output matches the expected output\n");
+        else if(Result == cbCompareResult_Short)
+            printf("> Output stops short of the expected output, at byte %lu\n", Offset);
+        else if(Result == cbCompareResult_Excess)
+            printf("> Output goes on past the expected output, at byte %lu\n", Offset);
+        else
+            printf("> Output differs from the expected output, at byte %lu\n", Offset);
+    }
+    
     // Print ticks if verbose
     if(IsVerbose)
         printf("> Total ticks: %lu\n", cbDebug_GetTicks(&Simulator));
     
-    // Release
+    // Release, which writes out the last frame of any recording
     cbRelease(&Simulator);
+    if(RecordFile != NULL)
+        fclose(RecordFile);
+    free(UserInput);
+    free(Expected);
     return 0;
 }
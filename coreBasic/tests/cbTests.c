@@ -0,0 +1,501 @@
+/***************************************************************
+ 
+ cBasic - coreBasic - BASIC Language Interpreter on iOS
+ Copyright 2011 Jeremy Bridon - See License.txt for info
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: cbTests.c
+ Desc: Regression tests of the interpreter. Each program is run
+ on every engine, which must all agree with single-stepping on
+ both the output and the error the program stops on. Built
+ against the interpreter's sources, from this directory:
+ 
+   cc -std=gnu99 -o cbTests cbTests.c $(ls ../cb*.c) -lm -lpthread
+   cbTests
+ 
+ prints each test's outcome, returning the number that failed.
+ Translated programs are built with cc (or $CC).
+ 
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../cbLang.h"
+#include "../cbProcess.h"
+#include "../cbRecord.h"
+#include "../cbTranslate.h"
+
+// Ways of running a program; single-stepping (cbStep) is the reference the others must agree with
+typedef struct __cbTestEngine
+{
+    const char* Name;
+    unsigned int Options;
+    bool IsStepped;
+} cbTestEngine;
+
+static const cbTestEngine Engines[] =
+{
+    { "step", cbOption_None, true },
+    { "run", cbOption_None, false },
+    { "register", cbOption_RegisterMachine, false },
+    { "register-step", cbOption_RegisterMachine, true },
+    { "jit", cbOption_Jit, false },
+};
+
+// Output a program wrote, as collected by its output sink
+typedef struct __cbTestOutput
+{
+    char Text[4096];
+    size_t Length;
+} cbTestOutput;
+
+static void testOutputSink(void* Context, const char* Text, size_t Length)
+{
+    cbTestOutput* Output = Context;
+    size_t Count = (Length < sizeof(Output->Text) - Output->Length) ? Length : sizeof(Output->Text) - Output->Length;
+    memcpy(Output->Text + Output->Length, Text, Count);
+    Output->Length += Count;
+}
+
+// Programs run the same way on every engine, and as translated C: the user input given up front, then
+// the error the program must stop on (cbError_Halted if it finishes) and the output it must write
+typedef struct __cbTestProgram
+{
+    const char* Code;
+    const char* Input;
+    cbError Error;
+    const char* Output;
+} cbTestProgram;
+
+// Release the compile errors of a program that failed to compile, returning the first one
+static cbError releaseErrors(cbList* Errors)
+{
+    cbError Error = cbError_UnknownLine;
+    cbParseError* ParseError = NULL;
+    for(bool IsFirst = true; (ParseError = cbList_PopFront(Errors)) != NULL; IsFirst = false)
+    {
+        if(IsFirst)
+            Error = ParseError->ErrorCode;
+        free(ParseError);
+    }
+    return Error;
+}
+
+// Compile and run the given program to its end on the given engine, with all of its user input given up front;
+// returns the error it stopped on (cbError_Halted if it finished), or the first compile error
+static cbError runProgram(const char* Code, const char* Input, const cbTestEngine* Engine, cbTestOutput* Output)
+{
+    cbVirtualMachine Processor;
+    cbList Errors;
+    Output->Length = 0;
+    
+    if(!cbInit_LoadSourceCode(&Processor, 4096, Code, NULL, NULL, 96, 64, Engine->Options, &Errors))
+    {
+        cbRelease(&Processor);
+        return releaseErrors(&Errors);
+    }
+    
+    // A program waiting on input it never gets runs out of ticks rather than hanging the tests
+    cbStep_SetOutputSink(&Processor, testOutputSink, Output);
+    if(Input != NULL)
+        cbStep_SetInputBuffer(&Processor, Input, strlen(Input));
+    cbStep_SetTimeLimit(&Processor, 1000000, 0);
+    
+    cbError Error = cbError_None;
+    cbInterrupt Interrupt = cbInterrupt_None;
+    while(Error == cbError_None)
+        Error = Engine->IsStepped ? cbStep(&Processor, &Interrupt) : cbRun(&Processor, 4096, &Interrupt);
+    
+    // Releasing writes out whatever output is still buffered
+    cbRelease(&Processor);
+    return Error;
+}
+
+// Run the given program on every engine, checking each stops on the expected error with the expected output
+static bool expectRun(const char* Code, const char* Input, cbError ExpectedError, const char* ExpectedOutput)
+{
+    bool IsPassed = true;
+    for(size_t i = 0; i < sizeof(Engines) / sizeof(Engines[0]); i++)
+    {
+        cbTestOutput Output;
+        cbError Error = runProgram(Code, Input, &Engines[i], &Output);
+        if(Error != ExpectedError || Output.Length != strlen(ExpectedOutput) || memcmp(Output.Text, ExpectedOutput, Output.Length) != 0)
+        {
+            printf("  %s: error %d \"%.*s\", expected error %d \"%s\"\n", Engines[i].Name, Error, (int)Output.Length, Output.Text, ExpectedError, ExpectedOutput);
+            IsPassed = false;
+        }
+    }
+    return IsPassed;
+}
+
+// Translate the given program into C, build it with the C compiler (cc, or $CC) against the interpreter's
+// sources, and run it with the given user input, collecting all it prints; returns false if it can't be built
+static bool runTranslated(const char* Code, const char* Input, cbTestOutput* Output)
+{
+    cbVirtualMachine Processor;
+    cbList Errors;
+    Output->Length = 0;
+    
+    if(!cbInit_LoadSourceCode(&Processor, 4096, Code, NULL, NULL, 0, 0, cbOption_None, &Errors))
+    {
+        cbRelease(&Processor);
+        releaseErrors(&Errors);
+        return false;
+    }
+    
+    FILE* SourceFile = fopen("cbTestProgram.c", "w");
+    cbError Error = (SourceFile != NULL) ? cbTranslate_WriteProgram(&Processor, "cbTestProgram.cb", SourceFile) : cbError_Null;
+    if(SourceFile != NULL)
+        fclose(SourceFile);
+    cbRelease(&Processor);
+    if(Error != cbError_None || system("${CC:-cc} -std=gnu99 -I.. -o cbTestProgram cbTestProgram.c $(ls ../cb*.c | grep -v main.c) -lm -lpthread") != 0)
+        return false;
+    
+    char Command[256];
+    snprintf(Command, sizeof(Command), "printf '%s' | ./cbTestProgram", (Input != NULL) ? Input : "");
+    FILE* Pipe = popen(Command, "r");
+    if(Pipe != NULL)
+    {
+        Output->Length = fread(Output->Text, 1, sizeof(Output->Text), Pipe);
+        pclose(Pipe);
+    }
+    remove("cbTestProgram.c");
+    remove("cbTestProgram");
+    return Pipe != NULL;
+}
+
+// Run the given program as translated C, checking it stops on the expected error with the expected output,
+// reported the way the console interface does
+static bool expectTranslated(const char* Code, const char* Input, cbError ExpectedError, const char* ExpectedOutput)
+{
+    char Expected[4096];
+    if(ExpectedError == cbError_Halted)
+        snprintf(Expected, sizeof(Expected), "> Program executing\n%s> Program terminated normally\n", ExpectedOutput);
+    else
+        snprintf(Expected, sizeof(Expected), "> Program executing\n%s> Error %d, line ", ExpectedOutput, ExpectedError);
+    
+    cbTestOutput Output;
+    if(!runTranslated(Code, Input, &Output) || Output.Length < strlen(Expected) || memcmp(Output.Text, Expected, strlen(Expected)) != 0)
+    {
+        printf("  translated: \"%.*s\", expected \"%s\"\n", (int)Output.Length, Output.Text, Expected);
+        return false;
+    }
+    return true;
+}
+
+/*** Tests ***/
+
+// Arithmetic, a branch, and a failing division, all of which every engine must agree on
+static const cbTestProgram BasicPrograms[] =
+{
+    { "disp(3 + 4 * 2 / (1 - 5))\ndisp(\" \")\ndisp(15 / 3 * 4)\ndisp(\" \")\ndisp(7 % 3 - 2 * 3)\n", NULL, cbError_Halted, "1 20 -5" },
+    { "a = 3\nb = a * a + 1\nif(b == 10)\n  disp(\"ten\")\nend\ndisp(b)\n", NULL, cbError_Halted, "ten10" },
+    { "disp(\"x\")\na = 0\nb = 7 / a\ndisp(\"y\")\n", NULL, cbError_DivZero, "x" },
+};
+
+static bool testBasic()
+{
+    bool IsPassed = true;
+    for(size_t i = 0; i < sizeof(BasicPrograms) / sizeof(BasicPrograms[0]); i++)
+        IsPassed &= expectRun(BasicPrograms[i].Code, BasicPrograms[i].Input, BasicPrograms[i].Error, BasicPrograms[i].Output);
+    return IsPassed;
+}
+
+// Integer modulo by zero fails the way division does, keeping the output written so far; the
+// translated C (which always checked) is the reference, so these are shared with its test
+static const cbTestProgram ModZeroPrograms[] =
+{
+    { "disp(\"x\")\na = 7\nb = 0\nc = a % b\ndisp(\"y\")\n", NULL, cbError_DivZero, "x" },
+    { "disp(\"x\")\na = 7\na = a % 0\ndisp(\"y\")\n", NULL, cbError_DivZero, "x" },
+    { "disp(\"x\")\na = input()\nb = 7 % a\ndisp(\"y\")\n", "0", cbError_DivZero, "x" },
+    { "disp(\"x\")\na = 7\nb = 0\nc = a % (b * 1)\ndisp(\"y\")\n", NULL, cbError_DivZero, "x" },
+    { "disp(\"x\")\na = input()\nb = 7 % (a * 1)\ndisp(\"y\")\n", "0", cbError_DivZero, "x" },
+    { "a = 7\nb = 3\ndisp(a % b)\n", NULL, cbError_Halted, "1" },
+};
+
+static bool testModZero()
+{
+    bool IsPassed = true;
+    for(size_t i = 0; i < sizeof(ModZeroPrograms) / sizeof(ModZeroPrograms[0]); i++)
+        IsPassed &= expectRun(ModZeroPrograms[i].Code, ModZeroPrograms[i].Input, ModZeroPrograms[i].Error, ModZeroPrograms[i].Output);
+    return IsPassed;
+}
+
+static bool testTranslatedModZero()
+{
+    bool IsPassed = true;
+    for(size_t i = 0; i < sizeof(ModZeroPrograms) / sizeof(ModZeroPrograms[0]); i++)
+        IsPassed &= expectTranslated(ModZeroPrograms[i].Code, ModZeroPrograms[i].Input, ModZeroPrograms[i].Error, ModZeroPrograms[i].Output);
+    return IsPassed;
+}
+
+// Programs with many string constants and lines fill memory with their code, data, and line table: each one
+// either fits and runs as usual, or fails to compile, but never writes past the memory; and once one doesn't
+// fit, no longer one does
+static bool testCompileStrings()
+{
+    static char Code[8192], Output[4096];
+    size_t CodeLength = 0, OutputLength = 0;
+    bool IsPassed = true, IsFitting = true;
+    for(int LineCount = 1; LineCount <= 120; LineCount++)
+    {
+        CodeLength += sprintf(Code + CodeLength, "disp(\"string constant %d\")\n", LineCount);
+        OutputLength += sprintf(Output + OutputLength, "string constant %d", LineCount);
+        
+        cbTestOutput RunOutput;
+        cbError Error = runProgram(Code, NULL, &Engines[0], &RunOutput);
+        if(Error == cbError_Overflow && RunOutput.Length == 0)
+            IsFitting = false;
+        else if(!IsFitting || !expectRun(Code, NULL, cbError_Halted, Output))
+        {
+            printf("  %d lines: error %d\n", LineCount, Error);
+            IsPassed = false;
+        }
+    }
+    
+    // Memory (of 4096 bytes) can't fit all of them
+    return IsPassed && !IsFitting;
+}
+
+// And and or of integers, alone and in branches; the register machine computes them on its own, so must
+// agree with the stack engines, and both operands must be integers (or booleans)
+static const cbTestProgram LogicPrograms[] =
+{
+    { "a = 0\nb = 1\nc = (a or b)\ndisp(c)\n", NULL, cbError_Halted, "1" },
+    { "a = 0\nb = 0\nc = (a or b)\ndisp(c)\n", NULL, cbError_Halted, "0" },
+    { "a = 1\nb = 0\nc = (a and b)\ndisp(c)\n", NULL, cbError_Halted, "0" },
+    { "a = 1\nb = 2\nc = (a and b)\ndisp(c)\n", NULL, cbError_Halted, "1" },
+    { "a = 3\nif(a < 2 or a > 2)\n  disp(\"y\")\nend\nif(a < 2 and a > 2)\n  disp(\"n\")\nend\n", NULL, cbError_Halted, "y" },
+    { "disp(\"x\")\na = \"s\"\nc = (1 or a)\ndisp(\"y\")\n", NULL, cbError_TypeMismatch, "x" },
+    { "disp(\"x\")\na = \"s\"\nc = (a and 1)\ndisp(\"y\")\n", NULL, cbError_TypeMismatch, "x" },
+};
+
+static bool testLogic()
+{
+    bool IsPassed = true;
+    for(size_t i = 0; i < sizeof(LogicPrograms) / sizeof(LogicPrograms[0]); i++)
+        IsPassed &= expectRun(LogicPrograms[i].Code, LogicPrograms[i].Input, LogicPrograms[i].Error, LogicPrograms[i].Output);
+    return IsPassed;
+}
+
+static bool testTranslatedLogic()
+{
+    bool IsPassed = true;
+    for(size_t i = 0; i < sizeof(LogicPrograms) / sizeof(LogicPrograms[0]); i++)
+        IsPassed &= expectTranslated(LogicPrograms[i].Code, LogicPrograms[i].Input, LogicPrograms[i].Error, LogicPrograms[i].Output);
+    return IsPassed;
+}
+
+// With a back buffer, the frame the host latched stays whole and unchanged until it latches again, however
+// many frames are drawn and flipped meanwhile; each frame here is a single color, different from the last
+static bool testLatchedFrame()
+{
+    const char* Code = "i = 0\nwhile(i < 40)\n  clear()\n  rect(0, 0, 96, 64, i % 3 + 1)\n  flip()\n  i = i + 1\nend\n";
+    cbVirtualMachine Processor;
+    cbList Errors;
+    if(!cbInit_LoadSourceCode(&Processor, 4096, Code, NULL, NULL, 96, 64, cbOption_DoubleBuffer, &Errors))
+    {
+        cbRelease(&Processor);
+        releaseErrors(&Errors);
+        return false;
+    }
+    
+    static unsigned char Frame[96 * 64];
+    const unsigned char* Latched = cbStep_GetScreenBuffer(&Processor);
+    memcpy(Frame, Latched, sizeof(Frame));
+    
+    bool IsPassed = true;
+    cbError Error = cbError_None;
+    cbInterrupt Interrupt = cbInterrupt_None;
+    for(size_t Step = 1; Error == cbError_None; Step++)
+    {
+        Error = cbStep(&Processor, &Interrupt);
+        if(Step % 7 != 0)
+            continue;
+        
+        // Still the frame latched last, then latch the one shown now
+        IsPassed &= (memcmp(Latched, Frame, sizeof(Frame)) == 0);
+        Latched = cbStep_GetScreenBuffer(&Processor);
+        memcpy(Frame, Latched, sizeof(Frame));
+        for(size_t i = 1; i < sizeof(Frame); i++)
+            IsPassed &= (Frame[i] == Frame[0]);
+    }
+    
+    cbRelease(&Processor);
+    return IsPassed && Error == cbError_Halted;
+}
+
+// Count the frames in a frame stream (see cbRecord.h); -1 if it's cut short or has no header
+static int countFrames(const cbTestOutput* Stream)
+{
+    if(Stream->Length < 10 || memcmp(Stream->Text, cbRecord_Magic, sizeof(cbRecord_Magic)) != 0)
+        return -1;
+    
+    int FrameCount = 0;
+    const unsigned char* Data = (const unsigned char*)Stream->Text;
+    for(size_t Offset = 10; Offset < Stream->Length; FrameCount++)
+    {
+        if(Stream->Length - Offset < 12)
+            return -1;
+        size_t PayloadLength = Data[Offset + 8] | (Data[Offset + 9] << 8) | (Data[Offset + 10] << 16) | ((size_t)Data[Offset + 11] << 24);
+        Offset += 12 + PayloadLength;
+        if(Offset > Stream->Length)
+            return -1;
+    }
+    return FrameCount;
+}
+
+// Every flip is recorded, with or without a back buffer, on every engine; each frame here differs from the last
+static bool testRecordFlips()
+{
+    const char* Code = "i = 0\nwhile(i < 12)\n  rect(0, 0, 96, 64, i % 3 + 1)\n  flip()\n  i = i + 1\nend\n";
+    const unsigned int Modes[] = { cbOption_None, cbOption_DoubleBuffer };
+    bool IsPassed = true;
+    for(size_t i = 0; i < sizeof(Engines) / sizeof(Engines[0]); i++)
+    {
+        for(size_t j = 0; j < sizeof(Modes) / sizeof(Modes[0]); j++)
+        {
+            cbVirtualMachine Processor;
+            cbList Errors;
+            if(!cbInit_LoadSourceCode(&Processor, 4096, Code, NULL, NULL, 96, 64, Engines[i].Options | Modes[j], &Errors))
+            {
+                cbRelease(&Processor);
+                releaseErrors(&Errors);
+                return false;
+            }
+            
+            // Frames are only taken on flips (and the halt, which changes nothing)
+            cbTestOutput Stream;
+            Stream.Length = 0;
+            cbRecord_Start(&Processor, testOutputSink, &Stream, 0);
+            
+            cbError Error = cbError_None;
+            cbInterrupt Interrupt = cbInterrupt_None;
+            while(Error == cbError_None)
+                Error = Engines[i].IsStepped ? cbStep(&Processor, &Interrupt) : cbRun(&Processor, 4096, &Interrupt);
+            cbRelease(&Processor);
+            
+            int FrameCount = countFrames(&Stream);
+            if(Error != cbError_Halted || FrameCount != 12)
+            {
+                printf("  %s%s: error %d, %d frames, expected 12\n", Engines[i].Name, (Modes[j] == cbOption_DoubleBuffer) ? " (back buffer)" : "", Error, FrameCount);
+                IsPassed = false;
+            }
+        }
+    }
+    return IsPassed;
+}
+
+// Run the given program until it stops, or is interrupted, on the given engine
+static cbError runUntilInterrupt(cbVirtualMachine* Processor, const cbTestEngine* Engine, cbInterrupt* Interrupt)
+{
+    cbError Error = cbError_None;
+    *Interrupt = cbInterrupt_None;
+    while(Error == cbError_None && *Interrupt == cbInterrupt_None)
+        Error = Engine->IsStepped ? cbStep(Processor, Interrupt) : cbRun(Processor, 4096, Interrupt);
+    return Error;
+}
+
+// A program interrupted for input on the very tick its limit runs out reports the interrupt, then the limit
+static bool testInterruptAtLimit()
+{
+    const char* Code = "disp(\"x\")\na = input()\ndisp(a)\n";
+    bool IsPassed = true;
+    for(size_t i = 0; i < sizeof(Engines) / sizeof(Engines[0]); i++)
+    {
+        // Count the ticks up to the interrupt, then run again with exactly that many
+        size_t Ticks = 0;
+        for(int Pass = 0; Pass < 2; Pass++)
+        {
+            cbVirtualMachine Processor;
+            cbList Errors;
+            if(!cbInit_LoadSourceCode(&Processor, 4096, Code, NULL, NULL, 96, 64, Engines[i].Options, &Errors))
+            {
+                cbRelease(&Processor);
+                releaseErrors(&Errors);
+                return false;
+            }
+            
+            cbInterrupt Interrupt = cbInterrupt_None, LimitInterrupt = cbInterrupt_None;
+            cbStep_SetTimeLimit(&Processor, Ticks, 0);
+            cbError Error = runUntilInterrupt(&Processor, &Engines[i], &Interrupt);
+            cbError LimitError = (Pass == 0) ? cbError_TimeLimit : runUntilInterrupt(&Processor, &Engines[i], &LimitInterrupt);
+            Ticks = Processor.Ticks;
+            cbRelease(&Processor);
+            
+            if(Error != cbError_None || Interrupt != cbInterrupt_Input || LimitError != cbError_TimeLimit)
+            {
+                printf("  %s: error %d, interrupt %d, then error %d\n", Engines[i].Name, Error, Interrupt, LimitError);
+                IsPassed = false;
+            }
+        }
+    }
+    return IsPassed;
+}
+
+// A deadline stops a program that never gives control back, even one single-stepped
+static bool testDeadline()
+{
+    const char* Code = "a = 1\nwhile(a > 0)\n  a = 1\nend\n";
+    bool IsPassed = true;
+    for(size_t i = 0; i < sizeof(Engines) / sizeof(Engines[0]); i++)
+    {
+        cbVirtualMachine Processor;
+        cbList Errors;
+        if(!cbInit_LoadSourceCode(&Processor, 4096, Code, NULL, NULL, 96, 64, Engines[i].Options, &Errors))
+        {
+            cbRelease(&Processor);
+            releaseErrors(&Errors);
+            return false;
+        }
+        
+        cbInterrupt Interrupt = cbInterrupt_None;
+        cbStep_SetTimeLimit(&Processor, 0, 50);
+        cbError Error = runUntilInterrupt(&Processor, &Engines[i], &Interrupt);
+        cbRelease(&Processor);
+        
+        if(Error != cbError_TimeLimit)
+        {
+            printf("  %s: error %d, expected %d\n", Engines[i].Name, Error, cbError_TimeLimit);
+            IsPassed = false;
+        }
+    }
+    return IsPassed;
+}
+
+// All tests, in the order they run
+typedef struct __cbTest
+{
+    const char* Name;
+    bool (*Function)();
+} cbTest;
+
+static const cbTest Tests[] =
+{
+    { "basic programs", testBasic },
+    { "mod by zero", testModZero },
+    { "mod by zero, translated", testTranslatedModZero },
+    { "compile many strings", testCompileStrings },
+    { "logic ops", testLogic },
+    { "logic ops, translated", testTranslatedLogic },
+    { "latched frame", testLatchedFrame },
+    { "record every flip", testRecordFlips },
+    { "interrupt at the tick limit", testInterruptAtLimit },
+    { "deadline", testDeadline },
+};
+
+// Main application entry point
+int main(int argc, const char* argv[])
+{
+    int FailedCount = 0;
+    for(size_t i = 0; i < sizeof(Tests) / sizeof(Tests[0]); i++)
+    {
+        bool IsPassed = Tests[i].Function();
+        printf("%s %s\n", IsPassed ? "PASS" : "FAIL", Tests[i].Name);
+        FailedCount += IsPassed ? 0 : 1;
+    }
+    return FailedCount;
+}
@@ -0,0 +1,127 @@
+/***************************************************************
+ 
+ cBasic - coreBasic - BASIC Language Interpreter on iOS
+ Copyright 2011 Jeremy Bridon - See License.txt for info
+ 
+ This source file is developed and maintained by:
+ + Jeremy Bridon jbridon@cores2.com
+ 
+ File: cbFrameDecode.c
+ Desc: Decodes a frame stream (see cbRecord.h) back into a
+ series of grayscale PGM images, one per frame, for checking
+ what a recorded program drew. Stands on its own:
+ 
+   cc -std=c99 -o cbFrameDecode cbFrameDecode.c
+   cbFrameDecode recording.cbfs frame
+ 
+ writes frame0000.pgm, frame0001.pgm, ...
+ 
+***************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Gray levels of the four colors, from white to black
+static const unsigned char Palette[4] = { 255, 170, 85, 0 };
+
+// Read a little-endian integer of the given size; returns 0 if the stream ran out
+static int readInt(FILE* In, unsigned long long* Value, size_t Bytes)
+{
+    unsigned char Buffer[8];
+    if(fread(Buffer, 1, Bytes, In) != Bytes)
+        return 0;
+    
+    *Value = 0;
+    for(size_t i = 0; i < Bytes; i++)
+        *Value |= (unsigned long long)Buffer[i] << (i * 8);
+    return 1;
+}
+
+// Main application entry point
+int main(int argc, const char* argv[])
+{
+    if(argc != 3)
+    {
+        printf("Usage: cbFrameDecode <frame stream> <output prefix>\n");
+        return -1;
+    }
+    
+    FILE* In = fopen(argv[1], "rb");
+    if(In == NULL)
+    {
+        printf("Unable to open the given frame stream \"%s\"\n", argv[1]);
+        return -1;
+    }
+    
+    // Check the header
+    unsigned char Header[6];
+    unsigned long long Width, Height;
+    if(fread(Header, 1, sizeof(Header), In) != sizeof(Header) || memcmp(Header, "cbFS", 4) != 0 || Header[4] != 1 ||
+       !readInt(In, &Width, 2) || !readInt(In, &Height, 2))
+    {
+        printf("Not a frame stream (or an unknown version)\n");
+        fclose(In);
+        return -1;
+    }
+    
+    // Frames are XORed into the colors, all zero at first
+    size_t PixelCount = (size_t)(Width * Height);
+    unsigned char* Colors = calloc(PixelCount + 1, 1);
+    unsigned char* Payload = malloc(PixelCount + 1);
+    unsigned char* Image = malloc(PixelCount + 1);
+    
+    int FrameIndex = 0;
+    unsigned long long Ticks, PayloadLength;
+    while(readInt(In, &Ticks, 8))
+    {
+        if(!readInt(In, &PayloadLength, 4) || PayloadLength > PixelCount || fread(Payload, 1, PayloadLength, In) != PayloadLength)
+        {
+            printf("Frame %d is cut short\n", FrameIndex);
+            break;
+        }
+        
+        // Apply the runs, which must cover the screen exactly
+        size_t Pixel = 0;
+        for(size_t i = 0; i < PayloadLength; i++)
+        {
+            size_t Length = (Payload[i] & 0x3F) + 1;
+            unsigned char Value = Payload[i] >> 6;
+            if(Pixel + Length > PixelCount)
+                break;
+            for(size_t j = 0; j < Length; j++)
+                Colors[Pixel++] ^= Value;
+        }
+        if(Pixel != PixelCount)
+        {
+            printf("Frame %d does not cover the screen\n", FrameIndex);
+            break;
+        }
+        
+        // PGM rows go top-down, while the screen's origin is in the bottom left
+        for(size_t Y = 0; Y < Height; Y++)
+            for(size_t X = 0; X < Width; X++)
+                Image[(Height - 1 - Y) * Width + X] = Palette[Colors[Y * Width + X] & 3];
+        
+        char FileName[1024];
+        snprintf(FileName, sizeof(FileName), "%s%04d.pgm", argv[2], FrameIndex);
+        FILE* Out = fopen(FileName, "wb");
+        if(Out == NULL)
+        {
+            printf("Unable to write the frame file \"%s\"\n", FileName);
+            break;
+        }
+        fprintf(Out, "P5\n# ticks %llu\n%llu %llu\n255\n", Ticks, Width, Height);
+        fwrite(Image, 1, PixelCount, Out);
+        fclose(Out);
+        
+        printf("%s: tick %llu\n", FileName, Ticks);
+        FrameIndex++;
+    }
+    
+    free(Colors);
+    free(Payload);
+    free(Image);
+    fclose(In);
+    return 0;
+}
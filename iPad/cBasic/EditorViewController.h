@@ -18,6 +18,7 @@
 #import "DebugEditorView.h"
 #import "cbLang.h"
 #import "cbProcess.h"
+#import "cbRunner.h"
 #import "PopDownController.h"
 
 @interface EditorViewController : UIViewController <PopDownControllerDelegate>
@@ -29,17 +30,14 @@
     // Processor handle for simulation and any errors associated with it
     cbProcessor Processor;
     cbError SimulatorError;
-    cbInterrupt InterruptState;
+    
+    // Runner of the processor, on its own thread, while the program runs
+    cbRunner* Runner;
     
     // Main text editor and debug interface
     TextEditorView* ViewEditor;
     DebugEditorView* ViewDebug;
     
-    // File stream I/O
-    FILE* StreamOut;
-    FILE* StreamIn;
-    int StreamReadPos;
-    
     // Date-time format used throughout the UI
     NSDateFormatter* DateTimeFormat;
     
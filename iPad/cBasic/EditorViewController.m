@@ -222,6 +222,8 @@
 {
     // Halt simulation
     [GUITimer invalidate];
+    cbRunner_Release(Runner);
+    Runner = NULL;
     
     // Turn on buttons again
     [RunButton setEnabled:true];
@@ -232,10 +234,6 @@
     // Release process
     cbRelease(&Processor);
     
-    // Close file streams
-    fclose(StreamOut);
-    fclose(StreamIn);
-    
     // Post that we halted the process
     NSDate* Today = [[NSDate alloc] init];
     [TopBuildLabel setText:[NSString stringWithFormat: @"Stopped cBasic | User-halted, %.2f seconds", (float)(Today.timeIntervalSince1970 - SimulationStart.timeIntervalSince1970)]];
@@ -272,15 +270,11 @@
 
 -(void) compileCode: (NSString*) Code
 {
-    // File streams for input / output (must be allocated first since we are sharing)
-    StreamOut = tmpfile();
-    StreamIn = tmpfile();
-    StreamReadPos = 0;
-    
-    // Start compiling code... (2 meg ram)
+    // Start compiling code... (2 meg ram); no file streams, since the runner passes output
+    // and input along once the program runs
     const char* SourceCode = [Code UTF8String];
-    SimulatorError = cbInit_LoadSource(&Processor, 2048, SourceCode, StreamOut, StreamIn, ScreenView_ScreenWidth, ScreenView_ScreenHeight);
-    InterruptState = cbInterrupt_None;
+    SimulatorError = cbInit_LoadSource(&Processor, 2048, SourceCode, NULL, NULL, ScreenView_ScreenWidth, ScreenView_ScreenHeight);
+    Runner = NULL;
     
     // Was there any sort of error?
     if(SimulatorError != cbError_NoError)
@@ -301,10 +295,6 @@
         
         // Release process
         cbRelease(&Processor);
-        
-        // Close file streams
-        fclose(StreamOut);
-        fclose(StreamIn);
     }
     else
     {
@@ -359,7 +349,8 @@
         // Save the simulation start time
         SimulationStart = [[NSDate alloc] init];
         
-        // Launch main-thread simulation
+        // The program runs on its own thread, at full speed; the timer only keeps up with it
+        Runner = cbRunner_Start(&Processor, 4096, 256);
         [GUITimer fire];
     }
     
@@ -370,96 +361,51 @@
 -(void) launchSimulation: (id)sender
 {
     // This timer must launch from the main thread, but does not yet start 
-    // Current simulation speed is 1kHz
-    GUITimer = [NSTimer scheduledTimerWithTimeInterval:0.001f target:self selector:@selector(simulateCode:) userInfo:nil repeats:true];
+    // It keeps up with the simulation at the screen's rate
+    GUITimer = [NSTimer scheduledTimerWithTimeInterval:1.0f / 60.0f target:self selector:@selector(simulateCode:) userInfo:nil repeats:true];
 }
 
 -(void) simulateCode: (NSTimer*)sender
 {
+    // Everything written out before the state was posted is there to read
+    cbRunnerState State = cbRunner_GetState(Runner);
+    
+    /*** Output from Simulation ***/
+    
+    // Pass all new output along to the console
+    char Output[1024];
+    size_t OutputLength;
+    while((OutputLength = cbRunner_ReadOutput(Runner, Output, sizeof(Output))) > 0)
+        [[ViewDebug TextField] pushMessage:[[NSString alloc] initWithBytes:Output length:OutputLength encoding:NSASCIIStringEncoding] isOutput:true];
+    
+    // Present the whole screen as it is now, without waiting on the worker
+    [[ViewDebug MainScreen] presentScreenOf:&Processor];
+    
     /*** Input wanted from Simulation ***/
     
-    // If interrupted for input
-    if(SimulatorError == cbError_NoError && InterruptState != cbInterrupt_None)
+    // If waiting on input, pass it along once the user gave it
+    if(State == cbRunnerState_Waiting)
     {
-        // If waiting for full input line..
-        if(InterruptState == cbInterrupt_Input)
-        {
-            // Get current input
-            NSString* UserInput = [[ViewDebug TextField] getMessage];
-            char input[256] = "";
-            
-            // If valid, copy, else give up until input
-            if(UserInput != NULL)
-                strncpy(input, [UserInput UTF8String], 255);
-            else
-                return;
-            
-            // Post the result
-            cbStep_ReleaseInterrupt(&Processor, input);
-            InterruptState = cbInterrupt_None;
-        }
-        // Else, not yet supported
-        else
-        {
-            [[ViewDebug TextField] pushMessage:@"WARNING: Unable to handle this type of interrupt\n" isOutput:true];
-            cbStep_ReleaseInterrupt(&Processor, "");
-            InterruptState = cbInterrupt_None;
-        }
+        NSString* UserInput = [[ViewDebug TextField] getMessage];
+        if(UserInput != NULL)
+            cbRunner_PostInput(Runner, [UserInput UTF8String]);
     }
     
-    // Keep simulating
-    else if(SimulatorError == cbError_NoError)
+    // Still running, update clock
+    if(State != cbRunnerState_Stopped)
     {
-        /*** Simulate ***/
-        
-        // Step (must lock for file I/O)
-        SimulatorError = cbStep(&Processor, &InterruptState);
-        
-        /*** Screen output from Simulation ***/
-        
-        // For any and all new drawing events
-        unsigned int x;
-        unsigned int y;
-        unsigned int c;
-        while(cbStep_GetOutput(&Processor, &x, &y, &c))
-        {
-            // If max, it's a clear event
-            if(x == UINT_MAX && y == UINT_MAX && c == UINT_MAX)
-                [[ViewDebug MainScreen] clearScreen];
-            else
-                [[ViewDebug MainScreen] setPixel:c atX:x atY:y];
-        }
-        
-        /*** Output from Simulation ***/
-        
-        // Save the current write-pointer
-        int writePos = ftell(StreamOut);
-        fseek(StreamOut, StreamReadPos, SEEK_SET);
-        
-        // Anything new in the file output sream?
-        char buffer[512];
-        size_t bufferLength = fread(buffer, 1, 512, StreamOut);
-        if(bufferLength > 0)
-        {
-            // Cap buffer, push to stdout, and then move the read
-            // pos so we don't re-read what we have already read
-            buffer[bufferLength] = '\0';
-            StreamReadPos += bufferLength;
-            
-            // Push to the text console output
-            [[ViewDebug TextField] pushMessage:[NSString stringWithCString:buffer encoding:NSASCIIStringEncoding] isOutput:true];
-        }
-        
-        // Set the write-pointer back
-        fseek(StreamOut, (long)writePos, SEEK_SET);
-        
-        // Still running, update clock
         NSDate* Today = [[NSDate alloc] init];
         [TopBuildLabel setText:[NSString stringWithFormat:@"Running cBasic | Running %d seconds", (int)(Today.timeIntervalSince1970 - SimulationStart.timeIntervalSince1970)]];
     }
-    // Else, this step failed
+    // Else, the program stopped
     else
     {
+        // Keep any build error, if it never got to run
+        if(Runner != NULL)
+            SimulatorError = cbRunner_Stop(Runner);
+        cbRunner_Release(Runner);
+        Runner = NULL;
+        
         // Process crashed
         if(SimulatorError != cbError_NoError && SimulatorError != cbError_Halted)
         {
@@ -483,10 +429,6 @@
         // Release process
         cbRelease(&Processor);
         
-        // Close file streams
-        fclose(StreamOut);
-        fclose(StreamIn);
-        
         // Stop this timer
         [sender invalidate];
     }
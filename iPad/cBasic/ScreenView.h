@@ -15,6 +15,7 @@
 ***************************************************************/
 
 #import <UIKit/UIKit.h>
+#import "cbProcess.h"
 
 // The type of color
 typedef enum __ScreenView_Color
@@ -31,12 +32,13 @@ static const int ScreenView_ScreenHeight = 64;
 
 @interface ScreenView : UIView
 {
-    // Pixel data
-    char* ScreenBuffer;
+    // Pixel data (RGBA), and the surface the processor's screen is presented into
+    unsigned char* ScreenBuffer;
+    cbSurface Surface;
 }
 
-// Set the pixel color at the given pixel coordinate
--(void) setPixel: (ScreenView_Color)Color atX: (int)x atY: (int) y;
+// Copy the whole of the processor's screen, as it is now (without waiting on the processor)
+-(void) presentScreenOf: (cbProcessor*)Processor;
 
 // Clear the screen
 -(void) clearScreen;
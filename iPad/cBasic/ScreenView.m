@@ -17,8 +17,17 @@
     self = [super initWithCoder:aDecoder];
     if(self)
     {
-        // Allocate the screen buffer and clear it
-        ScreenBuffer = malloc(sizeof(char) * ScreenView_ScreenWidth * ScreenView_ScreenHeight);
+        // Allocate the screen buffer and clear it; the four colors are the background, then 3 levels of grayscale
+        static const unsigned char Palette[4][4] = {
+            { 217, 217, 217, 255 },
+            { 145, 145, 145, 255 },
+            { 71, 71, 71, 255 },
+            { 0, 0, 0, 255 },
+        };
+        
+        // Rows are laid out bottom-up, since the image is drawn upside down into the view
+        ScreenBuffer = malloc(4 * ScreenView_ScreenWidth * ScreenView_ScreenHeight);
+        cbStep_InitSurface(&Surface, ScreenBuffer + 4 * ScreenView_ScreenWidth * (ScreenView_ScreenHeight - 1), -4 * ScreenView_ScreenWidth, cbSurfaceFormat_RGBA32, 1, Palette);
         [self clearScreen];
     }
     return self;
@@ -29,18 +38,20 @@
     free(ScreenBuffer);
 }
 
--(void) setPixel: (ScreenView_Color)Color atX: (int)x atY: (int) y
+-(void) presentScreenOf: (cbProcessor*)Processor
 {
-    // Ignore if out of bounds
-    if(x >= 0 && y >= 0 && x < ScreenView_ScreenWidth && y < ScreenView_ScreenHeight)
-        ScreenBuffer[y * ScreenView_ScreenWidth + x] = (char)Color;
+    // The processor runs on its own thread, so what changed can't be asked for from here (that clears the
+    // rows it marks), and nothing waits on it: the whole screen is converted as it is right now, which may
+    // be partly drawn unless the program draws into a back buffer; the next timer tick catches up
+    cbStep_PresentScreen(Processor, &Surface, NULL, 0);
     [self setNeedsDisplay];
 }
 
 -(void) clearScreen
 {
-    // Clear the screen (i.e. replace all bytes to 0)
-    memset(ScreenBuffer, 0, sizeof(char) * ScreenView_ScreenWidth * ScreenView_ScreenHeight);
+    // Clear the screen (i.e. all pixels to the background color)
+    for(int i = 0; i < ScreenView_ScreenWidth * ScreenView_ScreenHeight; i += 4)
+        memcpy(ScreenBuffer + i * 4, Surface.Expansion[0], 16);
     [self setNeedsDisplay];
 }
 
@@ -48,32 +59,18 @@
 // An empty implementation adversely affects performance during animation.
 - (void)drawRect:(CGRect)rect
 {
-    // Pixel width and height
-    float PixelWidth = [self frame].size.width / (float)ScreenView_ScreenWidth;
-    float PixelHeight = [self frame].size.height / (float)ScreenView_ScreenHeight;
-    
-    // Generate the four colors (background, then 3 levels of grayscale
-    CGColorRef Colors[4] = {
-        [UIColor colorWithRed:0.85f green:0.85f blue:0.85f alpha:1].CGColor,
-        [UIColor colorWithRed:0.57f green:0.57f blue:0.57f alpha:1].CGColor,
-        [UIColor colorWithRed:0.28f green:0.28f blue:0.28f alpha:1].CGColor,
-        [UIColor colorWithRed:0 green:0 blue:0 alpha:1].CGColor,
-    };
-    
     // Initialize the graphics context
     CGContextRef context = UIGraphicsGetCurrentContext();
     
-    // For each pixel
-    for(int y = 0; y < ScreenView_ScreenHeight; y++)
-    for(int x = 0; x < ScreenView_ScreenWidth; x++)
-    {
-        // Randomize the color
-        // Mod 4 is just so we cycle through colors if needed
-        CGContextSetFillColorWithColor(context, Colors[ScreenBuffer[y * ScreenView_ScreenWidth + x] % 4]);
-        
-        // Draw pixel
-        CGContextFillRect(context, CGRectMake((float)x * PixelWidth, (float)y * PixelHeight, PixelWidth, PixelHeight));
-    }
+    // Wrap the pixels as an image, and stretch it over the whole view with hard pixel edges
+    CGColorSpaceRef ColorSpace = CGColorSpaceCreateDeviceRGB();
+    CGDataProviderRef Provider = CGDataProviderCreateWithData(NULL, ScreenBuffer, 4 * ScreenView_ScreenWidth * ScreenView_ScreenHeight, NULL);
+    CGImageRef Image = CGImageCreate(ScreenView_ScreenWidth, ScreenView_ScreenHeight, 8, 32, 4 * ScreenView_ScreenWidth, ColorSpace, kCGImageAlphaNoneSkipLast, Provider, NULL, false, kCGRenderingIntentDefault);
+    CGContextSetInterpolationQuality(context, kCGInterpolationNone);
+    CGContextDrawImage(context, CGRectMake(0, 0, [self frame].size.width, [self frame].size.height), Image);
+    CGImageRelease(Image);
+    CGDataProviderRelease(Provider);
+    CGColorSpaceRelease(ColorSpace);
     
     // Draw an empty black rectnagle on the border
     CGContextSetStrokeColorWithColor(context, [UIColor blackColor].CGColor);